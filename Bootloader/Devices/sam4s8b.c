@@ -189,10 +189,10 @@ void Chip_download_complete()
 		print("Flashed cleared!" NL);
 		break;
 	}
-	print(" Page: ");
-	printHex( storage_page_position() );
-	print( " Block: ");
-	printHex( storage_block_position() );
+	print(" Sector: ");
+	printHex( storage_sector_position() );
+	print( " Offset: ");
+	printHex( storage_log_position() );
 	print( NL );
 }
 
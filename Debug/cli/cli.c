@@ -33,6 +33,7 @@
 #include <latency.h>
 #include <led.h>
 #include <print.h>
+#include <trace.h>
 
 // KLL Includes
 #include <kll_defs.h>
@@ -55,11 +56,13 @@ CLIDict_Entry( help,      "You're looking at it :P" );
 CLIDict_Entry( latency,   "Show latency of specific modules and routiines. Specify index for a single item" );
 CLIDict_Entry( led,       "Enables/Disables indicator LED. Try a couple times just in case the LED is in an odd state.\r\n\t\t\033[33mWarning\033[0m: May adversely affect some modules..." );
 CLIDict_Entry( periodic,  "Set the number of clock cycles between periodic scans." );
+CLIDict_Entry( printBuffer, "Shows debug output buffer usage and dropped bytes." );
 CLIDict_Entry( rand,      "If entropy available, print a random 32-bit number." );
 CLIDict_Entry( reload,    "Signals microcontroller to reflash/reload." );
 CLIDict_Entry( reset,     "Resets the terminal back to initial settings." );
 CLIDict_Entry( restart,   "Sends a software restart, should be similar to powering on the device." );
 CLIDict_Entry( tick,      "Displays the fundamental tick size, and current ticks since last systick." );
+CLIDict_Entry( trace,     "Show binary trace status. Specify a mask to set the traced event classes:" NL "\t\t1 Keys, 2 Votes, 4 Capabilities, 8 Animation frames, 16 I2C" );
 CLIDict_Entry( ram,       "Shows the current and max ram usage" );
 CLIDict_Entry( mpu,       "Shows the current memory regions" );
 CLIDict_Entry( version,   "Version information about this firmware." );
@@ -75,11 +78,13 @@ CLIDict_Def( basicCLIDict, "General Commands" ) = {
 	CLIDict_Item( latency ),
 	CLIDict_Item( led ),
 	CLIDict_Item( periodic ),
+	CLIDict_Item( printBuffer ),
 	CLIDict_Item( rand ),
 	CLIDict_Item( reload ),
 	CLIDict_Item( reset ),
 	CLIDict_Item( restart ),
 	CLIDict_Item( tick ),
+	CLIDict_Item( trace ),
 	CLIDict_Item( ram ),
 	CLIDict_Item( mpu ),
 	CLIDict_Item( version ),
@@ -651,6 +656,13 @@ void cliFunc_periodic( char* args )
 	printInt32( Periodic_cycles() );
 }
 
+void cliFunc_printBuffer( char* args )
+{
+	print( NL );
+	info_msg("Debug Output Buffers");
+	Print_stats();
+}
+
 void cliFunc_rand( char* args )
 {
 	print( NL );
@@ -676,6 +688,9 @@ void cliFunc_reload( char* args )
 		return;
 	}
 
+	// Write out buffered messages before the output module goes away
+	Print_flush();
+
 	// Request to output module to be set into firmware reload mode
 	Output_firmwareReload();
 }
@@ -687,7 +702,8 @@ void cliFunc_reset( char* args )
 
 void cliFunc_restart( char* args )
 {
-	// Trigger an overall software reset
+	// Write out buffered messages, then trigger an overall software reset
+	Print_flush();
 	Output_softReset();
 }
 
@@ -709,6 +725,23 @@ void cliFunc_tick( char* args )
 	print( NL );
 }
 
+void cliFunc_trace( char* args )
+{
+	// Parse number from argument
+	//  NOTE: Only first argument is used
+	char* arg1Ptr;
+	char* arg2Ptr;
+	CLI_argumentIsolation( args, &arg1Ptr, &arg2Ptr );
+
+	// Set event mask if an argument is given
+	if ( arg1Ptr[0] != '\0' )
+	{
+		Trace_mask = (uint8_t)numToInt( arg1Ptr );
+	}
+
+	Trace_stats();
+}
+
 void cliFunc_version( char* args )
 {
 	print( NL );
@@ -126,11 +126,13 @@ void cliFunc_help     ( char* args );
 void cliFunc_latency  ( char* args );
 void cliFunc_led      ( char* args );
 void cliFunc_periodic ( char* args );
+void cliFunc_printBuffer( char* args );
 void cliFunc_rand     ( char* args );
 void cliFunc_reload   ( char* args );
 void cliFunc_reset    ( char* args );
 void cliFunc_restart  ( char* args );
 void cliFunc_tick     ( char* args );
+void cliFunc_trace    ( char* args );
 void cliFunc_ram      ( char* args );
 void cliFunc_mpu      ( char* args );
 void cliFunc_version  ( char* args );
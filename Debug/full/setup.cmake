@@ -15,6 +15,7 @@ AddModule ( Debug cli )
 AddModule ( Debug latency )
 AddModule ( Debug led )
 AddModule ( Debug print )
+AddModule ( Debug trace )
 
 
 ###
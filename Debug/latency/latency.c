@@ -131,6 +131,15 @@ void Latency_start_time( uint8_t resource )
 	latency_measurements[resource].start_time = Time_now();
 }
 
+// Resource start time, for events that started before they could be measured (e.g. in an interrupt)
+//
+// resource: index of resource
+// start:    time the event started
+void Latency_start_time_at( uint8_t resource, Time start )
+{
+	latency_measurements[resource].start_time = start;
+}
+
 // Measure latency, and store
 //
 // resource: index of resource
@@ -68,6 +68,7 @@ typedef struct LatencyMeasurement {
 
 void Latency_init();
 void Latency_start_time( uint8_t resource );
+void Latency_start_time_at( uint8_t resource, Time start );
 void Latency_end_time( uint8_t resource );
 
 const char* Latency_query_name( uint8_t resource );
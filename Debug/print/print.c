@@ -23,14 +23,231 @@
 
 // Compiler Includes
 #include <stdarg.h>
+#include <string.h>
 
 // Project Includes
+#include <kll_defs.h>
 #include "print.h"
 
 
 
+// ----- Defines -----
+
+// Buffered output is only used on ARM, AVR and host print directly
+#if PrintBufferSize_define > 0 && ( defined(_kinetis_) || defined(_sam_) )
+#define Print_Buffered 1
+#else
+#define Print_Buffered 0
+#endif
+
+// Largest write handed to the output module at once (one USB serial packet)
+#define Print_FlushChunk 64
+
+#if Print_Buffered == 1 && ( PrintBufferSize_define & ( PrintBufferSize_define - 1 ) ) != 0
+#error "printBufferSize must be a power of two"
+#endif
+
+
+
+// ----- Enums -----
+
+// Each context writes to its own ring, so only nested interrupts can contend for a ring
+typedef enum PrintContext {
+	PrintContext_Thread,    // Main loop (CLI, poll routines)
+	PrintContext_Interrupt, // Periodic and any other interrupt
+	PrintContext_Count,
+} PrintContext;
+
+
+
+// ----- Structs -----
+
+#if Print_Buffered == 1
+// Log ring, indices are free running and wrap with the buffer size
+typedef struct PrintRing {
+	volatile uint32_t head;    // Reserved by writers
+	volatile uint32_t tail;    // Written out by Print_flush
+	volatile uint32_t dropped; // Bytes dropped since the last flush
+	uint32_t dropped_total;
+	uint32_t high_water;
+	char buf[PrintBufferSize_define];
+} PrintRing;
+#endif
+
+
+
+// ----- Variables -----
+
+#if Print_Buffered == 1
+static PrintRing print_rings[PrintContext_Count];
+static uint8_t print_flushing; // Set while Print_flush is writing to the output module
+#endif
+
+
+
 // ----- Functions -----
 
+#if Print_Buffered == 1
+// Determine which ring the caller should use
+static inline PrintContext Print_context()
+{
+	uint32_t ipsr;
+	__asm volatile ("mrs %0, ipsr" : "=r" (ipsr) );
+
+	return ipsr ? PrintContext_Interrupt : PrintContext_Thread;
+}
+
+// Copy into a reserved region of the ring, may wrap around the end of the buffer
+static void Print_ringCopy( PrintRing *ring, uint32_t head, const char *str, uint32_t len )
+{
+	uint32_t pos = head & ( PrintBufferSize_define - 1 );
+	uint32_t first = PrintBufferSize_define - pos;
+	if ( first > len )
+	{
+		first = len;
+	}
+	memcpy( &ring->buf[ pos ], str, first );
+	memcpy( ring->buf, str + first, len - first );
+}
+
+// Copy a string into the ring for the current context
+// Interrupts reserve space with a compare-and-swap so a preempting interrupt gets its own region,
+// fragments that don't fit are dropped and accounted for.
+// The main loop is the only writer of the thread ring, when it fills up it is flushed in place so nothing is lost.
+// Print_flush only runs in the main loop, so it never sees a partially written region.
+static void Print_ringWrite( const char *str, uint32_t len )
+{
+	PrintContext ctx = Print_context();
+	PrintRing *ring = &print_rings[ ctx ];
+
+	// Main loop, flush synchronously when out of space
+	// Output printed while flushing (e.g. from the output module) is dropped instead of recursing
+	if ( ctx == PrintContext_Thread && !print_flushing )
+	{
+		while ( len > 0 )
+		{
+			uint32_t part = len > PrintBufferSize_define ? PrintBufferSize_define : len;
+			if ( ring->head - ring->tail + part > PrintBufferSize_define )
+			{
+				Print_flush();
+			}
+
+			Print_ringCopy( ring, ring->head, str, part );
+			__atomic_store_n( &ring->head, ring->head + part, __ATOMIC_RELEASE );
+
+			str += part;
+			len -= part;
+		}
+		return;
+	}
+
+	uint32_t head = __atomic_load_n( &ring->head, __ATOMIC_RELAXED );
+	do {
+		// Not enough room, drop the whole fragment and account for it
+		if ( head - ring->tail + len > PrintBufferSize_define )
+		{
+			__atomic_fetch_add( &ring->dropped, len, __ATOMIC_RELAXED );
+			return;
+		}
+	} while ( !__atomic_compare_exchange_n( &ring->head, &head, head + len, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) );
+
+	Print_ringCopy( ring, head, str, len );
+}
+#endif
+
+// Send a string to the output module, through the log ring if enabled
+void Print_putstr( const char* str )
+{
+#if Print_Buffered == 1
+	Print_ringWrite( str, strlen( str ) );
+#else
+	Output_putstr( (char*)str );
+#endif
+}
+
+// Write buffered output to the output module
+// Called from Output_poll, fragments are coalesced into packet sized writes
+void Print_flush()
+{
+#if Print_Buffered == 1
+	char chunk[Print_FlushChunk + 1];
+
+	print_flushing = 1;
+
+	for ( uint8_t ctx = 0; ctx < PrintContext_Count; ctx++ )
+	{
+		PrintRing *ring = &print_rings[ ctx ];
+		uint32_t head = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+		uint32_t tail = ring->tail;
+
+		if ( head - tail > ring->high_water )
+		{
+			ring->high_water = head - tail;
+		}
+
+		while ( tail != head )
+		{
+			uint32_t pos = tail & ( PrintBufferSize_define - 1 );
+			uint32_t len = head - tail;
+			if ( len > Print_FlushChunk )
+			{
+				len = Print_FlushChunk;
+			}
+			if ( len > PrintBufferSize_define - pos )
+			{
+				len = PrintBufferSize_define - pos;
+			}
+
+			memcpy( chunk, &ring->buf[ pos ], len );
+			chunk[ len ] = '\0';
+			Output_putstr( chunk );
+
+			tail += len;
+			ring->tail = tail;
+		}
+
+		// Mark the gap in the output
+		uint32_t dropped = __atomic_exchange_n( &ring->dropped, 0, __ATOMIC_RELAXED );
+		if ( dropped )
+		{
+			ring->dropped_total += dropped;
+			int32ToStr( dropped, chunk );
+			Output_putstr( NL "\033[1;33m[" );
+			Output_putstr( chunk );
+			Output_putstr( " bytes dropped]\033[0m" NL );
+		}
+	}
+
+	print_flushing = 0;
+#endif
+}
+
+// Show log ring usage
+void Print_stats()
+{
+#if Print_Buffered == 1
+	const char *names[] = { "Thread", "Interrupt" };
+
+	for ( uint8_t ctx = 0; ctx < PrintContext_Count; ctx++ )
+	{
+		PrintRing *ring = &print_rings[ ctx ];
+
+		print( NL );
+		_print( names[ ctx ] );
+		print(" Pending: ");
+		printInt32( ring->head - ring->tail );
+		print("/");
+		printInt32( PrintBufferSize_define );
+		print(" High: ");
+		printInt32( ring->high_water );
+		print(" Dropped: ");
+		printInt32( ring->dropped_total + ring->dropped );
+	}
+#else
+	print( NL "Print buffering disabled" );
+#endif
+}
+
 // Multiple string Output
 void printstrs( char* first, ... )
 {
@@ -45,7 +262,7 @@ void printstrs( char* first, ... )
 	while ( !( cur[0] == '\0' && cur[1] == '\0' && cur[2] == '\0' ) )
 	{
 		// Print out the given string
-		Output_putstr( cur );
+		Print_putstr( cur );
 
 		// Get the next argument ready
 		cur = va_arg( ap, char* );
@@ -65,16 +282,20 @@ void _print( const char* s )
 		Output_putchar( c );
 	}
 #elif defined(_kinetis_) || defined(_sam_) // ARM
-	Output_putstr( (char*)s );
+	Print_putstr( s );
 #elif defined(_host_) // Host
-	Output_putstr( (char*)s );
+	Print_putstr( s );
 #endif
 }
 
 // Print a char
 void printChar( char c )
 {
+#if Print_Buffered == 1
+	Print_ringWrite( &c, 1 );
+#else
 	Output_putchar( c );
+#endif
 }
 
 
@@ -47,8 +47,8 @@
  */
 
 // Function Aliases
-#define dPrint(c)         Output_putstr(c)
-#define dPrintStr(c)      Output_putstr(c)
+#define dPrint(c)         Print_putstr(c)
+#define dPrintStr(c)      Print_putstr(c)
 #define dPrintStrs(...)   printstrs(__VA_ARGS__, "\0\0\0")      // Convenience Variadic Macro
 #define dPrintStrNL(c)    dPrintStrs       (c, NL)              // Appends New Line Macro
 #define dPrintStrsNL(...) printstrs(__VA_ARGS__, NL, "\0\0\0")  // Appends New Line Macro
@@ -90,6 +90,7 @@
 #endif
 
 void _print( const char *s );
+void Print_putstr( const char* str );
 void printstrs( char* first, ... );
 void printChar( char c );
 
@@ -105,6 +106,12 @@ void printHex_op  ( uint16_t in, uint8_t op );
 void printHex32_op( uint32_t in, uint8_t op );
 
 
+// Buffered Output
+// On ARM, output is written to a log ring and sent in bulk by Output_poll
+void Print_flush();
+void Print_stats();
+
+
 // String Functions
 #define hexToStr(hex, out) hexToStr_op(hex, out, 1)
 
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+'''
+Kiibohd binary trace decoder
+
+Converts a captured trace stream (RTT channel 2, or HID-IO 0x22 payloads) into a timeline
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import argparse
+import json
+import struct
+import sys
+
+
+
+### Variables ###
+
+# Must match TraceRecord in trace.h
+RecordFormat = '<BBHI'
+RecordSize = struct.calcsize( RecordFormat )
+
+Events = {
+    0x00: 'Sync',
+    0x01: 'Dropped',
+    0x10: 'Key',
+    0x11: 'Vote',
+    0x12: 'Capability',
+    0x13: 'Frame',
+    0x14: 'I2C',
+}
+
+ScheduleStates = {
+    0x0: 'O',
+    0x1: 'P',
+    0x2: 'H',
+    0x3: 'R',
+}
+
+Votes = [
+    ( 0x10, 'Release' ),
+    ( 0x08, 'Pass' ),
+    ( 0x04, 'DoNothingRelease' ),
+    ( 0x02, 'DoNothing' ),
+    ( 0x01, 'Fail' ),
+]
+
+
+
+### Functions ###
+
+def describe( event, arg8, arg16 ):
+    '''
+    Human readable description of a record
+    '''
+    if event == 0x00:
+        return "{} ticks/us, ms {}".format( arg8, arg16 )
+    if event == 0x01:
+        return "{} records".format( arg16 )
+    if event == 0x10:
+        return "S{} {}".format( arg16, ScheduleStates.get( arg8 & 0xF, hex( arg8 ) ) )
+    if event == 0x11:
+        names = [ name for bit, name in Votes if arg8 & bit ]
+        return "TriggerMacroList[{}] {}".format( arg16, '|'.join( names ) or 'Invalid' )
+    if event == 0x12:
+        return "CapabilitiesList[{}] {}".format( arg16, ScheduleStates.get( arg8 & 0xF, hex( arg8 ) ) )
+    if event == 0x13:
+        return "Animation {} frame {}".format( arg8, arg16 )
+    if event == 0x14:
+        return "Bus {} addr 0x{:02X} {} bytes".format( arg8 & 0x1, arg8 & 0xFE, arg16 )
+    return "arg8 0x{:02X} arg16 0x{:04X}".format( arg8, arg16 )
+
+
+def sync_wraps( ticks, elapsed_ms, ticks_per_us, tolerance_ms=2, max_wraps=64 ):
+    '''
+    Number of whole 32 bit tick wraps missing from ticks, given the elapsed ms (mod 2^16) between two sync records
+    '''
+    best = ( None, 0 )
+    for wraps in range( max_wraps ):
+        ms = ( ticks + ( wraps << 32 ) ) / ticks_per_us / 1000
+        error = abs( ( ms - elapsed_ms + 0x8000 ) % 0x10000 - 0x8000 )
+        if error <= tolerance_ms:
+            return wraps
+        if best[0] is None or error < best[0]:
+            best = ( error, wraps )
+    return best[1]
+
+
+def decode( data, mhz ):
+    '''
+    Decode a trace stream into a list of records
+
+    Timestamps are unwrapped and converted to microseconds, relative to the first record
+    '''
+    records = []
+    ticks_per_us = mhz
+    last_tick = None
+    total_ticks = 0
+    sync_ms = None
+    sync_ticks = 0
+
+    for offset in range( 0, len( data ) - len( data ) % RecordSize, RecordSize ):
+        event, arg8, arg16, tick = struct.unpack_from( RecordFormat, data, offset )
+
+        # Sync records carry the tick rate
+        if event == 0x00 and arg8 != 0:
+            ticks_per_us = arg8
+
+        # Tick counter is 32 bits, records between syncs are never more than one wrap apart
+        if last_tick is not None:
+            total_ticks += ( tick - last_tick ) & 0xFFFFFFFF
+        last_tick = tick
+
+        # Sync records are only sent along with an event, so an idle gap may span several tick wraps
+        # Use the ms counter (16 bits) to work out how many whole wraps passed since the previous sync
+        if event == 0x00:
+            if sync_ms is not None:
+                total_ticks += sync_wraps( total_ticks - sync_ticks, ( arg16 - sync_ms ) & 0xFFFF, ticks_per_us ) << 32
+            sync_ms = arg16
+            sync_ticks = total_ticks
+
+        records.append( {
+            'time_us': total_ticks / ticks_per_us,
+            'event': Events.get( event, hex( event ) ),
+            'arg8': arg8,
+            'arg16': arg16,
+            'desc': describe( event, arg8, arg16 ),
+        } )
+
+    return records
+
+
+
+### Main Entry Point ###
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser( description='Decode a Kiibohd binary trace into a timeline' )
+    parser.add_argument( 'input', nargs='?', help='Captured trace file (default: stdin)' )
+    parser.add_argument( '--mhz', type=int, default=72, help='Tick rate used before the first sync record (default: 72)' )
+    parser.add_argument( '--json', action='store_true', help='Output JSON instead of a text timeline' )
+    parser.add_argument( '--no-sync', action='store_true', help='Hide Sync records' )
+    args = parser.parse_args()
+
+    if args.input:
+        with open( args.input, 'rb' ) as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    records = decode( data, args.mhz )
+    if args.no_sync:
+        records = [ record for record in records if record['event'] != 'Sync' ]
+
+    if args.json:
+        print( json.dumps( records, indent=4 ) )
+        sys.exit( 0 )
+
+    # Text timeline, with the time since the previous record
+    prev = None
+    for record in records:
+        delta = record['time_us'] - prev if prev is not None else 0
+        prev = record['time_us']
+        print( "{:>14.3f} us (+{:>10.3f}) {:<10} {}".format( record['time_us'], delta, record['event'], record['desc'] ) )
@@ -0,0 +1,202 @@
+/* Copyright (C) 2018 by Jacob Alexander
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// ----- Includes -----
+
+// Compiler Includes
+#include <stdint.h>
+
+// Project Includes
+#include <Lib/MainLib.h>
+#include <Lib/time.h>
+#include <print.h>
+
+// KLL Include
+#include <kll.h>
+
+// Local Includes
+#include "trace.h"
+
+
+
+// ----- Defines -----
+
+// Sync records are inserted at least this often, so the host can unwrap the tick counter
+#define Trace_SyncPeriod_ms 1000
+
+#if ( TraceBufferSize_define & ( TraceBufferSize_define - 1 ) ) != 0 || TraceBufferSize_define < 16
+#error "traceBufferSize must be a power of two, and at least 16 bytes"
+#endif
+
+
+
+// ----- Variables -----
+
+volatile uint8_t Trace_mask = TraceMask_define;
+
+// Record ring, indices are free running byte offsets
+// Records never straddle the end of the buffer (the size is a multiple of the record size)
+static uint8_t trace_buf[TraceBufferSize_define];
+static volatile uint32_t trace_head; // Reserved by writers
+static volatile uint32_t trace_tail; // Consumed by the transport
+
+static volatile uint32_t trace_dropped;       // Records dropped since the last Dropped record
+static uint32_t trace_dropped_total;
+static uint32_t trace_records;
+static volatile uint32_t trace_sync_ms;
+static volatile uint8_t trace_synced;
+
+
+
+// ----- Functions -----
+
+// Timestamp for a record
+// ARM uses the cycle counter, host uses microseconds
+static inline uint32_t Trace_time( Time now )
+{
+#if defined(_host_)
+	return now.ms * 1000 + now.ticks / 1000;
+#else
+	return now.ticks;
+#endif
+}
+
+// Ticks per microsecond, sent in each sync record
+static inline uint8_t Trace_ticksPerUs()
+{
+#if defined(_host_)
+	return 1;
+#else
+	return F_CPU / 1000000;
+#endif
+}
+
+#if !defined(_avr_at_)
+// Reserve space for count records
+// Writers may be preempted by other writers (interrupts), the reservation is a compare-and-swap
+// Returns the byte offset of the first record, or -1 if there is not enough room
+static int32_t Trace_reserve( uint8_t count )
+{
+	uint32_t len = count * sizeof(TraceRecord);
+	uint32_t head = __atomic_load_n( &trace_head, __ATOMIC_RELAXED );
+
+	do {
+		if ( head - trace_tail + len > TraceBufferSize_define )
+		{
+			return -1;
+		}
+	} while ( !__atomic_compare_exchange_n( &trace_head, &head, head + len, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) );
+
+	return head;
+}
+
+static void Trace_write( uint32_t offset, TraceEvent event, uint8_t arg8, uint16_t arg16, uint32_t time )
+{
+	TraceRecord *record = (TraceRecord*)&trace_buf[ offset & ( TraceBufferSize_define - 1 ) ];
+	record->event = event;
+	record->arg8 = arg8;
+	record->arg16 = arg16;
+	record->time = time;
+}
+#endif
+
+// Add a record to the trace ring
+// Use Trace_event, which skips disabled event classes
+void Trace_record( TraceEvent event, uint8_t arg8, uint16_t arg16 )
+{
+#if defined(_avr_at_)
+	// No transport available
+	return;
+#else
+	Time now = Time_now();
+	uint32_t time = Trace_time( now );
+
+	// Prepend a sync record if one is due, and a dropped record if anything was lost
+	uint8_t sync = !trace_synced || now.ms - trace_sync_ms >= Trace_SyncPeriod_ms;
+	uint32_t dropped = trace_dropped;
+	uint8_t count = 1 + sync + ( dropped ? 1 : 0 );
+
+	int32_t offset = Trace_reserve( count );
+	if ( offset < 0 )
+	{
+		__atomic_fetch_add( &trace_dropped, 1, __ATOMIC_RELAXED );
+		return;
+	}
+
+	if ( sync )
+	{
+		trace_sync_ms = now.ms;
+		trace_synced = 1;
+		Trace_write( offset, TraceEvent_Sync, Trace_ticksPerUs(), now.ms & 0xFFFF, time );
+		offset += sizeof(TraceRecord);
+	}
+
+	if ( dropped )
+	{
+		__atomic_fetch_sub( &trace_dropped, dropped, __ATOMIC_RELAXED );
+		trace_dropped_total += dropped;
+		Trace_write( offset, TraceEvent_Dropped, 0, dropped > 0xFFFF ? 0xFFFF : dropped, time );
+		offset += sizeof(TraceRecord);
+	}
+
+	Trace_write( offset, event, arg8, arg16, time );
+	trace_records++;
+#endif
+}
+
+// Copy whole records, up to len bytes, without consuming them
+// Only call from the main loop (the same context as Trace_consume)
+// Returns the number of bytes copied
+uint16_t Trace_peek( uint8_t *buf, uint16_t len )
+{
+	uint32_t head = trace_head;
+	uint32_t tail = trace_tail;
+
+	len -= len % sizeof(TraceRecord);
+	if ( head - tail < len )
+	{
+		len = head - tail;
+	}
+
+	for ( uint16_t pos = 0; pos < len; pos++ )
+	{
+		buf[ pos ] = trace_buf[ ( tail + pos ) & ( TraceBufferSize_define - 1 ) ];
+	}
+
+	return len;
+}
+
+// Release records that have been sent
+void Trace_consume( uint16_t len )
+{
+	trace_tail += len;
+}
+
+// Show trace status
+void Trace_stats()
+{
+	print( NL );
+	info_msg("Trace Mask: ");
+	printHex( Trace_mask );
+	print(" Pending: ");
+	printInt32( trace_head - trace_tail );
+	print("/");
+	printInt32( TraceBufferSize_define );
+	print(" Recorded: ");
+	printInt32( trace_records );
+	print(" Dropped: ");
+	printInt32( trace_dropped_total + trace_dropped );
+}
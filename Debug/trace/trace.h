@@ -0,0 +1,86 @@
+/* Copyright (C) 2018 by Jacob Alexander
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// ----- Includes -----
+
+// Compiler Includes
+#include <stdint.h>
+
+
+
+// ----- Enumerations -----
+
+// Trace record types
+// Every record is 8 bytes, see TraceRecord
+typedef enum TraceEvent {
+	TraceEvent_Sync       = 0x00, // arg8: ticks per us, arg16: ms (lower 16 bits)
+	TraceEvent_Dropped    = 0x01, // arg16: records dropped since the last record
+
+	TraceEvent_Key        = 0x10, // arg8: ScheduleState,    arg16: scan code
+	TraceEvent_Vote       = 0x11, // arg8: TriggerMacroVote, arg16: TriggerMacro index
+	TraceEvent_Capability = 0x12, // arg8: ScheduleState,    arg16: capability index
+	TraceEvent_Frame      = 0x13, // arg8: animation index,  arg16: frame position
+	TraceEvent_I2C        = 0x14, // arg8: address | bus,    arg16: sequence length
+} TraceEvent;
+
+// Event class mask, one bit per event starting at TraceEvent_Key
+typedef enum TraceClass {
+	TraceClass_Key        = 0x01,
+	TraceClass_Vote       = 0x02,
+	TraceClass_Capability = 0x04,
+	TraceClass_Frame      = 0x08,
+	TraceClass_I2C        = 0x10,
+} TraceClass;
+
+
+
+// ----- Structs -----
+
+typedef struct TraceRecord {
+	uint8_t  event; // TraceEvent
+	uint8_t  arg8;
+	uint16_t arg16;
+	uint32_t time;  // CPU ticks (see TraceEvent_Sync for the rate)
+} __attribute__((packed)) TraceRecord;
+
+
+
+// ----- Variables -----
+
+extern volatile uint8_t Trace_mask;
+
+
+
+// ----- Functions -----
+
+void Trace_record( TraceEvent event, uint8_t arg8, uint16_t arg16 );
+
+uint16_t Trace_peek( uint8_t *buf, uint16_t len );
+void Trace_consume( uint16_t len );
+
+void Trace_stats();
+
+// Record an event if its class is enabled
+// Cheap enough to leave in place when tracing is disabled
+static inline void Trace_event( TraceEvent event, uint8_t arg8, uint16_t arg16 )
+{
+	if ( Trace_mask & ( 1 << ( event - TraceEvent_Key ) ) )
+	{
+		Trace_record( event, arg8, arg16 );
+	}
+}
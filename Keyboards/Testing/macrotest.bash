@@ -93,9 +93,17 @@ fi
 
 cmd python3 Tests/test.py
 cmd python3 Tests/animation.py
+cmd python3 Tests/interpolation.py
 cmd python3 Tests/hidio.py
+cmd python3 Tests/hidiobatch.py
+cmd python3 Tests/hidiobench.py
+cmd python3 Tests/hidiowindow.py
 cmd python3 Tests/cli.py
 cmd python3 Tests/layers.py
+cmd python3 Tests/lcd.py
+cmd python3 Tests/pixelstream.py
+cmd python3 Tests/usbevents.py
+cmd python3 Tests/trace.py
 
 # Tally results
 result
@@ -270,6 +270,9 @@ class Data:
     def __init__( self ):
         self.usb_keyboard_data = None
 
+        # Every keyboard report sent, in order (see usb_keyboard())
+        self.usb_keyboard_history = []
+
         # List of capability callbacks
         self.capability_history = CapabilityHistory()
 
@@ -40,21 +40,13 @@
 #define GPBR_SECURE1 GPBR->SYS_GPBR[6]
 #define GPBR_SECURE2 GPBR->SYS_GPBR[7]
 
-// 63-byte non-volatile storage
-// Can be 63, 127, 255 and 511 bytes
+// Non-volatile storage
+// Settings are kept as an append-only log of small records, see Lib/storage.c
 // XXX (HaaTa): Dual bank flash controllers (e.g. sam4sd32c) will have problems if using more than 1/2 the flash
 //              Will have to calculate the starting storage position differently...
-// Bootloader should always be defined as the minimum size so it is able to fully clear the block from any block
-// when attempting to clear the flash for new firmware.
-// The bootloader will only reset a page if
-//  a) Storage is completely empty (page 0, block 0)
-//  b) The previous page has cleared blocks already
-#if defined(_bootloader_)
-#define STORAGE_SIZE 63
-#else
-#define STORAGE_SIZE 63
-#endif
-
+// Pages are erased STORAGE_ERASE_PAGES at a time, each group of erased pages (sector) holds one copy of the log
+// The bootloader invalidates the stored settings after flashing new firmware by appending a clear record
+#define STORAGE_ERASE_PAGES 8
 #define STORAGE_PAGES 16
 #define STORAGE_FLASH_PAGE_SIZE IFLASH0_PAGE_SIZE
 #define STORAGE_RESERVED_FLASH (STORAGE_PAGES * STORAGE_FLASH_PAGE_SIZE)
@@ -57,431 +57,471 @@
 
 // ----- Defines -----
 
-#if (STORAGE_SIZE == 511)
-#elif (STORAGE_SIZE == 255)
-#elif (STORAGE_SIZE == 127)
-#elif (STORAGE_SIZE == 63)
-#else
-#error Invalid STORAGE_SIZE
-#endif
-
 #if (STORAGE_FLASH_PAGE_SIZE != 512)
 #error Page sizes other than 512 bytes are untested and will likely not work!
 #endif
 
-#if (STORAGE_PAGES != 16)
-#error Page counts other than 16 are untested and will likely not work!
+#if (STORAGE_ERASE_PAGES != 8)
+#error Only 8 page erases (IFLASH_ERASE_PAGES_8) are supported
 #endif
 
+#if (STORAGE_PAGES % STORAGE_ERASE_PAGES != 0) || (STORAGE_SECTORS < 2)
+#error STORAGE_PAGES must be a multiple of STORAGE_ERASE_PAGES, with at least 2 sectors
+#endif
 
+// Sector header magic ("KLLS")
+#define STORAGE_MAGIC 0x534C4C4B
 
-// ----- Variables -----
+// Reserved module ids
+#define STORAGE_MODULE_CLEAR 0xFE // Everything before this record is ignored
+#define STORAGE_MODULE_EMPTY 0xFF // Erased flash, end of the log
 
-static int8_t current_storage_index = 0;
-static uint8_t storage_buffer[STORAGE_SIZE];
-static uint8_t current_page = 0;
-static uint8_t erase_flag = 0;
-static uint8_t cleared_block = 0; // Set to 1 if current block has been cleared (i.e. empty)
 
-// Status Byte Scheme
-//
-// | X | X | X | X | X | X | B | V |
-// if V = 1, page/sub_page is next in line to be written, otherwise 0
-// if V = 0 and B = 1, the page has been cleared and does not need to be cleared (when blanking out the page)
 
-// ----- Functions -----
+// ----- Structs -----
 
-// Determine if the given block has been cleared
-// This is used by the bootloader to clear out old and possibly incompatible non-volatile data
-// However if the next block wasn't used, the bootloader needs a way to not wear out the flash
-// This is also useful for firmware in order to determine whether or not to discard the non-volatile state data
+// Log Scheme
 //
-// data points to the "reading" page rather than the full flash block
+// Each sector starts with a header, followed by records appended in order
+// | Header (8 bytes) | Record | Record | ... | 0xFF (erased) |
 //
-// Returns 1 if cleared page was found
-// Returns 0 if a normal page was found
-static uint8_t find_cleared_block( uint8_t *data )
+// Records hold a (module, key) -> value entry, the last record for a key wins
+// | Module | Key | Len | CRC-8 | Value (Len bytes) |
+//
+// Only the sector with a valid header and the newest sequence number is used.
+// Compaction erases the next sector, copies the newest record of each key and writes the header last.
+// If power is lost before the header is written, the previous sector is still used.
+typedef struct StorageHeader {
+	uint32_t magic;
+	uint16_t sequence;
+	uint16_t sequence_inv; // ~sequence
+} StorageHeader;
+
+typedef struct StorageRecord {
+	uint8_t module;
+	uint8_t key;
+	uint8_t len;
+	uint8_t crc;
+	uint8_t data[0];
+} StorageRecord;
+
+
+
+// ----- Variables -----
+
+static uint8_t current_sector = 0;
+static uint16_t current_sequence = 0;
+static uint8_t sector_valid = 0;  // Set to 1 if current sector has a valid header
+static uint16_t log_start = 0;    // First record after the last clear record
+static uint16_t log_end = 0;      // Next free byte in the sector, all records before this point are valid
+static uint16_t compact_end = 0;  // log_end after the last compaction (or boot)
+static uint8_t dirty = 0;         // Set to 1 if an unreadable record was found, compact before the next write
+static uint8_t compact_failed = 0; // Set to 1 if the last compaction failed, only retried when a write needs it
+static uint8_t cleared_block = 0; // Set to 1 if there are no settings stored (i.e. empty)
+
+
+
+// ----- Functions -----
+
+// CRC-8 (polynomial 0x07)
+static uint8_t storage_crc8( uint8_t crc, const uint8_t *data, uint8_t len )
 {
-	// Determine if block is cleared
-	if ( !(data[0] & 0x01) && data[0] & 0x02 )
+	while ( len-- )
 	{
-		return 1;
+		crc ^= *data++;
+		for ( uint8_t bit = 0; bit < 8; bit++ )
+		{
+			crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+		}
 	}
-	return 0;
+	return crc;
 }
 
-// Determine which block in page we are at
-static int8_t get_storage_block( uint8_t *data )
+// CRC of module, key, len and value
+static uint8_t storage_record_crc( const StorageRecord *record )
 {
-#if (STORAGE_SIZE == 511)
-	if ( data[0] & 0x01 )
-	{
-		return 0;
-	}
-#elif (STORAGE_SIZE == 255)
-	if ( data[0] & 0x01 )
-	{
-		return 0;
-	}
-	else if ( data[256] & 0x01 )
-	{
-		return 1;
-	}
-#elif (STORAGE_SIZE == 127)
-	if ( data[0] & 0x01 )
-	{
-		return 0;
-	}
-	else if ( data[128] & 0x01 )
-	{
-		return 1;
-	}
-	else if ( data[256] & 0x01 )
-	{
-		return 2;
-	}
-	else if ( data[384] & 0x01 )
-	{
-		return 3;
-	}
-#elif (STORAGE_SIZE == 63)
-	if ( data[0] & 0x01 )
-	{
-		return 0;
-	}
-	else if ( data[64] & 0x01 )
-	{
-		return 1;
-	}
-	else if ( data[128] & 0x01 )
-	{
-		return 2;
-	}
-	else if ( data[192] & 0x01 )
-	{
-		return 3;
-	}
-	else if ( data[256] & 0x01 )
-	{
-		return 4;
-	}
-	else if ( data[320] & 0x01 )
-	{
-		return 5;
-	}
-	else if ( data[384] & 0x01 )
-	{
-		return 6;
-	}
-	else if ( data[448] & 0x01 )
-	{
-		return 7;
-	}
-#endif
-	return -1;
+	uint8_t crc = storage_crc8( 0xFF, (const uint8_t*)record, 3 );
+	return storage_crc8( crc, record->data, record->len );
 }
 
-void storage_init()
+static uint32_t storage_sector_address( uint8_t sector )
 {
-	uint8_t page_walker;
+	return STORAGE_FLASH_START + sector * STORAGE_SECTOR_SIZE;
+}
 
-	// Flash incoming read buffer
-	uint8_t page_buffer[STORAGE_FLASH_PAGE_SIZE];
+static const StorageRecord *storage_record( uint8_t sector, uint16_t offset )
+{
+	return (const StorageRecord*)(storage_sector_address( sector ) + offset);
+}
 
-	// Initialize in-memory buffer
-	for ( int i = 0; i < STORAGE_SIZE; i++ )
-	{
-		storage_buffer[i] = 0xff;
-	}
+// Determine if the given sector has been initialized (i.e. compacted into)
+// Flash written in the old block format, or a partially compacted sector, will not have a valid header
+static uint8_t storage_sector_is_valid( uint8_t sector )
+{
+	const StorageHeader *header = (const StorageHeader*)storage_sector_address( sector );
+	return header->magic == STORAGE_MAGIC && header->sequence == (uint16_t)~header->sequence_inv;
+}
+
+// Walk the current sector, validating each record
+// Stops at erased flash, or the first unreadable record (e.g. power was lost while writing it)
+static void storage_scan()
+{
+	log_start = sizeof(StorageHeader);
+	log_end = sizeof(StorageHeader);
+	dirty = 0;
+	cleared_block = 1;
 
-	// Find the page and block index for the valid writable page.
-	for ( page_walker = 0; page_walker < STORAGE_PAGES; page_walker++ )
+	// Nothing usable, the first write will compact into a fresh sector
+	if ( !sector_valid )
 	{
-		// Read flash into page_buffer
-		memcpy(
-			page_buffer,
-			(const void *)(STORAGE_FLASH_START + page_walker * STORAGE_FLASH_PAGE_SIZE),
-			sizeof(page_buffer)
-		);
-
-		// Check to see if block is available
-		current_storage_index = get_storage_block(page_buffer);
-		current_page = page_walker;
-
-		// If available, stop walking
-		if ( current_storage_index >= 0 )
-		{
-			break;
-		}
+		log_end = STORAGE_SECTOR_SIZE;
+		return;
 	}
 
-	// If no page found, then the last page was the valid one. select the last block and put the data into buffer
-	if ( page_walker == STORAGE_PAGES )
+	while ( log_end + sizeof(StorageRecord) <= STORAGE_SECTOR_SIZE )
 	{
-		// Check for cleared page
-		cleared_block = find_cleared_block( page_buffer + STORAGE_FLASH_PAGE_SIZE - (STORAGE_SIZE + 1) );
+		const StorageRecord *record = storage_record( current_sector, log_end );
 
-		for ( int i = 0; i < STORAGE_SIZE; i++ )
+		// Erased flash, end of the log
+		if (
+			record->module == STORAGE_MODULE_EMPTY
+			&& record->key == 0xFF
+			&& record->len == 0xFF
+			&& record->crc == 0xFF
+		)
 		{
-#if (STORAGE_SIZE == 511)
-			storage_buffer[i] = page_buffer[i + 1];
-#elif (STORAGE_SIZE == 255)
-			storage_buffer[i] = page_buffer[i + 257];
-#elif (STORAGE_SIZE == 127)
-			storage_buffer[i] = page_buffer[i + 385];
-#elif (STORAGE_SIZE == 63)
-			storage_buffer[i] = page_buffer[i + 449];
-#endif
+			return;
 		}
-		current_storage_index = 0;
-		current_page = 0;
 
-		// Since all pages are dirty, erase before the next write to page 0
-		erase_flag = 1;
-	}
-	// If a page was found, move one block back and copy the data
-	else
-	{
-		// First block of a page, this means the data to be read is in the last block of the previous page
-		if ( current_storage_index == 0 )
+		uint16_t next = log_end + sizeof(StorageRecord) + record->len;
+		if (
+			record->module == STORAGE_MODULE_EMPTY
+			|| next > STORAGE_SECTOR_SIZE
+			|| record->crc != storage_record_crc( record )
+		)
 		{
-			memcpy(
-				page_buffer,
-				(const void *)(STORAGE_FLASH_START + ((current_page - 1) * STORAGE_FLASH_PAGE_SIZE)),
-				sizeof(page_buffer)
-			);
-
-			// Check for cleared page
-			cleared_block = find_cleared_block( page_buffer + STORAGE_FLASH_PAGE_SIZE-(STORAGE_SIZE + 1) );
+			break;
+		}
 
-			for ( int i  = 0; i < STORAGE_SIZE; i++ )
-			{
-#if(STORAGE_SIZE == 511)
-				storage_buffer[i] = page_buffer[i + 1];
-#elif(STORAGE_SIZE == 255)
-				storage_buffer[i] = page_buffer[i + 257];
-#elif(STORAGE_SIZE == 127)
-				storage_buffer[i] = page_buffer[i + 385];
-#elif (STORAGE_SIZE == 63)
-				storage_buffer[i] = page_buffer[i + 449];
-#endif
-			}
+		// Clear record, ignore everything before it
+		if ( record->module == STORAGE_MODULE_CLEAR )
+		{
+			log_start = next;
+			cleared_block = 1;
 		}
-		// If the block is within a page, go to previous block and fetch the data
 		else
 		{
-			uint16_t pos = (current_storage_index - 1) * (STORAGE_SIZE + 1);
-
-			// Check for cleared page
-			cleared_block = find_cleared_block( &page_buffer[pos] );
-
-			for ( int i = 0; i < STORAGE_SIZE; i++ )
-			{
-				storage_buffer[i] = page_buffer[pos + 1 + i];
-			}
+			cleared_block = 0;
 		}
 
+		log_end = next;
 	}
+
+	// Unreadable record (or the sector is full), don't write after it
+	dirty = 1;
 }
 
-// Erase flash if full
-// Only erases flash if erase flag has been set
-// storage_init() must be called first
-//
-// Returns:
-//  0 - Erase was not done (invalid status for erasure)
-//  1 - Erase completed
-static uint8_t storage_erase_flash()
+void storage_init()
 {
-	// If we have wrapped around the reserved 16 pages, delete everything
-	if ( current_page == 0 && erase_flag && current_storage_index == 0 )
+	// Use the valid sector with the newest sequence number
+	sector_valid = 0;
+	current_sector = 0;
+	current_sequence = 0;
+	for ( uint8_t sector = 0; sector < STORAGE_SECTORS; sector++ )
 	{
-		// Erase the first 8 pages
-		uint32_t status = flash_erase_page( STORAGE_FLASH_START, IFLASH_ERASE_PAGES_8 );
-		if ( status )
+		if ( !storage_sector_is_valid( sector ) )
 		{
-			print("Failed erasing pages 0..7: ");
-#if defined(_bootloader_)
-			printHex( status );
-#else
-			printHex32( status );
-#endif
-			print( NL );
+			continue;
 		}
 
-		// Erase the last 8 pages
-		status = flash_erase_page( STORAGE_FLASH_START + (STORAGE_FLASH_PAGE_SIZE * 8), IFLASH_ERASE_PAGES_8 );
-		if ( status )
+		uint16_t sequence = ((const StorageHeader*)storage_sector_address( sector ))->sequence;
+		if ( !sector_valid || (int16_t)(sequence - current_sequence) > 0 )
 		{
-			print("Failed erasing pages 8..15: ");
-#if defined(_bootloader_)
-			printHex( status );
-#else
-			printHex32( status );
-#endif
-			print( NL );
+			current_sector = sector;
+			current_sequence = sequence;
+			sector_valid = 1;
 		}
-
-		return 1;
 	}
 
+	// Find the end of the log
+	storage_scan();
+	compact_end = log_end;
+}
+
+// Returns 1 if there is a newer record for the same key after the given record
+// Only called for records before log_end, which have already been validated
+static uint8_t storage_superseded( const StorageRecord *record, uint16_t offset )
+{
+	while ( offset < log_end )
+	{
+		const StorageRecord *next = storage_record( current_sector, offset );
+		if ( next->module == record->module && next->key == record->key )
+		{
+			return 1;
+		}
+		offset += sizeof(StorageRecord) + next->len;
+	}
 	return 0;
 }
 
-// Write storage block
-// data    - Buffer to write from
-// address - Starting address to write to
-// size    - Number of bytes to write into storage
-// clear   - Set 0 for normal write, Set 1 to indicate nothing of value in the block (empty block)
+// Compact the log into the next sector
+// Only the newest record of each key is kept, clear records and everything before them are dropped
+// Sectors are used in rotation so each one is erased equally often
 // storage_init() must be called first
 //
-// Returns
-//  0 - Not enough space
-//  1 - Success
-//  2 - Failed to write successfully, but incremented counters (i.e. try again)
-uint8_t storage_write(uint8_t* data, uint16_t address, uint16_t size, uint8_t clear )
+// Returns:
+//  0 - Failed to erase or write the next sector, the current sector is still used
+//  1 - Compaction completed
+uint8_t storage_compact()
 {
-	// Flashing buffer
-	uint8_t page_buffer[STORAGE_FLASH_PAGE_SIZE];
+	uint8_t sector = (current_sector + 1) % STORAGE_SECTORS;
+	uint32_t address = storage_sector_address( sector );
 
-	// Make sure there is enough address space in the storage
-	if ( size + address > STORAGE_SIZE )
+	// Erase the next sector
+	uint32_t status = flash_erase_page( address, IFLASH_ERASE_PAGES_8 );
+	if ( status )
 	{
+		print("Failed erasing storage sector: ");
+#if defined(_bootloader_)
+		printHex( status );
+#else
+		printHex32( status );
+#endif
+		print( NL );
+		compact_failed = 1;
 		return 0;
 	}
 
-	// Set internal buffer to all 0xffs
-	// This way it's possible to do partial writes to the page
-	for ( int i = 0; i < STORAGE_FLASH_PAGE_SIZE; i++ )
+	// Copy the newest record of each key
+	uint16_t offset = sizeof(StorageHeader);
+	if ( sector_valid )
 	{
-		page_buffer[i] = 0xff;
-	}
+		uint16_t pos = log_start;
+		while ( pos < log_end )
+		{
+			const StorageRecord *record = storage_record( current_sector, pos );
+			uint16_t size = sizeof(StorageRecord) + record->len;
+			pos += size;
+
+			if ( record->module == STORAGE_MODULE_CLEAR || storage_superseded( record, pos ) )
+			{
+				continue;
+			}
 
-	// Erase flash, only erases if erase_flag has been set
-	storage_erase_flash();
+			status = flash_write( address + offset, record, size, 0 );
+			if ( status || memcmp( (const void*)(address + offset), record, size ) != 0 )
+			{
+				status = status ? status : 1;
+				break;
+			}
+			offset += size;
+		}
+	}
 
-	// Check which type of block we are writing
-	uint8_t block_type = 0x00; // Normal block
-	if ( clear )
+	// Header is written last, the sector is only used once everything has been copied
+	StorageHeader header = {
+		.magic = STORAGE_MAGIC,
+		.sequence = current_sequence + 1,
+		.sequence_inv = ~(current_sequence + 1),
+	};
+	if ( !status )
 	{
-		// Cleared page, update status to indicate this page should be ignored
-		block_type = 0x02;
-		cleared_block = 1;
+		status = flash_write( address, &header, sizeof(header), 0 );
 	}
-	else
+	if ( status || !storage_sector_is_valid( sector ) )
 	{
-		// Valid block
-		cleared_block = 0;
+		print("Failed to write storage sector... ERROR: ");
+#if defined(_bootloader_)
+		printHex( status );
+#else
+		printHex32( status );
+#endif
+		print( NL );
+		compact_failed = 1;
+		return 0;
 	}
 
-	// Clear empty page flag
-	page_buffer[(current_storage_index * (STORAGE_SIZE + 1))] = block_type;
+	current_sector = sector;
+	current_sequence = header.sequence;
+	sector_valid = 1;
+	log_start = sizeof(StorageHeader);
+	log_end = offset;
+	compact_end = offset;
+	dirty = 0;
+	compact_failed = 0;
+	cleared_block = offset == sizeof(StorageHeader);
+	return 1;
+}
 
-	// Prepare flashing and in-memory buffers so we can write to flash
-	for ( int i = 0; i < size; i++ )
+// Returns 1 if compaction should be done while idle
+// i.e. less than threshold bytes are free and records have been written since the last compaction
+// Always returns 1 if the log has an unreadable record
+// Returns 0 after a failed compaction (each attempt erases a sector), the next write that needs room retries it
+uint8_t storage_needs_compaction( uint16_t threshold )
+{
+	if ( compact_failed )
 	{
-		// Write to flashing buffer
-		page_buffer[i + address + (current_storage_index * (STORAGE_SIZE + 1)) + 1] = data[i];
-
-		// Write to in-memory storage
-		storage_buffer[i + address] = data[i];
+		return 0;
 	}
+	return dirty || ( storage_free() < threshold && log_end > compact_end );
+}
 
-	// Write flashing buffer to flash
-	uint32_t status = flash_write(
-		(STORAGE_FLASH_START + current_page * STORAGE_FLASH_PAGE_SIZE),
-		(const void *)page_buffer,
-		sizeof(page_buffer), 0
-	);
-
-	// Handle page increment based on storage size
-#if (STORAGE_SIZE == 511)
-	current_page++;
-#elif (STORAGE_SIZE == 255)
-	current_storage_index++;
-	if ( current_storage_index > 1 )
-	{
-		current_page++;
-		current_storage_index = 0;
-	}
-#elif (STORAGE_SIZE == 127)
-	current_storage_index++;
-	if ( current_storage_index > 3 )
-	{
-		current_page++;
-		current_storage_index = 0;
-	}
-#elif (STORAGE_SIZE == 63)
-	current_storage_index++;
-	if ( current_storage_index > 7 )
-	{
-		current_page++;
-		current_storage_index = 0;
-	}
-#endif
+// Append a record to the log
+// Compacts first if there isn't enough room
+static uint8_t storage_append( uint8_t module, uint8_t key, const uint8_t* data, uint8_t size )
+{
+	uint8_t buffer[sizeof(StorageRecord) + STORAGE_VALUE_MAX];
+	StorageRecord *record = (StorageRecord*)buffer;
+	uint16_t record_size = sizeof(StorageRecord) + size;
 
-	// Handle page rotation
-	if ( current_page > 15 )
+	// Make room
+	if ( dirty || log_end + record_size > STORAGE_SECTOR_SIZE )
 	{
-		current_page = 0;
-		erase_flag = 1;
-		current_storage_index = 0;
+		if ( !storage_compact() || log_end + record_size > STORAGE_SECTOR_SIZE )
+		{
+			return 0;
+		}
 	}
 
-	// Check status
-	if ( status )
+	record->module = module;
+	record->key = key;
+	record->len = size;
+	memcpy( record->data, data, size );
+	record->crc = storage_record_crc( record );
+
+	// Only the record is programmed, the rest of the page is left as is
+	uint32_t address = storage_sector_address( current_sector ) + log_end;
+	uint32_t status = flash_write( address, buffer, record_size, 0 );
+	if ( status || memcmp( (const void*)address, buffer, record_size ) != 0 )
 	{
+		// Bytes may have been partially programmed, compact before writing again
+		dirty = 1;
 		print("Failed to write to flash... ERROR: ");
 #if defined(_bootloader_)
-		printHex(status);
+		printHex( status );
 #else
-		printHex32(status);
+		printHex32( status );
 #endif
+		print( NL );
 		return 2;
 	}
+
+	log_end += record_size;
+	if ( module == STORAGE_MODULE_CLEAR )
+	{
+		log_start = log_end;
+		cleared_block = 1;
+	}
+	else
+	{
+		cleared_block = 0;
+	}
 	return 1;
 }
 
-// Read storage block
-// data    - Buffer to read into
-// address - Starting address from storage
-// size    - Number of bytes to read starting from address
+// Write storage record
+// module - Module id (0x00 to 0xFD)
+// key    - Key within the module
+// data   - Buffer to write from
+// size   - Number of bytes to write (up to STORAGE_VALUE_MAX)
+// storage_init() must be called first
+//
+// Returns
+//  0 - Invalid module/size or not enough space
+//  1 - Success
+//  2 - Failed to write successfully (i.e. try again)
+uint8_t storage_write( uint8_t module, uint8_t key, const uint8_t* data, uint8_t size )
+{
+	if ( module >= STORAGE_MODULE_CLEAR || size > STORAGE_VALUE_MAX )
+	{
+		return 0;
+	}
+
+	return storage_append( module, key, data, size );
+}
+
+// Read storage record
+// module - Module id
+// key    - Key within the module
+// data   - Buffer to read into
+// size   - Largest number of bytes to read
 // storage_init() must be called first
 //
 // Returns:
-//  0 - If range is invalid and will not fit inside a block
-//  1 - Read was successful
-uint8_t storage_read( uint8_t* data, uint16_t address, uint16_t size )
+//  0 - Key has not been written
+//  n - Number of bytes read
+uint8_t storage_read( uint8_t module, uint8_t key, uint8_t* data, uint8_t size )
 {
-	// Make sure the data section fully exists
-	if ( size + address > STORAGE_SIZE )
+	const StorageRecord *found = 0;
+
+	// Newest record wins
+	uint16_t pos = log_start;
+	while ( pos < log_end )
+	{
+		const StorageRecord *record = storage_record( current_sector, pos );
+		if ( record->module == module && record->key == key )
+		{
+			found = record;
+		}
+		pos += sizeof(StorageRecord) + record->len;
+	}
+
+	if ( !found )
 	{
 		return 0;
 	}
 
-	// Read out from buffer
-	for ( int i = 0; i < size; i++ )
+	if ( size > found->len )
 	{
-		data[i] = storage_buffer[address + i];
+		size = found->len;
 	}
-	return 1;
+	memcpy( data, found->data, size );
+	return size;
+}
+
+// Call apply for every stored record, oldest first
+// Newer records for the same key overwrite older ones
+// storage_init() must be called first
+void storage_replay( void (*apply)( uint8_t module, uint8_t key, const uint8_t* data, uint8_t size ) )
+{
+	uint16_t pos = log_start;
+	while ( pos < log_end )
+	{
+		const StorageRecord *record = storage_record( current_sector, pos );
+		apply( record->module, record->key, record->data, record->len );
+		pos += sizeof(StorageRecord) + record->len;
+	}
+}
+
+// Read storage sector position
+// Must run storage_init() first!
+uint8_t storage_sector_position()
+{
+	return current_sector;
+}
+
+// Read storage sector sequence number (incremented on each compaction)
+// Must run storage_init() first!
+uint16_t storage_sequence()
+{
+	return current_sequence;
 }
 
-// Read storage page position
+// Read storage log position (offset from the sector)
 // Must run storage_init() first!
-uint8_t storage_page_position()
+uint16_t storage_log_position()
 {
-	return current_page;
+	return log_end;
 }
 
-// Read storage block position (offset from the page)
+// Bytes left in the current sector
 // Must run storage_init() first!
-int8_t storage_block_position()
+uint16_t storage_free()
 {
-	return current_storage_index;
+	return STORAGE_SECTOR_SIZE - log_end;
 }
 
-// Returns 1 if storage has been cleared and will not have conflicts when changing the block size
+// Returns 1 if storage has been cleared and will not have conflicts when changing the settings layout
 // Or if there is no useful data in the non-volatile storage
 // storage_init() must be called first
 uint8_t storage_is_storage_cleared()
@@ -489,48 +529,29 @@ uint8_t storage_is_storage_cleared()
 	return cleared_block;
 }
 
-// Clears the current page
+// Clears the stored settings by appending a clear record
 // Does not clear if:
-//  - Previous page was cleared already
+//  - Settings were cleared already
 //  - Flash is entirely empty (no reason to clear)
 // storage_init() must be called first
 //
 // Returns:
-//  0 - Page was not cleared
-//  1 - Page was cleared
+//  0 - Storage was not cleared
+//  1 - Storage was cleared
 uint8_t storage_clear_page()
 {
-	// Flash is empty
-	if ( current_page == 0 && current_storage_index == 0 )
+	if ( cleared_block )
 	{
-		// Flash is full, needs to be erased which is the same as clearing a page
-		if ( storage_erase_flash() )
-		{
-			return 1;
-		}
 		return 0;
 	}
 
-	// Previous page was completely cleared
-	if ( current_storage_index == 0 && cleared_block == 1 )
+	if ( storage_append( STORAGE_MODULE_CLEAR, 0, 0, 0 ) != 1 )
 	{
+		// This is bad...not possible to recover without manually clearing
+		print("Failed to clear storage.");
 		return 0;
 	}
 
-	// Clear the rest of the blocks in the page
-	// Write a 0'd out buffer as well
-	uint8_t temp_buffer[STORAGE_SIZE];
-	memset( temp_buffer, 0, STORAGE_SIZE );
-	while ( current_storage_index != 0 )
-	{
-		if ( storage_write( temp_buffer, 0, STORAGE_SIZE, 1 ) == 0 )
-		{
-			// This is bad...not possible to recover without manually clearing
-			print("Not enough room in buffer, failed to clear block.");
-			return 0;
-		}
-	}
-
 	return 1;
 }
 
@@ -51,6 +51,18 @@
 
 
 
+// ----- Defines -----
+
+// Sectors are the smallest erasable unit (STORAGE_ERASE_PAGES pages)
+// The settings log is appended to one sector at a time, compaction moves it to the next sector
+#define STORAGE_SECTORS     (STORAGE_PAGES / STORAGE_ERASE_PAGES)
+#define STORAGE_SECTOR_SIZE (STORAGE_ERASE_PAGES * STORAGE_FLASH_PAGE_SIZE)
+
+// Largest value that can be stored in a single record
+#define STORAGE_VALUE_MAX 32
+
+
+
 // ----- Variables -----
 
 /*typedef struct {
@@ -79,12 +91,17 @@ typedef struct {
 // ----- Functions -----
 
 void storage_init();
-uint8_t storage_write(uint8_t* data, uint16_t address, uint16_t size, uint8_t clear );
-uint8_t storage_read(uint8_t* data, uint16_t address, uint16_t size );
+uint8_t storage_write( uint8_t module, uint8_t key, const uint8_t* data, uint8_t size );
+uint8_t storage_read( uint8_t module, uint8_t key, uint8_t* data, uint8_t size );
+void storage_replay( void (*apply)( uint8_t module, uint8_t key, const uint8_t* data, uint8_t size ) );
+uint8_t storage_compact();
+uint8_t storage_needs_compaction( uint16_t threshold );
 uint8_t storage_clear_page();
 
-uint8_t storage_page_position();
-int8_t storage_block_position();
+uint8_t storage_sector_position();
+uint16_t storage_sequence();
+uint16_t storage_log_position();
+uint16_t storage_free();
 uint8_t storage_is_storage_cleared();
 
 void Storage_registerModule(StorageModule *config);
@@ -25,6 +25,7 @@
 #include <led.h>
 #include <print.h>
 #include <scan_loop.h>
+#include <trace.h>
 
 // Keymaps
 #include <usb_hid.h> // Generated using kll (and hid-io/layouts) at compile time, in build directory
@@ -557,6 +558,22 @@ uint8_t Macro_pressReleaseAdd( void *trigger_ptr )
 		return 2;
 	}
 
+	// Only trace switch state changes, Switch1-4 map back onto a linear ScanCode
+	if ( trigger->type <= TriggerType_Switch4
+		&& ( trigger->state == ScheduleType_P || trigger->state == ScheduleType_R ) )
+	{
+		// Same encoding as Macro_keyState, Switch1 is 0-255, Switch2 256-511, etc.
+		Trace_event( TraceEvent_Key, trigger->state, ( ( trigger->type - TriggerType_Switch1 ) << 8 ) + trigger->index );
+	}
+
+#if defined(Output_USBEnabled_define)
+	// Start waking the host on the first press
+	if ( trigger->type <= TriggerType_Switch4 && trigger->state == ScheduleType_P )
+	{
+		USB_wake();
+	}
+#endif
+
 	// Add trigger to the Interconnect Cache
 	// During each processing loop, a scancode may be re-added depending on it's state
 	for ( var_uint_t c = 0; c < macroInterconnectCacheSize; c++ )
@@ -645,6 +662,20 @@ void Macro_keyState( uint16_t scanCode, uint8_t state )
 		macroTriggerEventBuffer[ macroTriggerEventBufferSize ].state = state;
 		macroTriggerEventBuffer[ macroTriggerEventBufferSize ].type  = type;
 		macroTriggerEventBufferSize++;
+
+		// Only trace state changes
+		if ( state != ScheduleType_H )
+		{
+			Trace_event( TraceEvent_Key, state, scanCode );
+		}
+
+#if defined(Output_USBEnabled_define)
+		// Start waking the host on the first press
+		if ( state == ScheduleType_P )
+		{
+			USB_wake();
+		}
+#endif
 		break;
 	}
 }
@@ -23,6 +23,7 @@
 // Project Includes
 #include <led.h>
 #include <print.h>
+#include <trace.h>
 
 // Local Includes
 #include "result.h"
@@ -143,6 +144,7 @@ void Result_evalResultMacroCombo(
 #endif
 
 			// Call capability
+			Trace_event( TraceEvent_Capability, record->state, guide->index );
 			capability( resultElem->trigger, record->state, record->stateType, &guide->args );
 		}
 		// Otherwise, queue up the capability for later
@@ -453,6 +455,7 @@ void Result_process_delayed()
 #endif
 
 		// Call capability
+		Trace_event( TraceEvent_Capability, item->state, item->capabilityIndex );
 		capability( item->trigger, item->state, item->stateType, item->args );
 
 		// Decrease stack size
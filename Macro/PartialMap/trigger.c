@@ -22,6 +22,7 @@
 // Project Includes
 #include <led.h>
 #include <print.h>
+#include <trace.h>
 
 // Local Includes
 #include "trigger.h"
@@ -654,6 +655,7 @@ TriggerMacroEval Trigger_evalTriggerMacro( var_uint_t triggerMacroIndex )
 		}
 
 		// Vote Debug
+		Trace_event( TraceEvent_Vote, overallVote, triggerMacroIndex );
 		switch ( voteDebugMode )
 		{
 		case 1:
@@ -725,6 +727,7 @@ TriggerMacroEval Trigger_evalTriggerMacro( var_uint_t triggerMacroIndex )
 		TriggerMacroVote overallVote = Trigger_overallVote( macro, record, long_trigger_macro, pos );
 
 		// Vote Debug
+		Trace_event( TraceEvent_Vote, overallVote, triggerMacroIndex );
 		switch ( voteDebugMode )
 		{
 		case 1:
@@ -27,6 +27,11 @@
 #include <led.h>
 #include <print.h>
 #include <output_com.h>
+#include <trace.h>
+
+#if defined(Output_HIDIOEnabled_define)
+#include <hidio_com.h>
+#endif
 
 // Local Includes
 #include "pixel.h"
@@ -151,6 +156,7 @@ uint8_t  Pixel_Buffers_HostLen = Pixel_BuffersLen_KLL;
 uint8_t  Pixel_MaxChannelPerPixel_Host = Pixel_MaxChannelPerPixel;
 uint16_t Pixel_Mapping_HostLen = 128; // TODO Define
 uint8_t  Pixel_AnimationStackElement_HostSize = sizeof( AnimationStackElement );
+uint16_t Pixel_TotalChannels_Host = Pixel_TotalChannels_KLL;
 #endif
 
 // Pixel Fade Profile Mapping
@@ -166,8 +172,47 @@ static uint8_t Pixel_pixel_fade_profile[Pixel_TotalPixels_KLL];
 // TODO (HaaTa): Use KLL to determine number of profiles (currently only 4)
 static PixelFadeProfile Pixel_pixel_fade_profile_entries[4];
 
+// Pixel Fade Channel Runs
+// Channels are grouped by fade profile into contiguous runs
+// Pixel_pixel_fade_runs_start[profile] is the first run of the profile, [4] is the total number of runs
+// Rebuilt whenever Pixel_pixel_fade_profile changes (see Pixel_pixel_fade_runs_dirty)
+#define Pixel_FadeRunsMax Pixel_FadeRunsMax_define
+static PixelFadeRun Pixel_pixel_fade_runs[Pixel_FadeRunsMax];
+static uint16_t     Pixel_pixel_fade_runs_start[4 + 1];
+static uint8_t      Pixel_pixel_fade_runs_dirty;
+
+// Precomputed Fill Lists
+// Pixel indices (1-indexed) of each display column (top to bottom) and row (left to right)
+// Blank and invalid display positions are omitted
+// Pixel_fill_*_start[n] is the first entry of column/row n, the final entry is the end of the list
+static uint16_t Pixel_fill_column_pixels[Pixel_TotalPixels_KLL];
+static uint16_t Pixel_fill_column_start[Pixel_DisplayMapping_Cols_KLL + 1];
+static uint16_t Pixel_fill_row_pixels[Pixel_TotalPixels_KLL];
+static uint16_t Pixel_fill_row_start[Pixel_DisplayMapping_Rows_KLL + 1];
+
+// Animation Stack Scheduling
+// Budget is the time (us) the animation stack may use per frame, 0 disables scheduling
+static uint32_t Pixel_stack_budget;
+static uint32_t Pixel_stack_cost;     // Last animation stack processing time (us)
+static uint32_t Pixel_stack_overruns; // # of frames where the animation stack exceeded the budget
+
+#if defined(Output_HIDIOEnabled_define)
+// Frame Stream Ring Buffer
+// Segments streamed from the host (HIDIO_Id__PixelStream), see Pixel_streamCall for the format
+// Each entry is stored as [len:1][segment:len]
+#define Pixel_StreamBufferSize Pixel_StreamBufferSize_define
+static uint8_t  Pixel_stream_buf[Pixel_StreamBufferSize];
+static uint16_t Pixel_stream_head; // Oldest entry
+static uint16_t Pixel_stream_tail; // Next free byte
+static uint16_t Pixel_stream_used; // # of bytes in use
+uint16_t Pixel_stream_frames;      // # of complete frames queued
+uint32_t Pixel_stream_played;      // # of frames played back
+uint32_t Pixel_stream_rejected;    // # of segments NAK'd (buffer full or invalid)
+#endif
+
 // Latency Measurement Resource
 static uint8_t pixelLatencyResource;
+static uint8_t pixelStackLatencyResource;
 
 
 
@@ -176,6 +221,7 @@ static uint8_t pixelLatencyResource;
 uint8_t Pixel_animationProcess( AnimationStackElement *elem );
 uint8_t Pixel_addAnimation( AnimationStackElement *element, CapabilityState cstate );
 uint8_t Pixel_determineLastTriggerScanCode( TriggerMacro *trigger );
+uint8_t Pixel_isLayerTrigger( TriggerMacro *trigger );
 
 void Pixel_pixelSet( PixelElement *elem, uint32_t value );
 void Pixel_clearAnimations();
@@ -457,6 +503,9 @@ void Pixel_FadeLayerHighlight_capability( TriggerMacro *trigger, uint8_t state,
 		// Set pixel to group #4 (index 3)
 		Pixel_pixel_fade_profile[pixel - 1] = 3;
 	}
+
+	// Channel runs need to be regenerated
+	Pixel_pixel_fade_runs_dirty = 1;
 }
 
 
@@ -491,6 +540,97 @@ uint8_t Pixel_8bitInterpolation( uint8_t start, uint8_t end, uint8_t dist )
 	return (start * (256 - dist) + end * dist) >> 8;
 }
 
+// Packed 8-bit interpolation, all 4 byte lanes at once (SIMD within a register)
+// Even and odd bytes are spread into 16-bit lanes so the products cannot carry into the next lane
+// Each lane gives the same result as Pixel_8bitInterpolation
+uint32_t Pixel_8bitInterpolation4( uint32_t start, uint32_t end, uint8_t dist )
+{
+	uint32_t inv = 256 - dist;
+
+	// Bytes 0 and 2
+	uint32_t even = ( ( start & 0x00FF00FF ) * inv + ( end & 0x00FF00FF ) * dist ) >> 8;
+
+	// Bytes 1 and 3 (result is already shifted into place)
+	uint32_t odd = ( ( start >> 8 ) & 0x00FF00FF ) * inv + ( ( end >> 8 ) & 0x00FF00FF ) * dist;
+
+	return ( even & 0x00FF00FF ) | ( odd & 0xFF00FF00 );
+}
+
+// Pack the 8-bit channel values of PixelModElement data into byte lanes
+// Values follow the PixelChange of each channel (stride of 2)
+uint32_t Pixel_packModData( const uint8_t *data, uint8_t channels )
+{
+	uint32_t packed = 0;
+	for ( uint8_t ch = 0; ch < channels; ch++ )
+	{
+		packed |= (uint32_t)data[ ch * 2 + 1 ] << ( ch * 8 );
+	}
+	return packed;
+}
+
+// Unpack byte lanes into PixelModElement data, see Pixel_packModData
+void Pixel_unpackModData( uint8_t *data, uint32_t packed, uint8_t channels )
+{
+	for ( uint8_t ch = 0; ch < channels; ch++ )
+	{
+		data[ ch * 2 + 1 ] = packed >> ( ch * 8 );
+	}
+}
+
+#if Pixel_MaxChannelPerPixel > 4
+#error "Pixel_8bitInterpolation4 supports at most 4 channels per pixel"
+#endif
+
+#if defined(_host_)
+// Interpolation microbenchmark, used by the host-side tests
+// Interpolates a full keyboard gradient (every pixel) loops times, using the scalar or packed path
+// Returns a checksum of the interpolated values, which must match between both paths
+uint32_t Pixel_interpolationBenchmark( uint8_t packed, uint32_t loops )
+{
+	// Gradient endpoints, PixelModElement data format ( [change][value] per channel )
+	const uint8_t start[] = { PixelChange_Set, 0xFF, PixelChange_Set, 0x20, PixelChange_Set, 0x00 };
+	const uint8_t end[]   = { PixelChange_Set, 0x10, PixelChange_Set, 0xC0, PixelChange_Set, 0xFF };
+	const uint8_t channels = sizeof( start ) / 2;
+	uint8_t interp[ sizeof( start ) ];
+	memcpy( interp, start, sizeof( start ) );
+
+	uint32_t start_packed = Pixel_packModData( start, channels );
+	uint32_t end_packed = Pixel_packModData( end, channels );
+
+	uint32_t checksum = 0;
+	for ( uint32_t loop = 0; loop < loops; loop++ )
+	{
+		for ( uint16_t pixel = 0; pixel < Pixel_TotalPixels_KLL; pixel++ )
+		{
+			uint8_t distance = pixel * 256 / Pixel_TotalPixels_KLL;
+			if ( packed )
+			{
+				Pixel_unpackModData(
+					interp,
+					Pixel_8bitInterpolation4( start_packed, end_packed, distance ),
+					channels
+				);
+			}
+			else
+			{
+				for ( uint8_t ch = 0; ch < channels; ch++ )
+				{
+					uint8_t pos = ch * 2 + 1;
+					interp[pos] = Pixel_8bitInterpolation( start[pos], end[pos], distance );
+				}
+			}
+
+			for ( uint8_t ch = 0; ch < channels; ch++ )
+			{
+				checksum = checksum * 31 + interp[ ch * 2 + 1 ];
+			}
+		}
+	}
+
+	return checksum;
+}
+#endif
+
 void Pixel_pixelInterpolate( PixelElement *elem, uint8_t position, uint8_t intensity )
 {
 	// Toggle each of the channels of the pixel
@@ -632,6 +772,16 @@ uint8_t Pixel_addAnimation( AnimationStackElement *element, CapabilityState csta
 	// Copy animation settings
 	memcpy( &Pixel_AnimationElement_Stor[pos], element, sizeof(AnimationStackElement) );
 
+	// Reset scheduling state
+	// Layer indicators must stay responsive, so they are never decimated
+	AnimationStackElement *added = &Pixel_AnimationElement_Stor[pos];
+	added->priority = Pixel_isLayerTrigger( element->trigger ) ? AnimationPriority_High : AnimationPriority_Low;
+	added->decimate = 0;
+	added->wait = 0;
+	added->overruns = 0;
+	added->cost = 0;
+	added->max_cost = 0;
+
 	return 1;
 }
 
@@ -714,6 +864,14 @@ AnimationStackElement *Pixel_lookupAnimation( uint16_t index, uint16_t prev )
 // If the animation is complete, do not re-add to the stack
 // - The stack is re-built each time.
 // - Ignores any stack element indices set to 0xFFFF/-1 (max)
+// - Stack order is preserved, processing order matters for overlapping animations
+//
+// Frame budget scheduling
+// - Each animation is timed, along with the whole stack
+// - Once the budget has been used, low priority animations are dropped for the frame
+// - If the stack went over budget, low priority animations are decimated further (skip more frames)
+// - If the stack used less than half of the budget, decimation is reduced
+// - High priority (layer indicator) animations are always processed
 void Pixel_stackProcess()
 {
 	uint16_t pos = 0;
@@ -722,6 +880,9 @@ void Pixel_stackProcess()
 	// We reset the stack size, and rebuild the stack on the fly
 	Pixel_AnimationStack.size = 0;
 
+	Latency_start_time( pixelStackLatencyResource );
+	Time stack_start = Time_now();
+
 	// Process each element of the stack
 	for ( ; pos < size; pos++ )
 	{
@@ -734,11 +895,41 @@ void Pixel_stackProcess()
 			continue;
 		}
 
+		// Low priority animations may be skipped this frame
+		if ( Pixel_stack_budget > 0 && elem->priority == AnimationPriority_Low )
+		{
+			// Decimated, waiting for next frame to process
+			// Out of time for this frame, drop
+			if ( elem->wait > 0 || Time_duration_us( stack_start ) >= Pixel_stack_budget )
+			{
+				if ( elem->wait > 0 )
+				{
+					elem->wait--;
+				}
+				elem->overruns++;
+
+				// Re-add animation to stack
+				Pixel_AnimationStack.stack[Pixel_AnimationStack.size++] = elem;
+				continue;
+			}
+		}
+
 		// Store index, in case we need to send an event
 		uint16_t cur_index = elem->index;
 
 		// Process animation element
-		if ( Pixel_animationProcess( elem ) )
+		Time elem_start = Time_now();
+		uint8_t active = Pixel_animationProcess( elem );
+
+		// Animation cost
+		elem->cost = Time_duration_us( elem_start );
+		if ( elem->cost > elem->max_cost )
+		{
+			elem->max_cost = elem->cost;
+		}
+		elem->wait = elem->decimate;
+
+		if ( active )
 		{
 			// Re-add animation to stack
 			Pixel_AnimationStack.stack[Pixel_AnimationStack.size++] = elem;
@@ -749,6 +940,44 @@ void Pixel_stackProcess()
 			Macro_animationState( cur_index, ScheduleType_Done );
 		}
 	}
+
+	Pixel_stack_cost = Time_duration_us( stack_start );
+	Latency_end_time( pixelStackLatencyResource );
+
+	// Adjust decimation of low priority animations for the next frame
+	if ( Pixel_stack_budget == 0 )
+	{
+		return;
+	}
+
+	int8_t adjust = 0;
+	if ( Pixel_stack_cost > Pixel_stack_budget )
+	{
+		Pixel_stack_overruns++;
+		adjust = 1;
+	}
+	else if ( Pixel_stack_cost < Pixel_stack_budget / 2 )
+	{
+		adjust = -1;
+	}
+
+	for ( pos = 0; adjust != 0 && pos < Pixel_AnimationStack.size; pos++ )
+	{
+		AnimationStackElement *elem = Pixel_AnimationStack.stack[pos];
+		if ( elem->priority != AnimationPriority_Low )
+		{
+			continue;
+		}
+
+		if ( adjust > 0 && elem->decimate < Pixel_MaxDecimation_define )
+		{
+			elem->decimate++;
+		}
+		else if ( adjust < 0 && elem->decimate > 0 )
+		{
+			elem->decimate--;
+		}
+	}
 }
 
 
@@ -996,6 +1225,170 @@ void Pixel_pixelEvaluation( PixelModElement *mod, PixelElement *elem )
 
 // -- Fill Algorithms --
 
+// Build column and row fill lists from the display mapping
+// Only needs to be done once, Pixel_DisplayMapping does not change at runtime
+void Pixel_fillListSetup()
+{
+	// Columns
+	uint16_t count = 0;
+	for ( uint16_t col = 0; col < Pixel_DisplayMapping_Cols_KLL; col++ )
+	{
+		Pixel_fill_column_start[col] = count;
+		for ( uint16_t row = 0; row < Pixel_DisplayMapping_Rows_KLL; row++ )
+		{
+			uint16_t index = Pixel_DisplayMapping[ row * Pixel_DisplayMapping_Cols_KLL + col ];
+
+			// Ignore blank and invalid pixels
+			if ( index == 0 || index > Pixel_TotalPixels_KLL )
+			{
+				continue;
+			}
+
+			// Pixels should only be mapped once, stop if they aren't
+			if ( count >= Pixel_TotalPixels_KLL )
+			{
+				warn_print("Column fill list is full, pixel mapped more than once?");
+				break;
+			}
+
+			Pixel_fill_column_pixels[count++] = index;
+		}
+	}
+	Pixel_fill_column_start[Pixel_DisplayMapping_Cols_KLL] = count;
+
+	// Rows
+	count = 0;
+	for ( uint16_t row = 0; row < Pixel_DisplayMapping_Rows_KLL; row++ )
+	{
+		Pixel_fill_row_start[row] = count;
+		for ( uint16_t col = 0; col < Pixel_DisplayMapping_Cols_KLL; col++ )
+		{
+			uint16_t index = Pixel_DisplayMapping[ row * Pixel_DisplayMapping_Cols_KLL + col ];
+
+			// Ignore blank and invalid pixels
+			if ( index == 0 || index > Pixel_TotalPixels_KLL )
+			{
+				continue;
+			}
+
+			// Pixels should only be mapped once, stop if they aren't
+			if ( count >= Pixel_TotalPixels_KLL )
+			{
+				warn_print("Row fill list is full, pixel mapped more than once?");
+				break;
+			}
+
+			Pixel_fill_row_pixels[count++] = index;
+		}
+	}
+	Pixel_fill_row_start[Pixel_DisplayMapping_Rows_KLL] = count;
+}
+
+// Fill List Lookup
+// - Returns the precomputed list of pixel indices (1-indexed) for fill address types
+// - *count is set to the number of pixels in the list
+// - Returns NULL/0 if mod is not a fill type or the column/row does not exist
+const uint16_t *Pixel_fillPixelList(
+	PixelModElement *mod,
+	AnimationStackElement *stack_elem,
+	uint16_t *count
+)
+{
+	int32_t col;
+	int32_t row;
+
+	*count = 0;
+
+	switch ( mod->type )
+	{
+	case PixelAddressType_ColumnFill:
+		col = mod->rect.col;
+		break;
+
+	case PixelAddressType_RowFill:
+		row = mod->rect.row;
+		goto row_fill;
+
+	case PixelAddressType_RelativeColumnFill:
+	{
+		// Determine scancode to be relative from
+		uint8_t scan_code = Pixel_determineLastTriggerScanCode( stack_elem->trigger );
+		if ( scan_code == 0 )
+		{
+			return 0;
+		}
+
+		// Lookup display position of scancode
+		uint16_t position = Pixel_ScanCodeToDisplay[ scan_code - 1 ];
+
+		// Calculate rectangle offset
+		position += (int16_t)mod->rect.col;
+
+		// Make sure column exists
+		if ( position >= Pixel_DisplayMapping_Cols_KLL * Pixel_DisplayMapping_Rows_KLL )
+		{
+			erro_msg("Invalid position index (relcol): ");
+			printInt16( position );
+			print( NL );
+			return 0;
+		}
+
+		// Determine which column we are in
+		col = position % Pixel_DisplayMapping_Cols_KLL;
+		break;
+	}
+
+	case PixelAddressType_RelativeRowFill:
+	{
+		// Determine scancode to be relative from
+		uint8_t scan_code = Pixel_determineLastTriggerScanCode( stack_elem->trigger );
+		if ( scan_code == 0 )
+		{
+			return 0;
+		}
+
+		// Lookup display position of scancode
+		uint16_t position = Pixel_ScanCodeToDisplay[ scan_code - 1 ];
+
+		// Calculate rectangle offset
+		position += (int16_t)mod->rect.row * Pixel_DisplayMapping_Rows_KLL;
+
+		// Make sure row exists
+		if ( position >= Pixel_DisplayMapping_Cols_KLL * Pixel_DisplayMapping_Rows_KLL )
+		{
+			erro_msg("Invalid position index (relrow): ");
+			printInt16( position );
+			print( NL );
+			return 0;
+		}
+
+		// Determine which row we are in
+		row = position / Pixel_DisplayMapping_Cols_KLL;
+		goto row_fill;
+	}
+
+	// Not a fill
+	default:
+		return 0;
+	}
+
+	// Column fill
+	if ( col < 0 || col >= Pixel_DisplayMapping_Cols_KLL )
+	{
+		return 0;
+	}
+	*count = Pixel_fill_column_start[col + 1] - Pixel_fill_column_start[col];
+	return &Pixel_fill_column_pixels[ Pixel_fill_column_start[col] ];
+
+row_fill:
+	if ( row < 0 || row >= Pixel_DisplayMapping_Rows_KLL )
+	{
+		return 0;
+	}
+	*count = Pixel_fill_row_start[row + 1] - Pixel_fill_row_start[row];
+	return &Pixel_fill_row_pixels[ Pixel_fill_row_start[row] ];
+}
+
 // Fill Algorithm Pixel Lookup
 // - **elem stores a pointer to the PixelElement which can be used to lookup the channel buffer location
 // - Determines which pixel element to work on next
@@ -1055,54 +1448,27 @@ uint16_t Pixel_fillPixelLookup(
 		break;
 
 	case PixelAddressType_ColumnFill:
-		// Lookup pixel until either, non-0 index or we reached the last row
-		do {
-			// Check if we've processed all rows
-			if ( cur >= Pixel_DisplayMapping_Rows_KLL )
-			{
-				return 0;
-			}
-
-			// Pixel index
-			index = Pixel_DisplayMapping[ cur * Pixel_DisplayMapping_Cols_KLL + mod->rect.col ];
-
-			cur++;
-		} while ( index == 0 );
-
-		// Validate index is actually a valid evaluation
-		if ( index <= Pixel_TotalPixels_KLL )
-		{
-			*valid = 1;
-		}
-
-		// Lookup pixel, pixels are 1 indexed, hence the -1
-		*elem = (PixelElement*)&Pixel_Mapping[ index - 1 ];
-		return cur;
-
 	case PixelAddressType_RowFill:
-		// Lookup pixel until either, non-0 index or we reached the last column
-		do {
-			// Check if we've processed all rows
-			if ( cur >= Pixel_DisplayMapping_Cols_KLL )
-			{
-				return 0;
-			}
-
-			// Pixel index
-			index = Pixel_DisplayMapping[ mod->rect.row * Pixel_DisplayMapping_Cols_KLL + cur ];
-
-			cur++;
-		} while ( index == 0 );
+	case PixelAddressType_RelativeColumnFill:
+	case PixelAddressType_RelativeRowFill:
+	{
+		// Lookup precomputed fill list
+		uint16_t count;
+		const uint16_t *list = Pixel_fillPixelList( mod, stack_elem, &count );
 
-		// Validate index is actually a valid evaluation
-		if ( index <= Pixel_TotalPixels_KLL )
+		// Check if we've processed all pixels in the column/row
+		if ( list == 0 || cur >= count )
 		{
-			*valid = 1;
+			return 0;
 		}
 
+		// Fill lists only contain valid pixels
+		*valid = 1;
+
 		// Lookup pixel, pixels are 1 indexed, hence the -1
-		*elem = (PixelElement*)&Pixel_Mapping[ index - 1 ];
-		return cur;
+		*elem = (PixelElement*)&Pixel_Mapping[ list[cur] - 1 ];
+		return cur + 1;
+	}
 
 	case PixelAddressType_ScanCode:
 		// Make sure ScanCode exists
@@ -1141,112 +1507,16 @@ uint16_t Pixel_fillPixelLookup(
 			break;
 		}
 
-		// Lookup pixel, pixels are 1 indexed, hence the -1
-		index = Pixel_DisplayMapping[ position ];
-
-		// Validate index is actually a valid evaluation
-		if ( index <= Pixel_TotalPixels_KLL && index != 0 )
-		{
-			*valid = 1;
-			*elem = (PixelElement*)&Pixel_Mapping[ index - 1 ];
-		}
-		break;
-	}
-	case PixelAddressType_RelativeColumnFill:
-	{
-		// Determine scancode to be relative from
-		uint8_t scan_code = Pixel_determineLastTriggerScanCode( stack_elem->trigger );
-
-		// Lookup display position of scancode
-		uint16_t position = Pixel_ScanCodeToDisplay[ scan_code - 1 ];
-
-		// Calculate rectangle offset
-		position += (int16_t)mod->rect.col;
-
-		// Make sure column exists
-		if ( position >= Pixel_DisplayMapping_Cols_KLL * Pixel_DisplayMapping_Rows_KLL )
-		{
-			erro_msg("Invalid position index (relcol): ");
-			printInt16( position );
-			print( NL );
-			break;
-		}
-
-		// Determine first row in column
-		position %= Pixel_DisplayMapping_Cols_KLL;
-
-		// Lookup pixel until either, non-0 index or we reached the last row
-		do {
-			// Current position
-			uint16_t curpos = cur++ * Pixel_DisplayMapping_Cols_KLL + position;
-
-			// Check if we've gone too far (and finished all rows)
-			if ( curpos >= Pixel_DisplayMapping_Cols_KLL * Pixel_DisplayMapping_Rows_KLL )
-			{
-				return 0;
-			}
-
-			// Pixel index
-			index = Pixel_DisplayMapping[ curpos ];
-		} while ( index == 0 );
-
-		// Validate index is actually a valid evaluation
-		if ( index <= Pixel_TotalPixels_KLL )
-		{
-			*valid = 1;
-		}
-
-		// Lookup pixel, pixels are 1 indexed, hence the -1
-		*elem = (PixelElement*)&Pixel_Mapping[ index - 1 ];
-		return cur;
-	}
-	case PixelAddressType_RelativeRowFill:
-	{
-		// Determine scancode to be relative from
-		uint8_t scan_code = Pixel_determineLastTriggerScanCode( stack_elem->trigger );
-
-		// Lookup display position of scancode
-		uint16_t position = Pixel_ScanCodeToDisplay[ scan_code - 1 ];
-
-		// Calculate rectangle offset
-		position += (int16_t)mod->rect.row * Pixel_DisplayMapping_Rows_KLL;
-
-		// Make sure column exists
-		if ( position >= Pixel_DisplayMapping_Cols_KLL * Pixel_DisplayMapping_Rows_KLL )
-		{
-			erro_msg("Invalid position index (relrow): ");
-			printInt16( position );
-			print( NL );
-			break;
-		}
-
-		// Determine which row we are in
-		position /= Pixel_DisplayMapping_Cols_KLL;
-
-		// Lookup pixel until either, non-0 index or we reached the last row
-		do {
-			// Current position
-			uint16_t curpos = cur++ + Pixel_DisplayMapping_Cols_KLL * position;
-
-			// Check if we've gone too far (and finished all rows)
-			if ( cur >= Pixel_DisplayMapping_Cols_KLL )
-			{
-				return 0;
-			}
-
-			// Pixel index
-			index = Pixel_DisplayMapping[ curpos ];
-		} while ( index == 0 );
+		// Lookup pixel, pixels are 1 indexed, hence the -1
+		index = Pixel_DisplayMapping[ position ];
 
 		// Validate index is actually a valid evaluation
-		if ( index <= Pixel_TotalPixels_KLL )
+		if ( index <= Pixel_TotalPixels_KLL && index != 0 )
 		{
 			*valid = 1;
+			*elem = (PixelElement*)&Pixel_Mapping[ index - 1 ];
 		}
-
-		// Lookup pixel, pixels are 1 indexed, hence the -1
-		*elem = (PixelElement*)&Pixel_Mapping[ index - 1 ];
-		return cur;
+		break;
 	}
 	// Skip
 	default:
@@ -1310,21 +1580,36 @@ void Pixel_pixelTweenStandard( const uint8_t *frame, AnimationStackElement *stac
 	PixelModElement *mod = (PixelModElement*)&frame[pos];
 	while ( mod->type != PixelAddressType_End )
 	{
-		// Lookup type of pixel, choose fill algorith and query all sub-pixels
 		uint16_t next = 0;
 		uint16_t valid = 0;
 		PixelElement *prev_pixel_elem = 0;
 		PixelElement *elem = 0;
-		do {
-			// Last element
-			prev_pixel_elem = elem;
 
-			// Lookup pixel, and check if there are any more pixels left
-			next = Pixel_fillPixelLookup( mod, &elem, next, stack_elem, &valid );
+		// Fills iterate directly over the precomputed list
+		uint16_t count;
+		const uint16_t *list = Pixel_fillPixelList( mod, stack_elem, &count );
+		if ( list != 0 )
+		{
+			for ( uint16_t cur = 0; cur < count; cur++ )
+			{
+				prev_pixel_elem = (PixelElement*)&Pixel_Mapping[ list[cur] - 1 ];
+				Pixel_pixelEvaluation( mod, prev_pixel_elem );
+			}
+		}
+		// Lookup type of pixel, choose fill algorith and query all sub-pixels
+		else
+		{
+			do {
+				// Last element
+				prev_pixel_elem = elem;
+
+				// Lookup pixel, and check if there are any more pixels left
+				next = Pixel_fillPixelLookup( mod, &elem, next, stack_elem, &valid );
 
-			// Apply operation to pixel
-			Pixel_pixelEvaluation( mod, elem );
-		} while ( next );
+				// Apply operation to pixel
+				Pixel_pixelEvaluation( mod, elem );
+			} while ( next );
+		}
 
 		// Determine next position
 		pos += Pixel_pixelTweenNextPos( elem, prev_pixel_elem );
@@ -1462,6 +1747,11 @@ void Pixel_pixelTweenInterpolation( const uint8_t *frame, AnimationStackElement
 		// XXX Division...
 		uint16_t slice = prev != 0 ? 256 / (end - start + 1) : 0;
 
+		// Pack channel values of both endpoints once, all channels are interpolated together
+		// TODO Only works with 8 bit channels
+		uint32_t prev_packed = prev != 0 ? Pixel_packModData( prev->data, mod_elem->channels ) : 0;
+		uint32_t mod_packed = Pixel_packModData( mod->data, mod_elem->channels );
+
 		// Iterate over tween-pixels
 		for ( int32_t cur = 0; cur < end - start + 1; cur++ )
 		{
@@ -1528,15 +1818,11 @@ void Pixel_pixelTweenInterpolation( const uint8_t *frame, AnimationStackElement
 			if ( prev != 0 )
 			{
 				int32_t distance = slice * cur;
-				for ( uint8_t ch = 0; ch < mod_elem->channels; ch++ )
-				{
-					uint8_t pos = ch * 2 + 1; // TODO Only works with 8 bit channels
-					interp_mod->data[pos] = Pixel_8bitInterpolation(
-						prev->data[pos],
-						mod->data[pos],
-						distance
-					);
-				}
+				Pixel_unpackModData(
+					interp_mod->data,
+					Pixel_8bitInterpolation4( prev_packed, mod_packed, distance ),
+					mod_elem->channels
+				);
 			}
 
 			// Lookup type of pixel, choose fill algorith and query all sub-pixels
@@ -1695,6 +1981,8 @@ uint8_t Pixel_animationProcess( AnimationStackElement *elem )
 		break;
 	}
 
+	Trace_event( TraceEvent_Frame, elem->index, elem->pos );
+
 	// Increment positions
 	// framedelay case
 	if ( elem->framedelay > 0 )
@@ -1816,6 +2104,246 @@ void Pixel_pixelToggle( PixelElement *elem )
 
 
 
+#if defined(Output_HIDIOEnabled_define)
+// -- Frame Streaming --
+
+// Free space in the stream ring buffer
+uint16_t Pixel_streamFree()
+{
+	return Pixel_StreamBufferSize - Pixel_stream_used;
+}
+
+// Drop all queued segments
+void Pixel_streamFlush()
+{
+	Pixel_stream_head = 0;
+	Pixel_stream_tail = 0;
+	Pixel_stream_used = 0;
+	Pixel_stream_frames = 0;
+}
+
+// Copy into the stream ring buffer
+// XXX: Does not check if full, caller must check Pixel_streamFree() first
+void Pixel_streamWrite( const uint8_t *data, uint16_t len )
+{
+	// Split on wrap-around
+	uint16_t first = Pixel_StreamBufferSize - Pixel_stream_tail;
+	if ( first > len )
+	{
+		first = len;
+	}
+	memcpy( &Pixel_stream_buf[ Pixel_stream_tail ], data, first );
+	memcpy( Pixel_stream_buf, &data[ first ], len - first );
+
+	Pixel_stream_tail = ( Pixel_stream_tail + len ) % Pixel_StreamBufferSize;
+	Pixel_stream_used += len;
+}
+
+// Copy out of the stream ring buffer
+// XXX: Does not check if empty, caller must make sure a full frame is queued
+void Pixel_streamRead( uint8_t *data, uint16_t len )
+{
+	// Split on wrap-around
+	uint16_t first = Pixel_StreamBufferSize - Pixel_stream_head;
+	if ( first > len )
+	{
+		first = len;
+	}
+	memcpy( data, &Pixel_stream_buf[ Pixel_stream_head ], first );
+	memcpy( &data[ first ], Pixel_stream_buf, len - first );
+
+	Pixel_stream_head = ( Pixel_stream_head + len ) % Pixel_StreamBufferSize;
+	Pixel_stream_used -= len;
+}
+
+// Make sure a segment only addresses valid channels
+// Done before queueing so playback does not need to check
+uint8_t Pixel_streamValidate( const uint8_t *seg, uint16_t len )
+{
+	// Header is always 3 bytes
+	if ( len < 3 )
+	{
+		return 0;
+	}
+
+	uint16_t chan = seg[1] | ( seg[2] << 8 );
+	switch ( seg[0] & PixelStreamType_Mask )
+	{
+	case PixelStreamType_Raw:
+		return chan + ( len - 3 ) <= Pixel_TotalChannels_KLL;
+
+	case PixelStreamType_Delta:
+		for ( uint16_t pos = 3; pos < len; )
+		{
+			// Each run is [skip][count][value * count]
+			if ( pos + 2 > len )
+			{
+				return 0;
+			}
+			chan += seg[ pos ];
+			uint8_t count = seg[ pos + 1 ];
+			pos += 2;
+
+			if ( pos + count > len || chan + count > Pixel_TotalChannels_KLL )
+			{
+				return 0;
+			}
+			chan += count;
+			pos += count;
+		}
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+// Apply a streamed segment to the pixel buffers
+void Pixel_streamApply( const uint8_t *seg, uint16_t len )
+{
+	uint16_t chan = seg[1] | ( seg[2] << 8 );
+	switch ( seg[0] & PixelStreamType_Mask )
+	{
+	// Sequential channel values
+	case PixelStreamType_Raw:
+		for ( uint16_t pos = 3; pos < len; pos++ )
+		{
+			Pixel_channelSet( chan++, seg[ pos ] );
+		}
+		break;
+
+	// Only changed channels, skipped channels keep their previous value
+	case PixelStreamType_Delta:
+		for ( uint16_t pos = 3; pos < len; )
+		{
+			chan += seg[ pos ];
+			uint8_t count = seg[ pos + 1 ];
+			pos += 2;
+
+			for ( ; count > 0; count-- )
+			{
+				Pixel_channelSet( chan++, seg[ pos++ ] );
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Play back the next streamed frame, if a complete one is queued
+// Called once per pixel frame, so playback is paced by the LED frame rate
+void Pixel_streamProcess()
+{
+	if ( Pixel_stream_frames == 0 )
+	{
+		return;
+	}
+
+	uint8_t seg[ HIDIO_Max_Payload ];
+	uint8_t len;
+	do
+	{
+		Pixel_streamRead( &len, 1 );
+		Pixel_streamRead( seg, len );
+		Pixel_streamApply( seg, len );
+	} while ( !( seg[0] & PixelStreamFlag_EndOfFrame ) );
+
+	Pixel_stream_frames--;
+	Pixel_stream_played++;
+}
+
+// HIDIO_Id__PixelStream call
+// Payload is a single frame segment
+//  [type|flags:1][start channel:2 (little endian)][data...]
+//  Raw   - data is a sequence of 8-bit values starting at the start channel
+//  Delta - data is a sequence of [skip:1][count:1][value:count] runs
+//          skip is relative to the end of the previous run (or the start channel)
+//  Flush - drops all queued segments, no channel or data
+// Set PixelStreamFlag_EndOfFrame on the final segment of a frame
+//
+// Every segment is answered with [free bytes:2][queued frames:2] for flow control
+// A NAK means the segment was not queued, the host should resend it once enough frames have been played
+// (if free bytes is larger than the segment, the segment is invalid and should not be resent)
+HIDIO_Return Pixel_streamCall( uint16_t buf_pos, uint8_t irq )
+{
+	// Buffer processing is done outside of interrupts
+	if ( irq )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	// Retrieve segment
+	uint8_t tmpbuf[ HIDIO_Max_Payload ];
+	uint16_t len;
+	uint8_t *seg = HIDIO_call_payload( buf_pos, tmpbuf, &len );
+	if ( seg == 0 )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	HIDIO_Packet_Type reply = HIDIO_Packet_Type__ACK;
+	if ( len > 0 && ( seg[0] & PixelStreamType_Mask ) == PixelStreamType_Flush )
+	{
+		Pixel_streamFlush();
+	}
+	else if ( !Pixel_streamValidate( seg, len ) )
+	{
+		reply = HIDIO_Packet_Type__NAK;
+		Pixel_stream_rejected++;
+	}
+	else if ( len + 1 > Pixel_streamFree() )
+	{
+		// If there are no complete frames queued, the partial frame can never finish
+		// Drop it, the frame is larger than the stream buffer
+		if ( Pixel_stream_frames == 0 )
+		{
+			warn_msg("Streamed frame larger than buffer, dropping: ");
+			printInt16( Pixel_stream_used + len + 1 );
+			print( NL );
+			Pixel_streamFlush();
+		}
+
+		reply = HIDIO_Packet_Type__NAK;
+		Pixel_stream_rejected++;
+	}
+	else
+	{
+		uint8_t entry_len = len;
+		Pixel_streamWrite( &entry_len, 1 );
+		Pixel_streamWrite( seg, len );
+
+		if ( seg[0] & PixelStreamFlag_EndOfFrame )
+		{
+			Pixel_stream_frames++;
+		}
+	}
+
+	// Flow control status
+	uint16_t free_bytes = Pixel_streamFree();
+	uint8_t status[] = {
+		free_bytes & 0xFF,
+		free_bytes >> 8,
+		Pixel_stream_frames & 0xFF,
+		Pixel_stream_frames >> 8,
+	};
+	HIDIO_call_response( HIDIO_Id__PixelStream, reply, status, sizeof(status) );
+
+	// Buffer is automatically released for us
+	return HIDIO_Return__Ok;
+}
+
+// HIDIO_Id__PixelStream reply
+// Frames are only sent by the host, nothing to do
+HIDIO_Return Pixel_streamReply( HIDIO_Buffer_Entry *buf, uint8_t irq )
+{
+	return HIDIO_Return__Ok;
+}
+#endif
+
+
+
 // -- Secondary Processing --
 
 void Pixel_SecondaryProcessing_profile_init()
@@ -1833,6 +2361,87 @@ void Pixel_SecondaryProcessing_profile_init()
 			Pixel_pixel_fade_profile[entry.pixels[pxin] - 1] = group + 1;
 		}
 	}
+
+	// Channel runs need to be regenerated
+	Pixel_pixel_fade_runs_dirty = 1;
+}
+
+// Group the channels of each fade profile into contiguous runs
+// Runs never cross LED buffer boundaries, so each run has a single width
+void Pixel_SecondaryProcessing_buildRuns()
+{
+	// Channel to profile lookup (0 is disabled)
+	uint8_t chan_profile[Pixel_TotalChannels_KLL];
+	memset( chan_profile, 0, sizeof( chan_profile ) );
+
+	for ( uint16_t pxin = 0; pxin < Pixel_TotalPixels_KLL; pxin++ )
+	{
+		const PixelElement *elem = &Pixel_Mapping[pxin];
+		for ( uint8_t ch = 0; ch < elem->channels; ch++ )
+		{
+			uint16_t chan = elem->indices[ch];
+			if ( chan < Pixel_TotalChannels_KLL )
+			{
+				chan_profile[chan] = Pixel_pixel_fade_profile[pxin];
+			}
+		}
+	}
+
+	uint16_t run = 0;
+	uint8_t proin;
+	for ( proin = 0; proin < 4; proin++ )
+	{
+		Pixel_pixel_fade_runs_start[proin] = run;
+
+		// Channels are scanned in order so neighbouring pixels merge into a single run
+		PixelFadeRun *cur = 0;
+		for ( uint16_t chan = 0; chan < Pixel_TotalChannels_KLL; chan++ )
+		{
+			// All profiles start from 1
+			if ( chan_profile[chan] != proin + 1 )
+			{
+				cur = 0;
+				continue;
+			}
+
+			PixelBuf *buf = LED_bufferMap( chan );
+			if ( buf == 0 )
+			{
+				cur = 0;
+				continue;
+			}
+			uint8_t bufin = buf - LED_Buffers;
+
+			// Extend the current run if it's in the same buffer
+			if ( cur != 0 && cur->buf == bufin && cur->len < 0xFF )
+			{
+				cur->len++;
+				continue;
+			}
+
+			// Make sure there is room left for another run
+			if ( run >= Pixel_FadeRunsMax )
+			{
+				warn_print("Fade run table is full, increase Pixel_FadeRunsMax...");
+				goto done;
+			}
+
+			cur = &Pixel_pixel_fade_runs[run++];
+			cur->buf = bufin;
+			cur->len = 1;
+			cur->start = chan - buf->offset;
+		}
+	}
+
+done:
+	// Profiles after the last one reached (run table full) are empty, [4] closes out the last range
+	for ( uint8_t next = proin + 1; next < 4; next++ )
+	{
+		Pixel_pixel_fade_runs_start[next] = run;
+	}
+	Pixel_pixel_fade_runs_start[4] = run;
+
+	Pixel_pixel_fade_runs_dirty = 0;
 }
 
 void Pixel_SecondaryProcessing_setup()
@@ -1862,114 +2471,175 @@ void Pixel_SecondaryProcessing_setup()
 		Pixel_pixel_fade_profile_entries[pf].pos = 0;
 		Pixel_pixel_fade_profile_entries[pf].period_conf = PixelPeriodIndex_Off_to_On;
 	}
+
+	// Build channel runs for the default profiles
+	Pixel_SecondaryProcessing_buildRuns();
+}
+
+// Determine the scaling for the current position of a fade profile
+//
+// Percentage calculation using 32-bit integer instead of float
+// This is just a: pos / end * current value of LED
+// Ignores rounding
+// For 8-bit values, the maximum percentage spread must be no greater than 25-bits
+// e.g. 1 << 24
+void Pixel_SecondaryProcessing_scale( PixelFadeProfile *profile, PixelFadeScale *scale )
+{
+	PixelPeriodConfig *period = &profile->conf[profile->period_conf];
+
+	// Default to gamma correction only
+	scale->enabled = 0;
+	scale->gamma = gamma_enabled;
+	scale->mult = 1;
+	scale->shift = 0;
+
+	switch ( profile->period_conf )
+	{
+	// Off -> On
+	case PixelPeriodIndex_Off_to_On:
+	// On -> Off
+	case PixelPeriodIndex_On_to_Off:
+		// If start and end are set to 0, ignore
+		if ( period->end == 0 && period->start == 0 )
+		{
+			break;
+		}
+
+		scale->enabled = 1;
+		scale->mult = profile->pos;
+		scale->shift = period->end;
+		break;
+
+	// On hold time
+	case PixelPeriodIndex_On:
+		scale->enabled = gamma_enabled;
+		break;
+
+	// Off hold time
+	case PixelPeriodIndex_Off:
+	{
+		PixelPeriodConfig *prev = &profile->conf[PixelPeriodIndex_On_to_Off];
+
+		// If the previous config was disabled, do not set to 0
+		if ( prev->start == 0 && prev->end == 0 )
+		{
+			break;
+		}
+
+		// If the previous On->Off change didn't go to fully off
+		// Calculate the value based off the previous config
+		// Otherwise set to 0
+		scale->enabled = 1;
+		scale->mult = 0;
+		if ( prev->start != 0 )
+		{
+			scale->mult = (1 << prev->start) - 1;
+			scale->shift = prev->end;
+		}
+		break;
+	}
+	}
 }
 
+// Apply fade scaling to a run of channels
+// Only the lower 8 bits of each channel are used
+#define Pixel_FadeRunExpansion(type, data, run, scale) \
+	{ \
+		type *val = &((type*)(data))[ run->start ]; \
+		type *end = val + run->len; \
+		if ( scale->gamma ) \
+		{ \
+			for ( ; val < end; val++ ) \
+				*val = (uint8_t)( ( gamma_table[(uint8_t)*val] * scale->mult ) >> scale->shift ); \
+		} \
+		else \
+		{ \
+			for ( ; val < end; val++ ) \
+				*val = (uint8_t)( ( (uint8_t)*val * scale->mult ) >> scale->shift ); \
+		} \
+	}
+
 void Pixel_SecondaryProcessing()
 {
 	// Copy KLL buffer into LED buffer
 	for ( uint8_t buf = 0; buf < Pixel_BuffersLen_KLL; buf++ )
 	{
-		memcpy(
-			LED_Buffers[buf].data,
-			Pixel_Buffers[buf].data,
-			Pixel_Buffers[buf].size * ( Pixel_Buffers[buf].width >> 3 ) // Size may not be multiples bytes
-		);
+		PixelBuf *src = &Pixel_Buffers[buf];
+		PixelBuf *dst = &LED_Buffers[buf];
+
+		// Same width, straight copy
+		if ( src->width == dst->width )
+		{
+			memcpy(
+				dst->data,
+				src->data,
+				src->size * ( src->width >> 3 ) // Size may not be multiples bytes
+			);
+			continue;
+		}
+
+		// LED buffers only hold what the driver sends (8-bit PWM), narrow each channel
+		switch ( src->width )
+		{
+		case 16:
+		{
+			uint16_t *val = (uint16_t*)src->data;
+			uint16_t *end = val + src->size;
+			uint8_t *out = (uint8_t*)dst->data;
+			for ( ; val < end; val++ )
+				*out++ = (uint8_t)*val;
+			break;
+		}
+		case 32:
+		{
+			uint32_t *val = (uint32_t*)src->data;
+			uint32_t *end = val + src->size;
+			uint8_t *out = (uint8_t*)dst->data;
+			for ( ; val < end; val++ )
+				*out++ = (uint8_t)*val;
+			break;
+		}
+		default:
+			erro_print("Unsupported buffer width");
+			break;
+		}
+	}
+
+	// Regenerate channel runs if profile assignments have changed
+	if ( Pixel_pixel_fade_runs_dirty )
+	{
+		Pixel_SecondaryProcessing_buildRuns();
 	}
 
-	// Iterate over each of the pixels, applying the appropriate profile to each one
-	for ( uint16_t pxin = 0; pxin < Pixel_TotalPixels_KLL; pxin++ )
+	// Apply each profile to its channel runs
+	for ( uint8_t proin = 0; proin < 4; proin++ )
 	{
-		// Select profile
-		uint8_t profile_in = Pixel_pixel_fade_profile[pxin];
+		// Calculate the scaling once per profile
+		PixelFadeScale scale;
+		Pixel_SecondaryProcessing_scale( &Pixel_pixel_fade_profile_entries[proin], &scale );
 
-		// Nothing to do (fade disabled for this pixel)
-		if ( profile_in == 0 )
+		// Nothing to do for this profile
+		if ( !scale.enabled )
 		{
 			continue;
 		}
 
-		// All profiles start from 1
-		PixelFadeProfile *profile = &Pixel_pixel_fade_profile_entries[profile_in - 1];
-		PixelPeriodConfig *period = &profile->conf[profile->period_conf];
-
-		// Lookup channels of the pixel
-		const PixelElement *elem = &Pixel_Mapping[pxin];
-		for ( uint8_t ch = 0; ch < elem->channels; ch++ )
+		for ( uint16_t runin = Pixel_pixel_fade_runs_start[proin]; runin < Pixel_pixel_fade_runs_start[proin + 1]; runin++ )
 		{
-			// Lookup PixelBuf containing the channel
-			uint16_t chan = elem->indices[ch];
-			PixelBuf *buf = LED_bufferMap( chan );
+			PixelFadeRun *run = &Pixel_pixel_fade_runs[runin];
+			PixelBuf *buf = &LED_Buffers[run->buf];
 
-			// Lookup memory location
-			// Then apply fade depending on the current position
-			//
-			// Percentage calculation using 32-bit integer instead of float
-			// This is just a: pos / end * current value of LED
-			// Ignores rounding
-			// For 8-bit values, the maximum percentage spread must be no greater than 25-bits
-			// e.g. 1 << 24
-			uint32_t val;
-			switch (buf->width)
+			// Lookup buffer to data width mapping
+			switch ( buf->width )
 			{
-			// TODO (HaaTa): Handle non-16bit arrays of 8-bit values
+			case 8:
+				Pixel_FadeRunExpansion( uint8_t, buf->data, run, (&scale) );
+				break;
 			case 16:
-				switch ( profile->period_conf )
-				{
-				// Off -> On
-				case PixelPeriodIndex_Off_to_On:
-				// On -> Off
-				case PixelPeriodIndex_On_to_Off:
-					// If start and end are set to 0, ignore
-					if ( period->end == 0 && period->start == 0 )
-					{
-						break;
-					}
-
-					val = (uint8_t)((uint16_t*)buf->data)[chan - buf->offset];
-					if (gamma_enabled) {
-						val = gamma_table[val];
-					}
-					val *= profile->pos;
-					val >>= period->end;
-					((uint16_t*)buf->data)[chan - buf->offset] = (uint8_t)val;
-					break;
-				// On hold time
-				case PixelPeriodIndex_On:
-					if (gamma_enabled) {
-						val = (uint8_t)((uint16_t*)buf->data)[chan - buf->offset];
-						val = gamma_table[val];
-						((uint16_t*)buf->data)[chan - buf->offset] = (uint8_t)val;
-					}
-					break;
-				// Off hold time
-				case PixelPeriodIndex_Off:
-				{
-					PixelPeriodConfig *prev = &profile->conf[PixelPeriodIndex_On_to_Off];
-
-					// If the previous config was disabled, do not set to 0
-					if ( prev->start == 0 && prev->end == 0 )
-					{
-						break;
-					}
-
-					// If the previous On->Off change didn't go to fully off
-					// Calculate the value based off the previous config
-					val = 0;
-					if ( prev->start != 0 )
-					{
-						val = (uint8_t)((uint16_t*)buf->data)[chan - buf->offset];
-						if (gamma_enabled) {
-							val = gamma_table[val];
-						}
-						val *= (1 << prev->start) - 1;
-						val >>= prev->end;
-					}
-
-					// Set to 0
-					((uint16_t*)buf->data)[chan - buf->offset] = (uint8_t)val;
-					break;
-				}
-				}
+				Pixel_FadeRunExpansion( uint16_t, buf->data, run, (&scale) );
+				break;
+			case 32:
+				Pixel_FadeRunExpansion( uint32_t, buf->data, run, (&scale) );
 				break;
 			default:
 				erro_print("Unsupported buffer width");
@@ -2059,6 +2729,38 @@ uint8_t Pixel_determineLastTriggerScanCode( TriggerMacro *trigger )
 	}
 }
 
+// Determines if a trigger macro contains a layer state trigger
+// Used to detect layer indicator animations
+uint8_t Pixel_isLayerTrigger( TriggerMacro *trigger )
+{
+	// Ignore unset and default (set to 1) triggers
+	if ( (uintptr_t)trigger <= 1 )
+	{
+		return 0;
+	}
+
+	// Iterate over each TriggerGuide element of each combo
+	for ( var_uint_t pos = 0; trigger->guide[ pos ] != 0; pos += trigger->guide[ pos ] * TriggerGuideSize + 1 )
+	{
+		for ( uint8_t comboItem = 0; comboItem < trigger->guide[ pos ]; comboItem++ )
+		{
+			TriggerGuide *guide = (TriggerGuide*)&trigger->guide[ pos + 1 + comboItem * TriggerGuideSize ];
+			switch ( guide->type )
+			{
+			case TriggerType_Layer1:
+			case TriggerType_Layer2:
+			case TriggerType_Layer3:
+			case TriggerType_Layer4:
+				return 1;
+			default:
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
 // External Animation Control
 void Pixel_setAnimationControl( AnimationControl control )
 {
@@ -2379,6 +3081,11 @@ inline void Pixel_process()
 	// Process Animation Stack
 	Pixel_stackProcess();
 
+#if defined(Output_HIDIOEnabled_define)
+	// Streamed frames are drawn over the animation stack
+	Pixel_streamProcess();
+#endif
+
 	// Pause if necessary
 	switch( Pixel_animationControl )
 	{
@@ -2435,11 +3142,28 @@ inline void Pixel_setup()
 	// Add initial animations
 	Pixel_initializeStartAnimations();
 
+	// Precompute column and row fill lists
+	Pixel_fillListSetup();
+
 	// Initialize secondary buffer processing
 	Pixel_SecondaryProcessing_setup();
 
+	// Setup animation stack frame budget
+	Pixel_stack_budget = Pixel_FrameBudget_us_define;
+	Pixel_stack_cost = 0;
+	Pixel_stack_overruns = 0;
+
 	// Allocate latency resource
 	pixelLatencyResource = Latency_add_resource("PixelMap", LatencyOption_Ticks);
+	pixelStackLatencyResource = Latency_add_resource("PixelStack", LatencyOption_us);
+
+#if defined(Output_HIDIOEnabled_define)
+	// Setup frame streaming
+	Pixel_streamFlush();
+	Pixel_stream_played = 0;
+	Pixel_stream_rejected = 0;
+	HIDIO_register_id( HIDIO_Id__PixelStream, (void*)Pixel_streamCall, (void*)Pixel_streamReply );
+#endif
 }
 
 
@@ -2879,6 +3603,12 @@ void cliFunc_aniStack( char* args )
 	print(NL);
 	info_msg("Stack Size: ");
 	printInt16( Pixel_AnimationStack.size );
+	print(" Budget: ");
+	printInt32( Pixel_stack_budget );
+	print("us Last: ");
+	printInt32( Pixel_stack_cost );
+	print("us Overruns: ");
+	printInt32( Pixel_stack_overruns );
 	for ( uint8_t pos = 0; pos < Pixel_AnimationStack.size; pos++ )
 	{
 		print(NL);
@@ -2897,6 +3627,16 @@ void cliFunc_aniStack( char* args )
 		printInt8( elem->ffunc );
 		print(") pfunc(");
 		printInt8( elem->pfunc );
+		print(") prio(");
+		printInt8( elem->priority );
+		print(") cost(");
+		printInt32( elem->cost );
+		print("us) maxcost(");
+		printInt32( elem->max_cost );
+		print("us) decimate(");
+		printInt8( elem->decimate );
+		print(") overruns(");
+		printInt16( elem->overruns );
 		print(")");
 	}
 }
@@ -119,6 +119,12 @@ typedef enum AnimationPlayState {
 	AnimationPlayState_Single = 3, // Play a single frame of the animation
 } AnimationPlayState;
 
+// Animation Scheduling Priority
+typedef enum AnimationPriority {
+	AnimationPriority_Low  = 0, // Decimated or dropped when the frame budget is exceeded
+	AnimationPriority_High = 1, // Always processed at full rate (e.g. layer indicators)
+} AnimationPriority;
+
 typedef enum AnimationControl {
 	AnimationControl_Forward    = 0, // Default
 	AnimationControl_ForwardOne = 1,
@@ -129,6 +135,16 @@ typedef enum AnimationControl {
 	AnimationControl_Clear      = 6, // Clears the display, animations continue
 } AnimationControl;
 
+// Frame Stream Segment Type
+// First byte of each HIDIO_Id__PixelStream segment
+typedef enum PixelStreamType {
+	PixelStreamType_Raw   = 0, // Sequential channel values
+	PixelStreamType_Delta = 1, // Runs of changed channel values
+	PixelStreamType_Flush = 2, // Drop all queued segments
+	PixelStreamType_Mask  = 0x0F,
+} PixelStreamType;
+#define PixelStreamFlag_EndOfFrame 0x80
+
 typedef enum PixelPeriodIndex {
 	PixelPeriodIndex_Off_to_On = 0, // Start, fading from off to on
 	PixelPeriodIndex_On        = 1, // Hold on
@@ -210,6 +226,13 @@ typedef struct AnimationStackElement {
 	// TODO ffunc and pfunc args
 	AnimationReplaceType replace;     // Replace type for stack element
 	AnimationPlayState   state;       // Animation state
+	// Scheduling, reset when added to the stack
+	AnimationPriority    priority;    // Scheduling priority, layer triggered animations are high priority
+	uint8_t              decimate;    // # of frames to skip between processed frames (frame budget)
+	uint8_t              wait;        // # of frames left to skip before processing again
+	uint16_t             overruns;    // # of frames skipped or dropped due to the frame budget
+	uint32_t             cost;        // Last processing time (us)
+	uint32_t             max_cost;    // Maximum processing time (us)
 } AnimationStackElement;
 
 // Animation stack
@@ -241,6 +264,22 @@ typedef struct PixelFadeProfile {
 	PixelPeriodIndex period_conf; // Which PixelPeriodConfig is being processed
 } PixelFadeProfile;
 
+// Per-frame fade scaling, calculated once per profile
+// value = ( gamma ? gamma_table[value] : value ) * mult >> shift
+typedef struct PixelFadeScale {
+	uint8_t  enabled; // Set if the profile modifies channels this frame
+	uint8_t  gamma;   // Apply gamma correction before scaling
+	uint8_t  shift;   // Right shift after multiply
+	uint32_t mult;    // Multiplier
+} PixelFadeScale;
+
+// Contiguous run of channels within a single LED buffer using the same fade profile
+typedef struct PixelFadeRun {
+	uint8_t  buf;   // LED_Buffers index
+	uint8_t  len;   // Number of channels in the run
+	uint16_t start; // First channel of the run (buffer offset already subtracted)
+} PixelFadeRun;
+
 typedef struct PixelLEDGroupEntry {
 	const uint16_t size;
 	const uint16_t *pixels;
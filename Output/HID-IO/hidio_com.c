@@ -25,6 +25,7 @@
 #include <led.h>
 #include <output_com.h>
 #include <print.h>
+#include <trace.h>
 
 // KLL
 #include <kll_defs.h>
@@ -39,8 +40,20 @@
 
 #define HIDIO_Id_List_MaxSize 20
 #define HIDIO_Max_ACK_Payload 70
-#define HIDIO_Max_Payload 200
+
+// Tx buffer must be able to hold a full window of packets
+#if HIDIOWindowSize_define * HIDIO_MAX_PACKET_SIZE > 200
+#define HIDIO_Max_Tx_Payload ( HIDIOWindowSize_define * HIDIO_MAX_PACKET_SIZE )
+#else
 #define HIDIO_Max_Tx_Payload 200
+#endif
+
+// Sync packet payload
+#define HIDIO_Sync_Request 0
+#define HIDIO_Sync_Reply   1
+
+// Batch packet record header, 16 bit id then 8 bit length
+#define HIDIO_Batch_Record_Header 3
 
 
 
@@ -55,25 +68,78 @@ typedef enum HIDIO_Info_1_Property {
 	HIDIO_Info_1_Property__OS_Type       = 3,
 	HIDIO_Info_1_Property__OS_Version    = 4,
 	HIDIO_Info_1_Property__Host_Software = 4,
+
+	// Kiibohd extensions
+	HIDIO_Info_1_Property__Window_Size   = 0x10, // Request/grant number of unacknowledged device packets
 } HIDIO_Info_1_Property;
 
+typedef enum HIDIO_Window_State {
+	HIDIO_Window_State__Normal, // Sending as the window allows
+	HIDIO_Window_State__Resync, // Timed out, waiting for the Sync reply before resending
+} HIDIO_Window_State;
+
 
 
 // ----- Structs -----
 
+// Registered Id, kept sorted by id for lookup
 typedef struct HIDIO_Id_Entry {
 	uint32_t id;
 	void *call_func;
 	void *reply_func;
+	uint32_t calls;   // Incoming calls dispatched
+	uint32_t replies; // Incoming ACK/NAKs dispatched
+	uint32_t time_us; // Total time spent in the call and reply functions
+	uint32_t max_us;  // Slowest single call or reply
 } HIDIO_Id_Entry;
 
+// Outgoing (device to host) sliding window
+// Packets between tx_buf head and next have been sent, and are waiting on an ACK
+// The transport keeps packets in order, so each ACK/NAK releases the oldest packet (cumulative)
+typedef struct HIDIO_Window {
+	HIDIO_Window_State state;
+	uint8_t  size;        // Negotiated window size
+	uint8_t  in_flight;   // Packets sent, not yet acknowledged
+	uint8_t  retries;     // Consecutive timeouts of the oldest packet
+	uint16_t next;        // tx_buf position of the next packet to send
+	Time     sent;        // Oldest in-flight packet sent (or last progress)
+	uint32_t packets;     // Packets sent, including retransmissions
+	uint32_t retransmits; // Packets resent after a timeout
+	uint32_t timeouts;    // Retransmit timer expirations
+	uint32_t dropped;     // Packets given up on after too many retries
+	uint32_t rejected;    // Packets released by a NAK, or a reply that couldn't be handled
+} HIDIO_Window;
+
+// Outgoing batch packet statistics
+typedef struct HIDIO_Batch_Stats {
+	uint32_t packets;  // Batch packets sent
+	uint32_t records;  // Messages sent in batch packets
+	uint32_t received; // Messages received in batch packets
+	uint32_t rejected; // Messages too large to batch
+} HIDIO_Batch_Stats;
+
 
 
 // ----- Function Declarations -----
 
+void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq );
+
+void cliFunc_hidioBatch( char* args );
+void cliFunc_hidioIds( char* args );
+void cliFunc_hidioWindow( char* args );
+
+
+
 // ----- Variables -----
 
+CLIDict_Entry( hidioBatch,  "Show HID-IO batch packet statistics. Argument flushes the pending batch." );
+CLIDict_Entry( hidioIds,    "Show registered HID-IO Ids with call/reply counts and timing. Argument clears counters." );
+CLIDict_Entry( hidioWindow, "Show/set the HID-IO transmit window and retransmit statistics." );
+
 CLIDict_Def( hidioCLIDict, "HID-IO Module Commands" ) = {
+	CLIDict_Item( hidioBatch ),
+	CLIDict_Item( hidioIds ),
+	CLIDict_Item( hidioWindow ),
 	{ 0, 0, 0 } // Null entry for dictionary end
 };
 
@@ -103,6 +169,20 @@ HIDIO_Buffer_Entry *HIDIO_ack_buf;
 uint8_t HIDIO_tx_buf_data[HIDIO_Max_Tx_Payload + sizeof(HIDIO_Packet)];
 HIDIO_Buffer HIDIO_tx_buf;
 
+// Packet Tx Window
+HIDIO_Window HIDIO_tx_window;
+
+// Outgoing Batch Packet
+// Records are appended after the packet header, sent once full or the deadline passes
+uint8_t HIDIO_batch_buf[ HIDIO_MAX_PACKET_SIZE ];
+uint16_t HIDIO_batch_len;
+Time HIDIO_batch_start;
+HIDIO_Batch_Stats HIDIO_batch_stats;
+
+// Set while dispatching messages from an incoming batch packet, responses are dropped
+static uint8_t HIDIO_batch_rx;       // Set while a Batch packet is being split into assembly entries
+static uint8_t HIDIO_dispatch_noack; // Set while dispatching a batched message, its responses are not sent
+
 
 
 // ----- Capabilities -----
@@ -121,7 +201,7 @@ HIDIO_Buffer HIDIO_tx_buf;
 uint8_t *HIDIO_buffer_munch( HIDIO_Buffer *buffer, uint8_t *buf, uint16_t buf_pos, uint16_t len )
 {
 	// Determine if buffer is contiguous for the length
-	if ( buf_pos + len < buffer->len )
+	if ( buf_pos + len <= buffer->len )
 	{
 		// We can just set the buffer directly
 		return &(buffer->data[ buf_pos ]);
@@ -141,9 +221,10 @@ uint8_t *HIDIO_buffer_munch( HIDIO_Buffer *buffer, uint8_t *buf, uint16_t buf_po
 	return buf;
 }
 
-// Push byte to ring buffer
-// XXX (HaaTa): Does not check if full, that needs to be validated ahead of time
-void HIDIO_buffer_push_byte( HIDIO_Buffer *buffer, uint8_t byte )
+// Push bytes to ring buffer
+// At most two copies, one up to the end of the buffer and one for the wrap-around
+// XXX Does not check if full, that needs to be validated ahead of time
+void HIDIO_buffer_push_bytes( HIDIO_Buffer *buffer, uint8_t *data, uint16_t len )
 {
 	// Check if wrap-around case
 	if ( buffer->tail == buffer->len )
@@ -151,25 +232,43 @@ void HIDIO_buffer_push_byte( HIDIO_Buffer *buffer, uint8_t byte )
 		buffer->tail = 0;
 	}
 
-	// Add byte at tail
-	buffer->data[ buffer->tail++ ] = byte;
+	// Copy up to the end of the buffer
+	uint16_t cur_len = buffer->len - buffer->tail;
+	if ( len <= cur_len )
+	{
+		memcpy( &(buffer->data[ buffer->tail ]), data, len );
+		buffer->tail += len;
+		return;
+	}
+	memcpy( &(buffer->data[ buffer->tail ]), data, cur_len );
+
+	// Remainder from the start of the buffer
+	memcpy( buffer->data, &data[ cur_len ], len - cur_len );
+	buffer->tail = len - cur_len;
 }
 
 // Modify buffer in place
+// At most two copies, one up to the end of the buffer and one for the wrap-around
 // XXX (HaaTa): Does not check tail bounds, responsibility of caller to verify bonuds are correct
 void HIDIO_modify_buffer( HIDIO_Buffer *buffer, uint16_t start, uint8_t *data, uint16_t len )
 {
-	for ( uint16_t c = 0; c < len; c++ )
+	// Wrap-around case
+	if ( start >= buffer->len )
 	{
-		uint16_t pos = c + start;
-		// Wrap-around case
-		if ( pos >= buffer->len )
-		{
-			pos -= buffer->len;
-		}
+		start -= buffer->len;
+	}
 
-		buffer->data[pos] = data[c];
+	// Copy up to the end of the buffer
+	uint16_t cur_len = buffer->len - start;
+	if ( len <= cur_len )
+	{
+		memcpy( &(buffer->data[ start ]), data, len );
+		return;
 	}
+	memcpy( &(buffer->data[ start ]), data, cur_len );
+
+	// Remainder from the start of the buffer
+	memcpy( buffer->data, &data[ cur_len ], len - cur_len );
 }
 
 // Pop bytes from ring buffer, just drops them, nothing returned
@@ -226,7 +325,7 @@ uint16_t HIDIO_buffer_position( HIDIO_Buffer *buffer, uint16_t cur_pos, uint16_t
 {
 	if ( cur_pos + distance >= buffer->len )
 	{
-		return buffer->len - (cur_pos + distance);
+		return cur_pos + distance - buffer->len;
 	}
 	else
 	{
@@ -316,6 +415,12 @@ uint16_t HIDIO_buffer_generate_packet(
 	uint32_t id
 )
 {
+	// Responses to batched messages are not sent
+	if ( HIDIO_dispatch_noack && buf == &HIDIO_ack_send_buf )
+	{
+		return payload_len;
+	}
+
 	/*
 	print("head: ");
 	printInt16( buf->head );
@@ -346,7 +451,7 @@ uint16_t HIDIO_buffer_generate_packet(
 	}
 
 	// Determine if there is enough room in tx buffer
-	uint16_t requested = payload_len - pos + sizeof(HIDIO_Packet) * ( packet_count - cur_packet );
+	uint16_t requested = payload_len - pos + ( sizeof(HIDIO_Packet) + width ) * ( packet_count - cur_packet );
 	if ( requested > HIDIO_buffer_free_bytes( buf ) )
 	{
 		erro_msg("Not enough bytes in HIDIO buffer: ");
@@ -362,15 +467,12 @@ uint16_t HIDIO_buffer_generate_packet(
 
 	// Generate a payload of given length, repeating the payload value
 	// Also proceed if building a zero-length packet
-	for ( ; pos < payload_len || payload_len == 0; pos++ )
+	while ( pos < payload_len || payload_len == 0 )
 	{
 		// Check if we need to start a new packet
-		uint16_t bytes_left = pos % max_payload;
-		if ( bytes_left == 0 )
+		uint16_t bytes_left = max_payload - pos % max_payload;
+		if ( bytes_left == max_payload )
 		{
-			// Reset bytes left
-			bytes_left = max_payload;
-
 			// Start of a new packet, signal previous one is ready
 			// Do not increment for the very first packet in the sequence
 			if ( pos != 0 )
@@ -410,13 +512,7 @@ uint16_t HIDIO_buffer_generate_packet(
 				};
 
 				// Copy packet header data to buffer
-				for ( uint8_t byte = 0; byte < sizeof(HIDIO_Packet16); byte++ )
-				{
-					HIDIO_buffer_push_byte( buf, ((uint8_t*)&packet)[ byte ] );
-				}
-
-				// There's always enough room for header
-				bytes_left -= sizeof(HIDIO_Packet16);
+				HIDIO_buffer_push_bytes( buf, (uint8_t*)&packet, sizeof(HIDIO_Packet16) );
 			}
 			else
 			{
@@ -430,13 +526,7 @@ uint16_t HIDIO_buffer_generate_packet(
 				};
 
 				// Copy packet header data to buffer
-				for ( uint8_t byte = 0; byte < sizeof(HIDIO_Packet32); byte++ )
-				{
-					HIDIO_buffer_push_byte( buf, ((uint8_t*)&packet)[ byte ] );
-				}
-
-				// There's always enough room for header
-				bytes_left -= sizeof(HIDIO_Packet32);
+				HIDIO_buffer_push_bytes( buf, (uint8_t*)&packet, sizeof(HIDIO_Packet32) );
 			}
 		}
 
@@ -445,14 +535,14 @@ uint16_t HIDIO_buffer_generate_packet(
 		// - bytes_left (payload left in packet)
 		// - data_len (input data buffer length)
 		// - Current overall payload position
-		uint16_t byte = 0;
-		for ( ; byte < data_len && bytes_left > 0; byte++, pos++, bytes_left-- )
-		{
-			HIDIO_buffer_push_byte( buf, data[ byte ] );
-		}
+		uint16_t byte = data_len < bytes_left ? data_len : bytes_left;
+		HIDIO_buffer_push_bytes( buf, data, byte );
+		pos += byte;
+		data += byte;
+		data_len -= byte;
 
 		// If we are out of data in the data buffer, return the current position
-		if ( byte >= data_len )
+		if ( data_len == 0 )
 		{
 			break;
 		}
@@ -483,6 +573,363 @@ void HIDIO_nopayload_ack( uint32_t id )
 }
 
 
+// Retrieve the payload of an assembly buffer entry
+// Used by registered call functions
+// buf_pos - Index position of the entry, as given to the call function
+// data - Must pass an array of at least HIDIO_Max_Payload in size (used on wrap-around)
+// size - Set to the length of the payload
+//
+// Returns 0 if the entry is not complete
+uint8_t *HIDIO_call_payload( uint16_t buf_pos, uint8_t *data, uint16_t *size )
+{
+	// Munch buffer entry header, not including data
+	uint8_t tmpbuf[ sizeof(HIDIO_Buffer_Entry) ];
+	uint8_t *buf = HIDIO_buffer_munch( &HIDIO_assembly_buf, (uint8_t*)&tmpbuf, buf_pos, sizeof(HIDIO_Buffer_Entry) );
+	HIDIO_Buffer_Entry *entry = (HIDIO_Buffer_Entry*)buf;
+
+	// Make sure entry is ready
+	if ( !entry->done || entry->size > HIDIO_Max_Payload )
+	{
+		return 0;
+	}
+	*size = entry->size;
+
+	// Payload follows the entry header, check for wrap-around
+	uint16_t data_pos = buf_pos + sizeof(HIDIO_Buffer_Entry);
+	if ( data_pos >= HIDIO_assembly_buf.len )
+	{
+		data_pos -= HIDIO_assembly_buf.len;
+	}
+
+	return HIDIO_buffer_munch( &HIDIO_assembly_buf, data, data_pos, entry->size );
+}
+
+// Queue a response (ACK/NAK) to a call, with an optional payload
+void HIDIO_call_response( uint32_t id, HIDIO_Packet_Type type, uint8_t *data, uint16_t len )
+{
+	uint16_t pos = 0;
+	do
+	{
+		pos = HIDIO_buffer_generate_packet(
+			&HIDIO_ack_send_buf,
+			pos,
+			len,
+			len > 0 ? &data[ pos ] : 0,
+			len > 0 ? 1 : 0,
+			type,
+			id
+		);
+	} while ( pos < len );
+}
+
+
+
+// Set the transmit window size, limited to 1 through hidioWindowSize
+// Packets already in flight are unaffected
+void HIDIO_window_size( uint8_t size )
+{
+	if ( size < 1 )
+	{
+		size = 1;
+	}
+	if ( size > HIDIOWindowSize_define )
+	{
+		size = HIDIOWindowSize_define;
+	}
+
+	HIDIO_tx_window.size = size;
+}
+
+// Release the oldest packet in the tx buffer
+static void HIDIO_tx_release()
+{
+	// Enough space to store header
+	uint8_t tmpdata[ sizeof(HIDIO_Packet) ];
+	HIDIO_Packet *packet = (HIDIO_Packet*)HIDIO_buffer_munch( &HIDIO_tx_buf, tmpdata, HIDIO_tx_buf.head, sizeof(tmpdata) );
+
+	// Determine size of data
+	uint16_t datasize = (packet->upper_len << 8) | packet->len;
+
+	// Pop bytes and decrement packet ready counter
+	if ( HIDIO_buffer_pop_bytes( &HIDIO_tx_buf, datasize + 2 ) )
+	{
+		HIDIO_tx_buf.packets_ready--;
+	}
+	// Failed pop, generally popping more buffer than is available
+	// (this is very bad, but recovering anyways)
+	else
+	{
+		HIDIO_tx_buf.packets_ready = 0;
+		HIDIO_tx_buf.head = 0;
+		HIDIO_tx_buf.tail = 0;
+		HIDIO_tx_window.next = 0;
+		HIDIO_tx_window.in_flight = 0;
+	}
+}
+
+// Send a Sync packet straight away
+// Used as a barrier, the transport is in order so the reply follows any outstanding ACKs
+static void HIDIO_sync_send( uint8_t payload )
+{
+	uint8_t buf[ HIDIO_MAX_PACKET_SIZE ] = { 0 };
+	HIDIO_Packet16 *packet = (HIDIO_Packet16*)buf;
+	packet->type = HIDIO_Packet_Type__Sync;
+	packet->len = sizeof(packet->id) + 1;
+	packet->id = 0;
+	packet->data[0] = payload;
+
+	Output_rawio_sendbuffer( (char*)buf );
+}
+
+// ACK/NAK received for the oldest in-flight packet
+static void HIDIO_tx_window_ack()
+{
+	// Late reply for a packet that was given up on
+	if ( HIDIO_tx_window.in_flight == 0 )
+	{
+		return;
+	}
+
+	HIDIO_tx_release();
+	if ( HIDIO_tx_window.in_flight > 0 )
+	{
+		HIDIO_tx_window.in_flight--;
+	}
+	HIDIO_tx_window.retries = 0;
+	HIDIO_tx_window.sent = Time_now();
+
+	// Nothing left to resend, the Sync reply is no longer needed
+	if ( HIDIO_tx_window.in_flight == 0 )
+	{
+		HIDIO_tx_window.state = HIDIO_Window_State__Normal;
+	}
+}
+
+// Go back to the oldest unacknowledged packet and resend from there
+static void HIDIO_tx_window_rewind()
+{
+	HIDIO_tx_window.retransmits += HIDIO_tx_window.in_flight;
+	HIDIO_tx_window.in_flight = 0;
+	HIDIO_tx_window.next = HIDIO_tx_buf.head;
+	HIDIO_tx_window.state = HIDIO_Window_State__Normal;
+}
+
+// Check the retransmit timer of the oldest in-flight packet
+static void HIDIO_tx_window_timeout()
+{
+	if ( HIDIO_tx_window.in_flight == 0
+		|| Time_duration_ms( HIDIO_tx_window.sent ) < HIDIORetransmitTimeout_define )
+	{
+		return;
+	}
+
+	HIDIO_tx_window.timeouts++;
+	HIDIO_tx_window.sent = Time_now();
+
+	// Host isn't responding, give up on everything in flight
+	if ( ++HIDIO_tx_window.retries > HIDIOMaxRetries_define )
+	{
+		warn_print("HID-IO host not responding, dropping packets");
+		HIDIO_tx_window.dropped += HIDIO_tx_window.in_flight;
+		while ( HIDIO_tx_window.in_flight > 0 )
+		{
+			HIDIO_tx_release();
+			if ( HIDIO_tx_window.in_flight > 0 )
+			{
+				HIDIO_tx_window.in_flight--;
+			}
+		}
+		HIDIO_tx_window.next = HIDIO_tx_buf.head;
+		HIDIO_tx_window.retries = 0;
+		HIDIO_tx_window.state = HIDIO_Window_State__Normal;
+		return;
+	}
+
+	// ACKs may still be on their way, don't resend until the Sync reply shows what was lost
+	HIDIO_tx_window.state = HIDIO_Window_State__Resync;
+	HIDIO_sync_send( HIDIO_Sync_Request );
+}
+
+// Incoming Sync packet
+static void HIDIO_sync_receive( uint8_t *data, uint16_t len )
+{
+	// Reply to our Sync request, anything still in flight was lost
+	if ( len > 0 && data[0] == HIDIO_Sync_Reply )
+	{
+		if ( HIDIO_tx_window.state == HIDIO_Window_State__Resync )
+		{
+			HIDIO_tx_window_rewind();
+		}
+		return;
+	}
+
+	// Host request, queued behind any pending ACKs
+	uint8_t reply = HIDIO_Sync_Reply;
+	HIDIO_call_response( 0, HIDIO_Packet_Type__Sync, &reply, 1 );
+}
+
+
+// Send the pending batch packet, if there is one
+void HIDIO_batch_flush()
+{
+	if ( HIDIO_batch_len == 0 )
+	{
+		return;
+	}
+
+	HIDIO_Packet *packet = (HIDIO_Packet*)HIDIO_batch_buf;
+	packet->type = HIDIO_Packet_Type__Batch;
+	packet->cont = 0;
+	packet->id_width = 0;
+	packet->reserved = 0;
+	packet->upper_len = ( HIDIO_batch_len >> 8 ) & 0x3;
+	packet->len = HIDIO_batch_len & 0xFF;
+
+	Output_rawio_sendbuffer( (char*)HIDIO_batch_buf );
+	HIDIO_batch_stats.packets++;
+
+	// Clear, so unused bytes are sent as 0
+	memset( HIDIO_batch_buf, 0, sizeof(HIDIO_batch_buf) );
+	HIDIO_batch_len = 0;
+}
+
+// Queue a small message to be sent in a batch packet
+// Batched messages are not ACK'd, use for frequent events where the latest state matters most
+// Only 16 bit ids are supported, and the message must fit in a single packet
+// Sent when the packet fills up, or hidioBatchDeadline ms after the first message was queued
+//
+// Returns 1 if queued, 0 if the message cannot be batched
+uint8_t HIDIO_batch_push( uint16_t id, uint8_t *data, uint8_t len )
+{
+	uint16_t max = HIDIO_Packet_Size - sizeof(HIDIO_Packet);
+	uint16_t size = HIDIO_Batch_Record_Header + len;
+	if ( size > max )
+	{
+		HIDIO_batch_stats.rejected++;
+		return 0;
+	}
+
+	// Not enough room left, send what we have first
+	if ( HIDIO_batch_len + size > max )
+	{
+		HIDIO_batch_flush();
+	}
+
+	// Deadline starts with the first message
+	if ( HIDIO_batch_len == 0 )
+	{
+		HIDIO_batch_start = Time_now();
+	}
+
+	uint8_t *record = &HIDIO_batch_buf[ sizeof(HIDIO_Packet) + HIDIO_batch_len ];
+	record[0] = id & 0xFF;
+	record[1] = id >> 8;
+	record[2] = len;
+	memcpy( &record[ HIDIO_Batch_Record_Header ], data, len );
+
+	HIDIO_batch_len += size;
+	HIDIO_batch_stats.records++;
+	return 1;
+}
+
+// Incoming Batch packet
+// Each message is dispatched as if it arrived in its own Data packet
+static void HIDIO_batch_receive( uint8_t *data, uint16_t len, uint8_t irq )
+{
+	// Messages would be appended to the continued payload
+	if ( HIDIO_assembly_buf.waiting )
+	{
+		warn_print("Dropping incoming Batch packet, waiting on Continued Data packet...");
+		return;
+	}
+
+	HIDIO_batch_rx = 1;
+
+	uint16_t pos = 0;
+	while ( pos + HIDIO_Batch_Record_Header <= len )
+	{
+		uint16_t id = data[ pos ] | ( data[ pos + 1 ] << 8 );
+		uint8_t size = data[ pos + 2 ];
+		pos += HIDIO_Batch_Record_Header;
+
+		// Truncated record
+		if ( pos + size > len )
+		{
+			warn_print("Truncated HID-IO Batch record");
+			break;
+		}
+
+		// Rebuild as a single Data packet
+		uint8_t buf[ HIDIO_MAX_PACKET_SIZE ];
+		HIDIO_Packet16 *packet = (HIDIO_Packet16*)buf;
+		packet->type = HIDIO_Packet_Type__Data;
+		packet->cont = 0;
+		packet->id_width = 0;
+		packet->reserved = 0;
+		packet->upper_len = 0;
+		packet->len = sizeof(packet->id) + size;
+		packet->id = id;
+		memcpy( packet->data, &data[ pos ], size );
+
+		HIDIO_process_incoming_packet( buf, irq );
+		HIDIO_batch_stats.received++;
+
+		pos += size;
+	}
+
+	HIDIO_batch_rx = 0;
+}
+
+
+// Position of id in the sorted id list
+// If not registered, the position it would be inserted at
+static uint16_t HIDIO_id_position( uint32_t id )
+{
+	uint16_t low = 0;
+	uint16_t high = HIDIO_Id_List_Size;
+
+	// Binary search
+	while ( low < high )
+	{
+		uint16_t mid = ( low + high ) / 2;
+		if ( HIDIO_Id_List[ mid ].id < id )
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+// Lookup registered id
+// Returns 0 if not registered
+static HIDIO_Id_Entry *HIDIO_id_lookup( uint32_t id )
+{
+	uint16_t pos = HIDIO_id_position( id );
+	if ( pos < HIDIO_Id_List_Size && HIDIO_Id_List[ pos ].id == id )
+	{
+		return &HIDIO_Id_List[ pos ];
+	}
+
+	return 0;
+}
+
+// Accumulate time spent in a call/reply function
+static void HIDIO_id_time( HIDIO_Id_Entry *entry, Time start )
+{
+	uint32_t us = Time_duration_us( start );
+	entry->time_us += us;
+	if ( us > entry->max_us )
+	{
+		entry->max_us = us;
+	}
+}
+
+
 
 // ----- Internal Id Functions -----
 
@@ -493,9 +940,31 @@ void HIDIO_supported_0_request()
 }
 
 // Supported Ids call
+// ACK'd with the list of registered 16 bit Ids
 HIDIO_Return HIDIO_supported_0_call( uint16_t buf_pos, uint8_t irq )
 {
-	// TODO
+	if ( irq )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	uint8_t ids[ HIDIO_Id_List_MaxSize * 2 ];
+	uint16_t len = 0;
+	for ( uint16_t pos = 0; pos < HIDIO_Id_List_Size; pos++ )
+	{
+		uint32_t id = HIDIO_Id_List[ pos ].id;
+		if ( id > 0xFFFF )
+		{
+			continue;
+		}
+
+		ids[ len++ ] = id & 0xFF;
+		ids[ len++ ] = id >> 8;
+	}
+
+	HIDIO_call_response( HIDIO_Id__Supported, HIDIO_Packet_Type__ACK, ids, len );
+
+	// Buffer is automatically released for us
 	return HIDIO_Return__Ok;
 }
 
@@ -513,9 +982,44 @@ void HIDIO_info_1_request( uint8_t property )
 }
 
 // Info call
+// Payload is the property (1 byte), followed by an optional property argument
+// ACK'd with the property and its value, NAK'd with the property if unsupported
 HIDIO_Return HIDIO_info_1_call( uint16_t buf_pos, uint8_t irq )
 {
-	// TODO
+	if ( irq )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	uint8_t tmpbuf[ HIDIO_Max_Payload ];
+	uint16_t len;
+	uint8_t *payload = HIDIO_call_payload( buf_pos, tmpbuf, &len );
+	if ( payload == 0 )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	uint8_t reply[2] = { len > 0 ? payload[0] : 0xFF, 0 };
+
+	switch ( reply[0] )
+	{
+	// Window size, optionally requested by the host
+	// Granted size is limited by hidioWindowSize
+	case HIDIO_Info_1_Property__Window_Size:
+		if ( len > 1 )
+		{
+			HIDIO_window_size( payload[1] );
+		}
+		reply[1] = HIDIO_tx_window.size;
+		HIDIO_call_response( HIDIO_Id__Info, HIDIO_Packet_Type__ACK, reply, 2 );
+		break;
+
+	default:
+		HIDIO_call_response( HIDIO_Id__Info, HIDIO_Packet_Type__NAK, reply, 1 );
+		break;
+	}
+
+	// Buffer is automatically released for us
 	return HIDIO_Return__Ok;
 }
 
@@ -555,31 +1059,27 @@ HIDIO_Return HIDIO_test_2_call( uint16_t buf_pos, uint8_t irq )
 		return HIDIO_Return__Delay;
 	}
 
-	// Munch buffer entry header, not including data
-	uint8_t tmpbuf[ sizeof(HIDIO_Buffer_Entry) ];
-	uint8_t *buf = HIDIO_buffer_munch( &HIDIO_assembly_buf, (uint8_t*)&tmpbuf, buf_pos, sizeof(HIDIO_Buffer_Entry) );
-	HIDIO_Buffer_Entry *entry = (HIDIO_Buffer_Entry*)buf;
+	// Retrieve payload, only copied if it wraps around the buffer
+	uint8_t tmpbuf[ HIDIO_Max_Payload ];
+	uint16_t len;
+	uint8_t *payload = HIDIO_call_payload( buf_pos, tmpbuf, &len );
 
 	// Make sure entry is ready
-	if ( !entry->done )
+	if ( payload == 0 )
 	{
 		return HIDIO_Return__Delay;
 	}
 
-	// Get size and iterate through payload
+	// Iterate through payload
 	uint16_t transitions = 0;
 	uint8_t last_byte = 0;
-	for ( uint16_t pos = 0; pos < entry->size; pos++ )
+	for ( uint16_t pos = 0; pos < len; pos++ )
 	{
-		uint8_t buf;
-		uint16_t calc_buf_pos = HIDIO_buffer_position( &HIDIO_assembly_buf, buf_pos + sizeof(HIDIO_Buffer_Entry), pos );
-		uint8_t *byte = HIDIO_buffer_munch( &HIDIO_assembly_buf, &buf, calc_buf_pos, 1 );
-
 		// Count transitions, should only be 1, from 0 to value
-		if ( *byte != last_byte )
+		if ( payload[ pos ] != last_byte )
 		{
 			transitions++;
-			last_byte = *byte;
+			last_byte = payload[ pos ];
 		}
 	}
 
@@ -594,12 +1094,12 @@ HIDIO_Return HIDIO_test_2_call( uint16_t buf_pos, uint8_t irq )
 
 	// Prepare ACK
 	uint16_t pos = 0;
-	while ( pos < entry->size )
+	while ( pos < len )
 	{
 		pos = HIDIO_buffer_generate_packet(
 			&HIDIO_ack_send_buf,
 			pos,
-			entry->size,
+			len,
 			&last_byte,
 			1,
 			HIDIO_Packet_Type__ACK,
@@ -652,6 +1152,42 @@ HIDIO_Return HIDIO_test_2_reply( HIDIO_Buffer_Entry *buf, uint8_t irq )
 	return HIDIO_Return__Ok;
 }
 
+// Trace call
+// Payload is the new trace mask (1 byte), ACK'd with the mask in use
+HIDIO_Return HIDIO_trace_34_call( uint16_t buf_pos, uint8_t irq )
+{
+	if ( irq )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	uint8_t tmpbuf[ HIDIO_Max_Payload ];
+	uint16_t len;
+	uint8_t *payload = HIDIO_call_payload( buf_pos, tmpbuf, &len );
+	if ( payload == 0 )
+	{
+		return HIDIO_Return__Delay;
+	}
+
+	if ( len > 0 )
+	{
+		Trace_mask = payload[0];
+	}
+
+	uint8_t mask = Trace_mask;
+	HIDIO_call_response( HIDIO_Id__Trace, HIDIO_Packet_Type__ACK, &mask, 1 );
+
+	// Buffer is automatically released for us
+	return HIDIO_Return__Ok;
+}
+
+// Trace reply
+// Host acknowledged a packet of trace records
+HIDIO_Return HIDIO_trace_34_reply( HIDIO_Buffer_Entry *buf, uint8_t irq )
+{
+	return HIDIO_Return__Ok;
+}
+
 // Invalid Id Request
 void HIDIO_invalid_65535_request()
 {
@@ -675,6 +1211,21 @@ void HIDIO_invalid_65535_request()
 // If an Id is not registered, it is ignored and automatically NAK'd
 void HIDIO_register_id( uint32_t id, void* incoming_call_func, void* incoming_reply_func )
 {
+	// Find sorted position
+	uint16_t pos = HIDIO_id_position( id );
+	HIDIO_Id_Entry *entry = &HIDIO_Id_List[ pos ];
+
+	// Already registered, replace handlers
+	if ( pos < HIDIO_Id_List_Size && entry->id == id )
+	{
+		warn_msg("HIDIO Id already registered, replacing: ");
+		printInt32( id );
+		print( NL );
+		entry->call_func = incoming_call_func;
+		entry->reply_func = incoming_reply_func;
+		return;
+	}
+
 	// Check if there is any room left in the list
 	if ( HIDIO_Id_List_Size >= HIDIO_Id_List_MaxSize )
 	{
@@ -684,8 +1235,11 @@ void HIDIO_register_id( uint32_t id, void* incoming_call_func, void* incoming_re
 		return;
 	}
 
-	// Add id to unsorted list (no reason to sort, as Ids may not be contiguous)
-	HIDIO_Id_Entry *entry = &HIDIO_Id_List[ HIDIO_Id_List_Size++ ];
+	// Make room, keeping the list sorted
+	memmove( entry + 1, entry, ( HIDIO_Id_List_Size - pos ) * sizeof(HIDIO_Id_Entry) );
+	HIDIO_Id_List_Size++;
+
+	memset( entry, 0, sizeof(HIDIO_Id_Entry) );
 	entry->id = id;
 	entry->call_func = incoming_call_func;
 	entry->reply_func = incoming_reply_func;
@@ -700,18 +1254,25 @@ HIDIO_Return HIDIO_call_id( uint32_t id, uint16_t buf_pos, uint8_t irq )
 	HIDIO_Return retval = HIDIO_Return__Unknown;
 
 	// Find id
-	for ( uint16_t pos = 0; pos < HIDIO_Id_List_Size; pos++ )
+	HIDIO_Id_Entry *id_entry = HIDIO_id_lookup( id );
+	if ( id_entry )
 	{
-		// Match id
-		if ( HIDIO_Id_List[ pos ].id == id )
-		{
-			// Map function pointer
-			HIDIO_Return (*func)(uint16_t, uint8_t) = \
-				(HIDIO_Return(*)(uint16_t, uint8_t))(HIDIO_Id_List[ pos ].call_func);
-
-			// Call function
-			retval = func( buf_pos, irq );
-		}
+		// Map function pointer
+		HIDIO_Return (*func)(uint16_t, uint8_t) = \
+			(HIDIO_Return(*)(uint16_t, uint8_t))(id_entry->call_func);
+
+		// Messages from a Batch packet don't get responses
+		uint8_t tmpentry[sizeof(HIDIO_Buffer_Entry)];
+		HIDIO_Buffer_Entry *call_entry = (HIDIO_Buffer_Entry*)HIDIO_buffer_munch( &HIDIO_assembly_buf, tmpentry, buf_pos, sizeof(tmpentry) );
+		HIDIO_dispatch_noack = call_entry->type == HIDIO_Packet_Type__Batch;
+
+		// Call function
+		Time start = Time_now();
+		retval = func( buf_pos, irq );
+		id_entry->calls++;
+		HIDIO_id_time( id_entry, start );
+
+		HIDIO_dispatch_noack = 0;
 	}
 
 	// Enough space to store header
@@ -749,7 +1310,9 @@ HIDIO_Return HIDIO_call_id( uint32_t id, uint16_t buf_pos, uint8_t irq )
 	// HIDIO_Return__InBuffer_Fail, Nak (or related), drop all continued packets if necessary
 	case HIDIO_Return__InBuffer_Fail:
 		// TODO (HaaTa)
-		print("FAIL"NL);
+		erro_msg("HIDIO call failed, Id: ");
+		printHex32( id );
+		print( NL );
 		break;
 
 	default:
@@ -768,60 +1331,37 @@ HIDIO_Return HIDIO_reply_id( uint32_t id, uint8_t *buf, uint8_t irq )
 	HIDIO_Return retval = HIDIO_Return__Unknown;
 
 	// Find id
-	for ( uint16_t pos = 0; pos < HIDIO_Id_List_Size; pos++ )
+	HIDIO_Id_Entry *entry = HIDIO_id_lookup( id );
+	if ( entry )
 	{
-		// Match id
-		if ( HIDIO_Id_List[ pos ].id == id )
-		{
-			// Map function pointer
-			HIDIO_Return (*func)(HIDIO_Buffer_Entry*, uint8_t) = \
-				(HIDIO_Return(*)(HIDIO_Buffer_Entry*, uint8_t))(HIDIO_Id_List[ pos ].reply_func);
-
-			// Call function
-			retval = func( (HIDIO_Buffer_Entry*)buf, irq );
-			break;
-		}
+		// Map function pointer
+		HIDIO_Return (*func)(HIDIO_Buffer_Entry*, uint8_t) = \
+			(HIDIO_Return(*)(HIDIO_Buffer_Entry*, uint8_t))(entry->reply_func);
+
+		// Call function
+		Time start = Time_now();
+		retval = func( (HIDIO_Buffer_Entry*)buf, irq );
+		entry->replies++;
+		HIDIO_id_time( entry, start );
 	}
 
-	// Enough space to store header
-	uint8_t tmpdata[6];
-	uint16_t datasize;
-	HIDIO_Packet *packet;
-
 	switch ( retval )
 	{
-	// HIDIO_Return__Ok, we can pop the most recent tx_buf packet
+	// HIDIO_Return__Ok, we can pop the oldest in-flight tx_buf packet
 	case HIDIO_Return__Ok:
-		packet = (HIDIO_Packet*)HIDIO_buffer_munch( &HIDIO_tx_buf, tmpdata, HIDIO_tx_buf.head, sizeof(tmpdata) );
-
-		// Determine size of data
-		datasize = (packet->upper_len << 8) | packet->len;
-
-		// Pop bytes and decrement packet ready counter
-		if ( HIDIO_buffer_pop_bytes( &HIDIO_tx_buf, datasize + 2 ) )
+		// NAKs still release the packet, resending it would only be rejected again
+		if ( ((HIDIO_Buffer_Entry*)buf)->type == HIDIO_Packet_Type__NAK )
 		{
-			HIDIO_tx_buf.packets_ready--;
+			HIDIO_tx_window.rejected++;
 		}
-		// Failed pop, generally popping more buffer than is available
-		// (this is very bad, but recovering anyways)
-		else
-		{
-			HIDIO_tx_buf.packets_ready = 0;
-			HIDIO_tx_buf.head = 0;
-			HIDIO_tx_buf.tail = 0;
-		}
-
-		// Unset waiting for ACK packet
-		HIDIO_tx_buf.waiting = 0;
-		break;
-
-	// HIDIO_Return__InBuffer_Fail, Nak (or related), drop all continued packets if necessary
-	case HIDIO_Return__InBuffer_Fail:
-		// TODO (HaaTa)
-		print("FAIL"NL);
+		HIDIO_tx_window_ack();
 		break;
 
+	// HIDIO_Return__InBuffer_Fail, Unknown Id, etc.
+	// Replies are not revisited, the host did reply, so release the packet rather than waiting for the retransmit timer
 	default:
+		HIDIO_tx_window.rejected++;
+		HIDIO_tx_window_ack();
 		break;
 	}
 
@@ -879,6 +1419,17 @@ inline void HIDIO_setup()
 	HIDIO_tx_buf.waiting = 0;
 	HIDIO_tx_buf.data = HIDIO_tx_buf_data;
 
+	// Setup Tx Window, stop-and-wait until the host negotiates a larger window
+	memset( &HIDIO_tx_window, 0, sizeof(HIDIO_tx_window) );
+	HIDIO_tx_window.size = 1;
+
+	// Setup Batch Packet
+	memset( HIDIO_batch_buf, 0, sizeof(HIDIO_batch_buf) );
+	memset( &HIDIO_batch_stats, 0, sizeof(HIDIO_batch_stats) );
+	HIDIO_batch_len = 0;
+	HIDIO_batch_rx = 0;
+	HIDIO_dispatch_noack = 0;
+
 	// Register Output CLI dictionary
 	CLI_registerDictionary( hidioCLIDict, hidioCLIDictName );
 
@@ -889,9 +1440,10 @@ inline void HIDIO_setup()
 	HIDIO_Id_List_Size = 0;
 
 	// Register internal Ids
-	HIDIO_register_id( 0, (void*)HIDIO_supported_0_call, (void*)HIDIO_supported_0_reply );
-	HIDIO_register_id( 1, (void*)HIDIO_info_1_call, (void*)HIDIO_info_1_reply );
-	HIDIO_register_id( 2, (void*)HIDIO_test_2_call, (void*)HIDIO_test_2_reply );
+	HIDIO_register_id( HIDIO_Id__Supported, (void*)HIDIO_supported_0_call, (void*)HIDIO_supported_0_reply );
+	HIDIO_register_id( HIDIO_Id__Info, (void*)HIDIO_info_1_call, (void*)HIDIO_info_1_reply );
+	HIDIO_register_id( HIDIO_Id__Test, (void*)HIDIO_test_2_call, (void*)HIDIO_test_2_reply );
+	HIDIO_register_id( HIDIO_Id__Trace, (void*)HIDIO_trace_34_call, (void*)HIDIO_trace_34_reply );
 }
 
 // HID-IO Process Packet
@@ -901,7 +1453,7 @@ void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq )
 	HIDIO_Packet *packet = (HIDIO_Packet*)buf;
 
 	// Check header packet type to see if a valid packet
-	if ( packet->type > HIDIO_Packet_Type__Continued )
+	if ( packet->type > HIDIO_Packet_Type__Batch )
 		return;
 
 	// Check if the length is valid
@@ -923,9 +1475,10 @@ void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq )
 	uint8_t *data = 0;
 	switch ( type )
 	{
-	case HIDIO_Packet_Type__Sync:
-		// TODO
-		print("SYNC");
+	// Batch packets have no Id, records start immediately
+	case HIDIO_Packet_Type__Batch:
+		data = packet->data;
+		payload_len = packet_len;
 		break;
 
 	// XXX Falls through on purpose
@@ -979,18 +1532,14 @@ void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq )
 			entry.id = id;
 			entry.size = payload_len;
 			entry.done = packet->cont ? 0 : 1;
-			entry.type = packet->type;
+			// Batched messages are marked on the entry, so they are never acknowledged, even if processing is delayed
+			entry.type = HIDIO_batch_rx ? HIDIO_Packet_Type__Batch : packet->type;
 
 			// Determine buffer position where we are starting
 			HIDIO_assembly_buf.cur_buf_head = HIDIO_assembly_buf.tail;
 
-			// Copy byte-by-byte into ring buffer
-			// TODO (HaaTa): Make more efficient by checking conditions and using memcpy when appropriate
 			// First the entry info
-			for ( uint8_t c = 0; c < sizeof(HIDIO_Buffer_Entry); c++ )
-			{
-				HIDIO_buffer_push_byte( &HIDIO_assembly_buf, ((uint8_t*)&entry)[c] );
-			}
+			HIDIO_buffer_push_bytes( &HIDIO_assembly_buf, (uint8_t*)&entry, sizeof(HIDIO_Buffer_Entry) );
 		}
 		else
 		{
@@ -1023,11 +1572,8 @@ void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq )
 		// Determine if we are waiting for continued packets
 		HIDIO_assembly_buf.waiting = packet->cont;
 
-		// Then the payload data
-		for ( uint16_t c = 0; c < payload_len; c++ )
-		{
-			HIDIO_buffer_push_byte( &HIDIO_assembly_buf, data[c] );
-		}
+		// Then the payload data, straight from the packet
+		HIDIO_buffer_push_bytes( &HIDIO_assembly_buf, data, payload_len );
 
 		// If finished, send to appropriate registered callback
 		HIDIO_assembly_buf.packets_ready++;
@@ -1044,7 +1590,11 @@ void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq )
 				HIDIO_assembly_buf.packets_ready--;
 				HIDIO_assembly_buf.head = HIDIO_assembly_buf.tail;
 
-				// Generate invalid Id 0-length data packet
+				// Generate invalid Id 0-length data packet (not for batched messages)
+				if ( HIDIO_batch_rx )
+				{
+					break;
+				}
 				HIDIO_buffer_generate_packet(
 					&HIDIO_ack_send_buf,
 					0,
@@ -1086,6 +1636,13 @@ void HIDIO_process_incoming_packet( uint8_t *buf, uint8_t irq )
 			HIDIO_reply_id( id, (uint8_t*)HIDIO_ack_buf, irq );
 		}
 		break;
+
+	case HIDIO_Packet_Type__Sync:
+		HIDIO_sync_receive( data, payload_len );
+		break;
+
+	case HIDIO_Packet_Type__Batch:
+		HIDIO_batch_receive( data, payload_len, irq );
 		break;
 
 	default:
@@ -1114,17 +1671,16 @@ inline void HIDIO_process()
 	// Start latency measurement
 	Latency_start_time( hidioLatencyResource );
 
-	// TODO (HaaTa): Handle timeouts and lost packets
-
 	// Retrieve incoming packets
-	while ( Output_rawio_availablechar() )
+	// Packets are processed where the output module received them, only the payload is copied
+	uint8_t *rxdata;
+	while ( ( rxdata = (uint8_t*)Output_rawio_peekbuffer() ) )
 	{
-		// XXX Double copy is done here with getbuffer
-		uint8_t tmpdata[ HIDIO_MAX_PACKET_SIZE ];
-		Output_rawio_getbuffer( (char*)&tmpdata );
-
 		// Process Packet, regular process (no interrupt)
-		HIDIO_process_incoming_packet( tmpdata, 0 );
+		HIDIO_process_incoming_packet( rxdata, 0 );
+
+		// Hand the packet buffer back
+		Output_rawio_popbuffer();
 	}
 
 	// Send all ACK packets
@@ -1161,25 +1717,62 @@ inline void HIDIO_process()
 		}
 	}
 
-	// Send outgoing packet, we can only send one at a time
-	// and the next one can only be sent after an ACK is recieved
-	if ( HIDIO_tx_buf.packets_ready > 0 && HIDIO_tx_buf.waiting == 0 )
+	// Resend any packets the host didn't acknowledge in time
+	HIDIO_tx_window_timeout();
+
+	// Send the pending batch once its deadline has passed
+	if ( HIDIO_batch_len > 0 && Time_duration_ms( HIDIO_batch_start ) >= HIDIOBatchDeadline_define )
+	{
+		HIDIO_batch_flush();
+	}
+
+#if TraceTransport_define == 1
+	// Stream trace records while there's room in the window
+	if ( HIDIO_tx_buf.packets_ready < HIDIO_tx_window.size
+		&& HIDIO_buffer_free_bytes( &HIDIO_tx_buf ) >= HIDIO_Packet_Size )
+	{
+		uint8_t data[ HIDIO_MAX_PACKET_SIZE ];
+		uint16_t max = HIDIO_max_payload( HIDIO_id_width( HIDIO_Id__Trace ) );
+		uint16_t len = Trace_peek( data, max < sizeof(data) ? max : sizeof(data) );
+		if ( len > 0 )
+		{
+			HIDIO_buffer_generate_packet( &HIDIO_tx_buf, 0, len, data, len, HIDIO_Packet_Type__Data, HIDIO_Id__Trace );
+			Trace_consume( len );
+		}
+	}
+#endif
+
+	// Send outgoing packets, up to the window size may be waiting on an ACK
+	// Once ACK has been received (or NAK) the oldest packet will be released
+	while ( HIDIO_tx_window.state == HIDIO_Window_State__Normal
+		&& HIDIO_tx_window.in_flight < HIDIO_tx_window.size
+		&& HIDIO_tx_buf.packets_ready > HIDIO_tx_window.in_flight )
 	{
 		// Prepare 64 byte packet
 		// TODO (HaaTa): Handle internal max size
 		uint8_t tmpdata[64];
-		uint8_t *buf = HIDIO_buffer_munch( &HIDIO_tx_buf, tmpdata, HIDIO_tx_buf.head, HIDIO_Packet_Size );
+		uint8_t *buf = HIDIO_buffer_munch( &HIDIO_tx_buf, tmpdata, HIDIO_tx_window.next, HIDIO_Packet_Size );
 		HIDIO_Packet *packet = (HIDIO_Packet*)buf;
 
 		// Send packet
 		// TODO (HaaTa): Check error?
 		Output_rawio_sendbuffer( (char*)packet );
 
-		// Indicate waiting for ACK packet
-		// Once ACK has been received (or NAK) the packet will be released
-		HIDIO_tx_buf.waiting = 1;
+		// Retransmit timer runs from the oldest in-flight packet
+		if ( HIDIO_tx_window.in_flight++ == 0 )
+		{
+			HIDIO_tx_window.sent = Time_now();
+		}
+		HIDIO_tx_window.packets++;
+
+		// Determine size of data, and move on to the next packet
+		uint16_t datasize = (packet->upper_len << 8) | packet->len;
+		HIDIO_tx_window.next = HIDIO_buffer_position( &HIDIO_tx_buf, HIDIO_tx_window.next, datasize + 2 );
 	}
 
+	// Waiting on an ACK before anything else can be sent
+	HIDIO_tx_buf.waiting = HIDIO_tx_window.in_flight >= HIDIO_tx_window.size;
+
 	// End latency measurement
 	Latency_end_time( hidioLatencyResource );
 }
@@ -1188,3 +1781,115 @@ inline void HIDIO_process()
 
 // ----- CLI Command Functions -----
 
+void cliFunc_hidioBatch( char* args )
+{
+	print( NL );
+
+	// Parse argument
+	//  NOTE: Only first argument is used
+	char* arg1Ptr;
+	char* arg2Ptr;
+	CLI_argumentIsolation( args, &arg1Ptr, &arg2Ptr );
+
+	// Flush pending batch
+	if ( arg1Ptr[0] != '\0' )
+	{
+		HIDIO_batch_flush();
+	}
+
+	info_msg("Deadline: ");
+	printInt16( HIDIOBatchDeadline_define );
+	print(" ms Pending: ");
+	printInt16( HIDIO_batch_len );
+	print(" bytes");
+
+	print( NL );
+	info_msg("Sent: ");
+	printInt32( HIDIO_batch_stats.records );
+	print(" in ");
+	printInt32( HIDIO_batch_stats.packets );
+	print(" packets Received: ");
+	printInt32( HIDIO_batch_stats.received );
+	print(" Rejected: ");
+	printInt32( HIDIO_batch_stats.rejected );
+}
+
+void cliFunc_hidioIds( char* args )
+{
+	print( NL );
+
+	// Parse argument
+	//  NOTE: Only first argument is used
+	char* arg1Ptr;
+	char* arg2Ptr;
+	CLI_argumentIsolation( args, &arg1Ptr, &arg2Ptr );
+
+	for ( uint16_t pos = 0; pos < HIDIO_Id_List_Size; pos++ )
+	{
+		HIDIO_Id_Entry *entry = &HIDIO_Id_List[ pos ];
+
+		// Clear counters
+		if ( arg1Ptr[0] != '\0' )
+		{
+			entry->calls = 0;
+			entry->replies = 0;
+			entry->time_us = 0;
+			entry->max_us = 0;
+			continue;
+		}
+
+		uint32_t count = entry->calls + entry->replies;
+
+		info_msg("Id: ");
+		printHex32( entry->id );
+		print(" Calls: ");
+		printInt32( entry->calls );
+		print(" Replies: ");
+		printInt32( entry->replies );
+		print(" Avg: ");
+		printInt32( count > 0 ? entry->time_us / count : 0 );
+		print(" us Max: ");
+		printInt32( entry->max_us );
+		print(" us");
+		print( NL );
+	}
+}
+
+void cliFunc_hidioWindow( char* args )
+{
+	print( NL );
+
+	// Parse number from argument
+	//  NOTE: Only first argument is used
+	char* arg1Ptr;
+	char* arg2Ptr;
+	CLI_argumentIsolation( args, &arg1Ptr, &arg2Ptr );
+
+	// Set window size
+	if ( arg1Ptr[0] != '\0' )
+	{
+		HIDIO_window_size( (uint8_t)numToInt( arg1Ptr ) );
+	}
+
+	info_msg("Window: ");
+	printInt8( HIDIO_tx_window.size );
+	print("/");
+	printInt8( HIDIOWindowSize_define );
+	print(" In Flight: ");
+	printInt8( HIDIO_tx_window.in_flight );
+	print(" Queued: ");
+	printInt16( HIDIO_tx_buf.packets_ready );
+
+	print( NL );
+	info_msg("Sent: ");
+	printInt32( HIDIO_tx_window.packets );
+	print(" Retransmits: ");
+	printInt32( HIDIO_tx_window.retransmits );
+	print(" Timeouts: ");
+	printInt32( HIDIO_tx_window.timeouts );
+	print(" Dropped: ");
+	printInt32( HIDIO_tx_window.dropped );
+	print(" Rejected: ");
+	printInt32( HIDIO_tx_window.rejected );
+}
+
@@ -28,6 +28,9 @@
 // TODO Query from driver interface
 #define HIDIO_MAX_PACKET_SIZE 64
 
+// Maximum reassembled payload size
+#define HIDIO_Max_Payload 200
+
 
 
 // ----- Enumerations -----
@@ -38,8 +41,18 @@ typedef enum HIDIO_Packet_Type {
 	HIDIO_Packet_Type__NAK       = 2,
 	HIDIO_Packet_Type__Sync      = 3,
 	HIDIO_Packet_Type__Continued = 4,
+	HIDIO_Packet_Type__Batch     = 5, // Several small messages in one packet, not ACK'd
 } HIDIO_Packet_Type;
 
+// Reserved Ids
+typedef enum HIDIO_Id {
+	HIDIO_Id__Supported   = 0x00, // Supported Ids
+	HIDIO_Id__Info        = 0x01, // Info query
+	HIDIO_Id__Test        = 0x02, // Test packet (loopback)
+	HIDIO_Id__PixelStream = 0x21, // PixelMap frame streaming
+	HIDIO_Id__Trace       = 0x22, // Binary trace stream
+} HIDIO_Id;
+
 typedef enum HIDIO_Return {
 	HIDIO_Return__Ok,
 	HIDIO_Return__InBuffer_Fail,  // Problem with the incoming buffer
@@ -112,3 +125,12 @@ void HIDIO_setup();
 void HIDIO_process();
 void HIDIO_packet_interrupt( uint8_t* buf );
 
+void HIDIO_register_id( uint32_t id, void* incoming_call_func, void* incoming_reply_func );
+void HIDIO_window_size( uint8_t size );
+
+uint8_t HIDIO_batch_push( uint16_t id, uint8_t *data, uint8_t len );
+void HIDIO_batch_flush();
+
+uint8_t *HIDIO_call_payload( uint16_t buf_pos, uint8_t *data, uint16_t *size );
+void HIDIO_call_response( uint32_t id, HIDIO_Packet_Type type, uint8_t *data, uint16_t len );
+
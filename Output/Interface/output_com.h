@@ -81,6 +81,8 @@ int Output_putstr( char* str );
 
 unsigned int Output_rawio_availablechar();
 int Output_rawio_getbuffer( char* buffer );
+char* Output_rawio_peekbuffer(); // Oldest received packet, in place (0 if none), release with popbuffer
+void Output_rawio_popbuffer();
 int Output_rawio_sendbuffer( char* buffer );
 
 // Returns the total mA available (total, if used in a chain, each device will have to use a slice of it)
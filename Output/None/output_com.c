@@ -139,6 +139,19 @@ int Output_rawio_getbuffer( char* buffer )
 }
 
 
+// UART RawIO peek buffer
+char* Output_rawio_peekbuffer()
+{
+	return 0;
+}
+
+
+// UART RawIO pop buffer
+void Output_rawio_popbuffer()
+{
+}
+
+
 // UART RawIO send buffer
 int Output_rawio_sendbuffer( char* buffer )
 {
@@ -80,6 +80,9 @@ inline void Output_setup()
 inline void Output_poll()
 {
 	RTT_poll();
+
+	// Send buffered debug output
+	Print_flush();
 }
 
 
@@ -148,6 +151,21 @@ int Output_rawio_getbuffer( char* buffer )
 }
 
 
+// RTT RawIO peek buffer
+// XXX (HaaTa) Not implemented
+char* Output_rawio_peekbuffer()
+{
+	return 0;
+}
+
+
+// RTT RawIO pop buffer
+// XXX (HaaTa) Not implemented
+void Output_rawio_popbuffer()
+{
+}
+
+
 // RTT RawIO send buffer
 // XXX (HaaTa) Not implemented
 int Output_rawio_sendbuffer( char* buffer )
@@ -26,6 +26,7 @@
 
 // Project Includes
 #include <print.h>
+#include <trace.h>
 
 // RTT Includes
 #include "SEGGER_RTT.h"
@@ -45,6 +46,16 @@
 #define rtt_buffer_size 64
 #define rtt_channel 0
 
+// Binary trace stream (channel 1 is used by SystemView)
+// Streamed over HID-IO instead, if selected and available
+#if TraceTransport_define == 0 || !defined(Output_HIDIOEnabled_define)
+#define rtt_trace_enabled 1
+#else
+#define rtt_trace_enabled 0
+#endif
+#define rtt_trace_channel 2
+#define rtt_trace_buffer_size 512
+
 // ----- Variables -----
 
 volatile uint8_t rtt_buffer_head = 0;
@@ -52,6 +63,10 @@ volatile uint8_t rtt_buffer_tail = 0;
 volatile uint8_t rtt_buffer_items = 0;
 volatile uint8_t rtt_buffer[rtt_buffer_size];
 
+#if rtt_trace_enabled == 1
+static uint8_t rtt_trace_buffer[rtt_trace_buffer_size];
+#endif
+
 // ----- Capabilities -----
 
 // ----- Functions -----
@@ -61,6 +76,11 @@ inline void RTT_setup()
 {
 	SEGGER_SYSVIEW_Conf();
 	//SEGGER_SYSVIEW_Start();
+
+#if rtt_trace_enabled == 1
+	// Skip mode, records are only released once the whole write fits
+	SEGGER_RTT_ConfigUpBuffer( rtt_trace_channel, "Trace", rtt_trace_buffer, sizeof(rtt_trace_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP );
+#endif
 }
 
 
@@ -91,6 +111,20 @@ inline void RTT_poll()
 			rtt_buffer_head = 0;
 		}
 	}
+
+#if rtt_trace_enabled == 1
+	// Stream trace records, until the host falls behind
+	uint8_t data[64];
+	uint16_t len;
+	while ( ( len = Trace_peek( data, sizeof(data) ) ) > 0 )
+	{
+		if ( SEGGER_RTT_Write( rtt_trace_channel, data, len ) == 0 )
+		{
+			break;
+		}
+		Trace_consume( len );
+	}
+#endif
 }
 
 
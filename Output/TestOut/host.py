@@ -257,6 +257,110 @@ class Commands:
         control.kiibohd.HIDIO_invalid_65535_request.argtypes = []
         return control.kiibohd.HIDIO_invalid_65535_request()
 
+    def HIDIO_host_packet( self, packet_type, idval, payload ):
+        '''
+        Queue a single HID-IO packet, as if it were sent by the host
+        Payload must fit in a single packet (64 byte packets, 60 byte payload)
+
+        NOTE: Use with RawIO loopback disabled, replies are placed in rawio_incoming_buffer
+        '''
+        header = HIDIO_Packet()
+        header.type = packet_type
+        header.cont = 0
+        header.id_width = 0
+        header.upper_len = ( ( len( payload ) + 2 ) >> 8 ) & 0x3
+        header.len = ( len( payload ) + 2 ) & 0xFF
+
+        raw = bytes( header ) + idval.to_bytes( 2, byteorder='little' ) + bytes( payload )
+        raw += bytes( 64 - len( raw ) )
+        data.rawio_outgoing_buffer.append( ( header, idval, list( payload ), list( raw ) ) )
+
+    def HIDIO_host_batch( self, records ):
+        '''
+        Queue a single HID-IO Batch packet, as if it were sent by the host
+        records - List of ( id, payload ) tuples, 16 bit ids only, all must fit in a single packet
+
+        Batched messages are not ACK'd.
+        NOTE: Use with RawIO loopback disabled
+        '''
+        body = b''
+        for idval, payload in records:
+            body += idval.to_bytes( 2, byteorder='little' ) + bytes( [ len( payload ) ] ) + bytes( payload )
+
+        header = HIDIO_Packet()
+        header.type = 5
+        header.cont = 0
+        header.id_width = 0
+        header.upper_len = ( len( body ) >> 8 ) & 0x3
+        header.len = len( body ) & 0xFF
+
+        raw = bytes( header ) + body
+        raw += bytes( 64 - len( raw ) )
+        data.rawio_outgoing_buffer.append( ( header, 0, list( body ), list( raw ) ) )
+
+    def HIDIO_batch_push( self, idval, payload ):
+        '''
+        HIDIO_batch_push wrapper
+        '''
+        control.kiibohd.HIDIO_batch_push.argtypes = [ c_uint16, c_char_p, c_uint8 ]
+        control.kiibohd.HIDIO_batch_push.restype = c_uint8
+        return control.kiibohd.HIDIO_batch_push( idval, bytes( payload ), len( payload ) )
+
+    def PixelStream_segments( self, frame, previous=None, max_payload=60 ):
+        '''
+        Encode a frame of 8-bit channel values into HID-IO PixelStream segments
+        See Pixel_streamCall in Macro/PixelMap/pixel.c for the format
+
+        frame    - List of channel values, starting from channel 0
+        previous - Previously sent frame, if set only changed channels are sent (delta)
+
+        Returns a list of segment payloads, the last is flagged as the end of the frame
+        '''
+        segments = []
+
+        # Raw, sequential channel values
+        if previous is None:
+            step = max_payload - 3
+            for start in range( 0, len( frame ), step ):
+                segments.append( [ 0x00, start & 0xFF, start >> 8 ] + list( frame[start:start + step] ) )
+
+        # Delta, runs of changed channels
+        else:
+            seg = None
+            chan = 0
+            pos = 0
+            while pos < len( frame ):
+                if frame[pos] == previous[pos]:
+                    pos += 1
+                    continue
+
+                # Find the end of the run of changed channels
+                end = pos
+                while end < len( frame ) and frame[end] != previous[end] and end - pos < min( 255, max_payload - 5 ):
+                    end += 1
+
+                # Start a new segment if the skip is too large or the run does not fit
+                if seg is None or pos - chan > 255 or len( seg ) + 2 + end - pos > max_payload:
+                    if seg is not None:
+                        segments.append( seg )
+                    seg = [ 0x01, pos & 0xFF, pos >> 8 ]
+                    chan = pos
+
+                seg += [ pos - chan, end - pos ] + list( frame[pos:end] )
+                chan = end
+                pos = end
+
+            # Nothing changed, still need to signal the frame
+            if seg is None:
+                seg = [ 0x01, 0x00, 0x00 ]
+            segments.append( seg )
+
+        # Flag end of frame
+        if len( segments ) == 0:
+            segments.append( [ 0x00, 0x00, 0x00 ] )
+        segments[-1][0] |= 0x80
+        return segments
+
 
 
 class Callbacks:
@@ -292,6 +396,8 @@ class Callbacks:
             usb_keys,
         )
 
+        data.usb_keyboard_history.append( data.usb_keyboard() )
+
         # Indicate we are done with the buffer
         usb_keys.changed = 0
 
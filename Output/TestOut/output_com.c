@@ -61,6 +61,9 @@ inline void Output_setup()
 inline void Output_poll()
 {
 	TestOut_poll();
+
+	// Send buffered debug output
+	Print_flush();
 }
 
 
@@ -127,6 +130,20 @@ int Output_rawio_getbuffer( char* buffer )
 }
 
 
+// TestOut RawIO peek buffer
+char* Output_rawio_peekbuffer()
+{
+	return TestOut_rawio_peekbuffer();
+}
+
+
+// TestOut RawIO pop buffer
+void Output_rawio_popbuffer()
+{
+	TestOut_rawio_popbuffer();
+}
+
+
 // TestOut RawIO send buffer
 int Output_rawio_sendbuffer( char* buffer )
 {
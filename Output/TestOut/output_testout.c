@@ -52,6 +52,11 @@ uint8_t  USBKeys_BitfieldSize = USB_NKRO_BITFIELD_SIZE_KEYS;
 // Output_Host_Callback( char* command, char* args ) return int
 void *Output_Host_Callback;
 
+// RawIO packet held by TestOut_rawio_peekbuffer
+// XXX Must be a 64 byte buffer
+static char TestOut_rawio_rxbuf[64];
+static uint8_t TestOut_rawio_rxheld = 0;
+
 
 
 // ----- Capabilities -----
@@ -118,21 +123,8 @@ inline void TestOut_periodic()
 		USBKeys_Protocol_Change = 0;
 	}
 
-	// Boot Mode Only, unset stale keys
-	if ( USBKeys_Protocol == 0 )
-	{
-		for ( uint8_t c = USBKeys_Sent; c < USB_BOOT_MAX_KEYS; c++ )
-		{
-			USBKeys_primary.keys[c] = 0;
-		}
-	}
-
 	// Send keypresses while there are pending changes
-	while ( USBKeys_primary.changed )
-	{
-		usb_keyboard_send( (USBKeys*)&USBKeys_primary, USBKeys_Protocol );
-		Output_callback( "keyboard_send", "" );
-	}
+	USB_queueKeys();
 
 	// Signal Scan Module we are finished
 	switch ( USBKeys_Protocol )
@@ -231,6 +223,36 @@ int TestOut_rawio_getbuffer( char* buffer )
 }
 
 
+// USB RawIO peek buffer
+// Packet is fetched from the host callback once, then held until popped
+char* TestOut_rawio_peekbuffer()
+{
+#if enableRawIO_define == 1
+	if ( !TestOut_rawio_rxheld )
+	{
+		if ( !TestOut_rawio_availablechar() || !TestOut_rawio_getbuffer( TestOut_rawio_rxbuf ) )
+		{
+			return 0;
+		}
+		TestOut_rawio_rxheld = 1;
+	}
+
+	return TestOut_rawio_rxbuf;
+#else
+	return 0;
+#endif
+}
+
+
+// USB RawIO pop buffer
+void TestOut_rawio_popbuffer()
+{
+#if enableRawIO_define == 1
+	TestOut_rawio_rxheld = 0;
+#endif
+}
+
+
 // USB RawIO send buffer
 // XXX Must be a 64 byte buffer
 int TestOut_rawio_sendbuffer( char* buffer )
@@ -253,6 +275,9 @@ void usb_device_reload() {}
 void usb_device_software_reset() {}
 
 void usb_keyboard_clear( uint8_t protocol ) {}
+void usb_keyboard_flush() {}
+void usb_keyboard_init() {}
+void usb_keyboard_wake() {}
 void usb_keyboard_idle_update() {}
 void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
 {
@@ -294,6 +319,9 @@ void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
 		}
 	}
 
+	// Hand the report to the host-side, which records it
+	Output_callback( "keyboard_send", "" );
+
 	buffer->changed = USBKeyChangeState_None;
 }
 
@@ -306,5 +334,7 @@ int usb_serial_write( const void *buffer, uint32_t size ) { return 0; }
 
 uint32_t usb_rawio_available() { return 0; }
 int32_t usb_rawio_rx( void *buf, uint32_t timeout ) { return 0; }
+uint8_t *usb_rawio_rx_peek() { return 0; }
+void usb_rawio_rx_pop() {}
 int32_t usb_rawio_tx( const void *buf, uint32_t timeout ) { return 0; }
 
@@ -63,6 +63,8 @@ int TestOut_putstr( char* str );
 // RawIO Interface
 unsigned int TestOut_rawio_availablechar();
 int TestOut_rawio_getbuffer( char* buffer );
+char* TestOut_rawio_peekbuffer();
+void TestOut_rawio_popbuffer();
 int TestOut_rawio_sendbuffer( char* buffer );
 
 
@@ -76,6 +78,9 @@ void usb_device_reload();
 void usb_device_software_reset();
 
 void usb_keyboard_clear( uint8_t protocol );
+void usb_keyboard_flush();
+void usb_keyboard_init();
+void usb_keyboard_wake();
 void usb_keyboard_idle_update();
 void usb_keyboard_send( USBKeys *buffer, uint8_t protocol );
 
@@ -88,5 +93,7 @@ int usb_serial_write( const void *buffer, uint32_t size );
 
 uint32_t usb_rawio_available();
 int32_t usb_rawio_rx( void *buf, uint32_t timeout );
+uint8_t *usb_rawio_rx_peek();
+void usb_rawio_rx_pop();
 int32_t usb_rawio_tx( const void *buf, uint32_t timeout );
 
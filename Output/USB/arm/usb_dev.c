@@ -41,6 +41,10 @@
 #include "usb_dev.h"
 #include "usb_mem.h"
 
+#if enableKeyboard_define == 1
+#include "usb_keyboard.h"
+#endif
+
 #if enableVirtualSerialPort_define == 1
 #include "usb_serial.h"
 #endif
@@ -74,6 +78,12 @@
 #define BDT_DTS         0x08
 #define BDT_STALL       0x04
 
+// Remote wakeup, the device drives resume signalling for 1-15 ms
+#define USB_RESUME_SIGNAL_MS 10
+
+// Stop waiting on the host if it hasn't come back after signalling resume (it may retry on the next keypress)
+#define USB_RESUME_WAIT_MS 200
+
 #define TX    1
 #define RX    0
 #define ODD   1
@@ -184,6 +194,12 @@ static uint8_t usb_bulk_buf[64];
 volatile uint8_t usb_configuration = 0;
 volatile uint8_t usb_reboot_timer = 0;
 
+#if USBSOFAligned_define == 1
+// Time of the most recent SOF token, used to align output to the USB frame
+volatile Time usb_sof_time;
+volatile uint32_t usb_sof_count = 0;
+#endif
+
 static uint8_t reply_buffer[8];
 
 static uint8_t power_neg_delay;
@@ -191,6 +207,18 @@ static uint32_t power_neg_time;
 
 static uint8_t usb_remote_wakeup = 0;
 
+// Remote wakeup state, signalling runs from usb_resume_poll() rather than blocking the caller
+typedef enum USBResumeState {
+	USBResumeState_Idle,
+	USBResumeState_Signalling, // Driving resume on the bus
+	USBResumeState_Waiting,    // Waiting for the host to start sending SOFs again
+} USBResumeState;
+
+static volatile USBResumeState usb_resume_state = USBResumeState_Idle;
+#if defined(_kinetis_)
+static uint32_t usb_resume_time;
+#endif
+
 
 
 // ----- Functions -----
@@ -392,7 +420,7 @@ void usb_setup()
 			if ( epconf & USB_ENDPT_EPRXEN )
 			{
 				usb_packet_t *p;
-				p = usb_malloc();
+				p = usb_malloc( i );
 				if ( p )
 				{
 					table[ index( i, RX, EVEN ) ].addr = p->buf;
@@ -403,7 +431,7 @@ void usb_setup()
 					table[ index( i, RX, EVEN ) ].desc = 0;
 					usb_rx_memory_needed++;
 				}
-				p = usb_malloc();
+				p = usb_malloc( i );
 				if ( p )
 				{
 					table[ index( i, RX, ODD ) ].addr = p->buf;
@@ -1292,7 +1320,7 @@ usb_packet_t *usb_rx( uint32_t endpoint )
 
 #elif defined(_sam_)
 	// TODO (HaaTa): We probably don't need this for sam4s
-	usb_packet_t *ret = usb_malloc();
+	usb_packet_t *ret = usb_malloc( endpoint );
 	udd_ep_run(endpoint | USB_EP_DIR_OUT, false, ret->buf, ret->len, NULL);
 
 	return ret;
@@ -1342,6 +1370,27 @@ uint32_t usb_tx_packet_count( uint32_t endpoint )
 	return count;
 }
 
+// Returns 1 if the endpoint has nothing queued or waiting on the host
+uint8_t usb_tx_idle( uint32_t endpoint )
+{
+#if defined(_kinetis_)
+	uint8_t idle;
+
+	endpoint--;
+	if ( endpoint >= NUM_ENDPOINTS )
+		return 1;
+	__disable_irq();
+	idle = tx_first[ endpoint ] == NULL
+		&& ( tx_state[ endpoint ] == TX_STATE_BOTH_FREE_EVEN_FIRST
+		|| tx_state[ endpoint ] == TX_STATE_BOTH_FREE_ODD_FIRST );
+	__enable_irq();
+
+	return idle;
+#else
+	return usb_tx_packet_count( endpoint ) == 0;
+#endif
+}
+
 #if defined(_kinetis_)
 // Called from usb_free, but only when usb_rx_memory_needed > 0, indicating
 // receive endpoints are starving for memory.  The intention is to give
@@ -1349,13 +1398,15 @@ uint32_t usb_tx_packet_count( uint32_t endpoint )
 // likely calling usb_malloc to obtain memory for transmitting.  When the
 // user is creating data very quickly, their consumption could starve reception
 // without this prioritization.  The packet buffer (input) is assigned to the
-// first endpoint needing memory.
+// first endpoint needing memory whose pool class may take it.
+// Returns 1 if the packet was taken, 0 if the caller should return it to the pool.
 //
-void usb_rx_memory( usb_packet_t *packet )
+uint8_t usb_rx_memory( usb_packet_t *packet )
 {
 	//print("USB RX MEMORY");
 	unsigned int i;
 	const uint8_t *cfg;
+	uint8_t starving = 0;
 
 	cfg = usb_endpoint_config_table;
 	//serial_print("rx_mem:");
@@ -1366,33 +1417,40 @@ void usb_rx_memory( usb_packet_t *packet )
 		{
 			if ( table[ index( i, RX, EVEN ) ].desc == 0 )
 			{
+				starving = 1;
+				if ( !usb_pool_claim( packet, i ) )
+					continue;
 				table[ index( i, RX, EVEN ) ].addr = packet->buf;
 				table[ index( i, RX, EVEN ) ].desc = BDT_DESC( 64, 0 );
 				usb_rx_memory_needed--;
 				__enable_irq();
 				//serial_phex(i);
 				//serial_print(",even\n");
-				return;
+				return 1;
 			}
 			if ( table[ index( i, RX, ODD ) ].desc == 0 )
 			{
+				starving = 1;
+				if ( !usb_pool_claim( packet, i ) )
+					continue;
 				table[ index( i, RX, ODD ) ].addr = packet->buf;
 				table[ index( i, RX, ODD ) ].desc = BDT_DESC( 64, 1 );
 				usb_rx_memory_needed--;
 				__enable_irq();
 				//serial_phex(i);
 				//serial_print(",odd\n");
-				return;
+				return 1;
 			}
 		}
 	}
+	// If no endpoint was starving, usb_rx_memory_needed was set
+	// greater than zero, but no memory was actually needed.
+	if ( !starving )
+	{
+		usb_rx_memory_needed = 0;
+	}
 	__enable_irq();
-	// we should never reach this point.  If we get here, it means
-	// usb_rx_memory_needed was set greater than zero, but no memory
-	// was actually needed.
-	usb_rx_memory_needed = 0;
-	usb_free( packet );
-	return;
+	return 0;
 }
 #endif
 
@@ -1431,21 +1489,23 @@ uint8_t usb_resume()
 
 #if enableUSBResume_define == 1
 	// If we have been sleeping, try to wake up host
+	// Returns straight away, usb_resume_poll() ends the resume signalling
 	if ( usb_suspended() && usb_configured() && usb_remote_wakeup )
 	{
+		if ( usb_resume_state != USBResumeState_Idle )
+		{
+			return 1;
+		}
+
 #if enableVirtualSerialPort_define != 1
 		info_print("Attempting to resume the host");
 #endif
 
 #if defined(_kinetis_)
 		// According to the USB Spec a device must hold resume for at least 1 ms but no more than 15 ms
-		// After setting to RESUME, send a packet, delay then unset RESUME
 		USB0_CTL |= USB_CTL_RESUME;
-		usb_packet_t *tx_packet = usb_malloc();
-		usb_tx( KEYBOARD_ENDPOINT, tx_packet );
-		delay_ms(10);
-		USB0_CTL &= ~(USB_CTL_RESUME);
-		usb_dev_sleep = 0; // Make sure we don't call this again, may crash system
+		usb_resume_time = systick_millis_count;
+		usb_resume_state = USBResumeState_Signalling;
 
 #elif defined(_sam_)
 		udd_send_remotewakeup();
@@ -1461,6 +1521,48 @@ uint8_t usb_resume()
 	return 0;
 }
 
+// Advance remote wakeup signalling, call from the main loop
+void usb_resume_poll()
+{
+#if defined(_kinetis_)
+	switch ( usb_resume_state )
+	{
+	case USBResumeState_Signalling:
+		// Strictly greater, the first ms may be partial
+		if ( systick_millis_count - usb_resume_time > USB_RESUME_SIGNAL_MS )
+		{
+			USB0_CTL &= ~(USB_CTL_RESUME);
+			usb_resume_time = systick_millis_count;
+			usb_resume_state = USBResumeState_Waiting;
+		}
+		break;
+
+	case USBResumeState_Waiting:
+		// SOF tokens (or the resume interrupt) clear usb_dev_sleep once the host is back
+		if ( !usb_dev_sleep || systick_millis_count - usb_resume_time > USB_RESUME_WAIT_MS )
+		{
+			usb_resume_state = USBResumeState_Idle;
+		}
+		break;
+
+	default:
+		break;
+	}
+#endif
+}
+
+// Returns 1 while the host is suspended and a remote wakeup is, or can be, in progress
+// Reports sent in this state are held until the host is back
+uint8_t usb_resume_pending()
+{
+#if enableUSBResume_define == 1 && defined(_kinetis_)
+	return usb_resume_state != USBResumeState_Idle
+		|| ( usb_suspended() && usb_configured() && usb_remote_wakeup );
+#else
+	return 0;
+#endif
+}
+
 void usb_tx( uint32_t endpoint, usb_packet_t *packet )
 {
 	// Update expiry counter
@@ -1570,6 +1672,11 @@ restart:
 
 	if ( (status & USB_INTEN_SOFTOKEN /* 04 */ ) )
 	{
+#if USBSOFAligned_define == 1
+		usb_sof_time = Time_now();
+		usb_sof_count++;
+#endif
+
 		if ( usb_configuration )
 		{
 			t = usb_reboot_timer;
@@ -1679,6 +1786,11 @@ restart:
 						break;
 					}
 				}
+
+#if enableKeyboard_define == 1
+				// Queue the next pending keyboard report
+				usb_keyboard_tx_complete( endpoint + 1 );
+#endif
 			}
 			else
 			{ // receive
@@ -1707,10 +1819,9 @@ restart:
 					}
 					rx_last[ endpoint ] = packet;
 					usb_rx_byte_count_data[ endpoint ] += packet->len;
-					// TODO: implement a per-endpoint maximum # of allocated packets
-					// so a flood of incoming data on 1 endpoint doesn't starve
-					// the others if the user isn't reading it regularly
-					packet = usb_malloc();
+					// Receive allocations go through the pool reservations, so a flood
+					// of incoming data on 1 endpoint can't starve higher priority classes
+					packet = usb_malloc( endpoint + 1 );
 					if ( packet )
 					{
 						b->addr = packet->buf;
@@ -33,6 +33,10 @@
 
 // ----- Includes -----
 
+// Project Includes
+#include <Lib/time.h>
+#include <kll_defs.h>
+
 // Local Includes
 #include "usb_mem.h"
 #include "usb_desc.h"
@@ -51,6 +55,11 @@ extern volatile uint8_t usb_configuration;
 
 extern uint16_t usb_rx_byte_count_data[NUM_ENDPOINTS];
 
+#if USBSOFAligned_define == 1
+extern volatile Time usb_sof_time;
+extern volatile uint32_t usb_sof_count;
+#endif
+
 
 
 // ----- Functions -----
@@ -64,10 +73,13 @@ void usb_tx( uint32_t endpoint, usb_packet_t *packet );
 void usb_tx_isr( uint32_t endpoint, usb_packet_t *packet );
 
 uint8_t usb_resume();
+void usb_resume_poll();
+uint8_t usb_resume_pending();
 uint8_t usb_suspended();
 
 uint32_t usb_tx_byte_count( uint32_t endpoint );
 uint32_t usb_tx_packet_count( uint32_t endpoint );
+uint8_t usb_tx_idle( uint32_t endpoint );
 
 usb_packet_t *usb_rx( uint32_t endpoint );
 
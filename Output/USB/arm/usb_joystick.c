@@ -83,7 +83,7 @@ int usb_joystick_send()
 		}
 		if ( usb_tx_packet_count( JOYSTICK_ENDPOINT ) < TX_PACKET_LIMIT )
 		{
-			tx_packet = usb_malloc();
+			tx_packet = usb_malloc( JOYSTICK_ENDPOINT );
 			if ( tx_packet )
 			{
 				break;
@@ -39,6 +39,7 @@
 
 // Project Includes
 #include <Lib/OutputLib.h>
+#include <latency.h>
 #include <print.h>
 
 // Local Includes
@@ -55,16 +56,333 @@
 // When the PC isn't listening, how long do we wait before discarding data?
 #define TX_TIMEOUT_MS 50
 
+// How long reports are held for replay while waiting on the host to resume
+#define RESUME_TIMEOUT_MS 1000
+
+// Largest report (NKRO: ID + modifiers + 27 bytes of key bitfield)
+#define USB_ReportMaxLen 29
+
+
+
+// ----- Structs -----
+
+// Snapshot of a single HID report, waiting for its endpoint
+typedef struct USBReport {
+	uint8_t len;
+	uint8_t buf[USB_ReportMaxLen];
+} USBReport;
+
+// Ordered report queue for a single endpoint
+typedef struct USBReportQueue {
+	uint8_t endpoint;
+	uint8_t head;
+	uint8_t count;
+	uint8_t high_water;
+	uint32_t queued;    // Reports queued
+	uint32_t dropped;   // Reports discarded or coalesced because the queue was full or the host timed out
+	Time progress;      // Last time a report was handed to the endpoint
+	USBReport reports[USBReportQueueDepth_define];
+} USBReportQueue;
+
 
 
 // ----- Variables -----
 
-static uint8_t transmit_previous_timeout = 0;
+static volatile uint8_t transmit_previous_timeout = 0;
+
+// Set while the main loop is draining, so the ISR doesn't reorder reports
+static volatile uint8_t usb_report_draining = 0;
+
+// Last NKRO report handed to the queue, identical reports are not sent again
+static uint8_t usb_nkro_last[USB_ReportMaxLen];
+static uint8_t usb_nkro_last_valid = 0;
+static uint32_t usb_nkro_skipped = 0;
+
+// Report to host latency, measured for reports queued on an idle keyboard endpoint
+static uint8_t usb_report_latency_resource;
+static volatile uint8_t usb_report_latency_endpoint = 0;
+
+// Set while reports are held for the host to resume, they are replayed in order once it's back
+static uint8_t usb_report_held = 0;
+
+// Remote wakeup to first keyboard report read by the host
+static uint8_t usb_wake_latency_resource;
+static volatile uint8_t usb_wake_latency_pending = 0;
+
+USBReportQueue usb_report_queues[USBReportQueue_Count] = {
+	{ .endpoint = KEYBOARD_ENDPOINT },      // USBReportQueue_Boot
+	{ .endpoint = NKRO_KEYBOARD_ENDPOINT }, // USBReportQueue_NKRO
+	{ .endpoint = SYS_CTRL_ENDPOINT },      // USBReportQueue_SysCtrl
+};
 
 
 
 // ----- Functions -----
 
+static void usb_keyboard_build( USBKeys *buffer, uint8_t protocol, uint8_t force );
+
+// Move as many queued reports as possible to the endpoint
+// Never waits, whatever doesn't fit is sent on the next endpoint completion
+static void usb_report_drain( USBReportQueue *queue )
+{
+	while ( queue->count > 0 && usb_tx_packet_count( queue->endpoint ) < TX_PACKET_LIMIT )
+	{
+		usb_packet_t *tx_packet = usb_malloc( queue->endpoint );
+		if ( !tx_packet )
+			return;
+
+		// Pop the oldest report
+		__disable_irq();
+		if ( queue->count == 0 )
+		{
+			__enable_irq();
+			usb_free( tx_packet );
+			return;
+		}
+		USBReport *report = &queue->reports[ queue->head ];
+		memcpy( tx_packet->buf, report->buf, report->len );
+		tx_packet->len = report->len;
+		queue->head = ( queue->head + 1 ) % USBReportQueueDepth_define;
+		queue->count--;
+		__enable_irq();
+
+		usb_tx( queue->endpoint, tx_packet );
+		queue->progress = Time_now();
+		transmit_previous_timeout = 0;
+	}
+}
+
+// Snapshot a report into the endpoint queue
+// If the queue is full, the newest queued report with the same ID is replaced, as HID reports carry full state
+static void usb_report_push( USBReportQueue *queue, const uint8_t *buf, uint8_t len, uint8_t has_id )
+{
+	// Time the report until the host reads it, if nothing else is ahead of it
+	if ( queue->endpoint != SYS_CTRL_ENDPOINT
+		&& queue->count == 0
+		&& !usb_report_latency_endpoint
+		&& usb_tx_idle( queue->endpoint ) )
+	{
+		Latency_start_time( usb_report_latency_resource );
+		usb_report_latency_endpoint = queue->endpoint;
+	}
+
+	__disable_irq();
+	USBReport *report = 0;
+
+	if ( queue->count < USBReportQueueDepth_define )
+	{
+		if ( queue->count == 0 )
+		{
+			queue->progress = Time_now();
+		}
+		report = &queue->reports[ ( queue->head + queue->count ) % USBReportQueueDepth_define ];
+		queue->count++;
+		queue->queued++;
+		if ( queue->count > queue->high_water )
+		{
+			queue->high_water = queue->count;
+		}
+	}
+	else
+	{
+		queue->dropped++;
+		for ( uint8_t pos = queue->count; pos > 0; pos-- )
+		{
+			USBReport *cur = &queue->reports[ ( queue->head + pos - 1 ) % USBReportQueueDepth_define ];
+			if ( !has_id || cur->buf[0] == buf[0] )
+			{
+				report = cur;
+				break;
+			}
+		}
+	}
+
+	if ( report )
+	{
+		memcpy( report->buf, buf, len );
+		report->len = len;
+	}
+	__enable_irq();
+
+	// Hold the report if the host is asleep, it's replayed once the host resumes
+	if ( usb_resume_pending() )
+	{
+		usb_report_held = 1;
+		return;
+	}
+
+	// Start sending right away if the endpoint is idle
+	// Completion ISRs don't drain meanwhile, otherwise they could send the next report before this one
+	// If this push interrupted a drain, the report is sent by the next drain instead
+	if ( usb_report_draining )
+		return;
+	usb_report_draining = 1;
+	usb_report_drain( queue );
+	usb_report_draining = 0;
+}
+
+// Called from the USB ISR when an IN transfer completes on an endpoint
+void usb_keyboard_tx_complete( uint32_t endpoint )
+{
+	if ( usb_report_latency_endpoint == endpoint )
+	{
+		Latency_end_time( usb_report_latency_resource );
+		usb_report_latency_endpoint = 0;
+	}
+
+	if ( usb_wake_latency_pending && ( endpoint == KEYBOARD_ENDPOINT || endpoint == NKRO_KEYBOARD_ENDPOINT ) )
+	{
+		Latency_end_time( usb_wake_latency_resource );
+		usb_wake_latency_pending = 0;
+	}
+
+	if ( usb_report_draining )
+		return;
+
+	for ( uint8_t pos = 0; pos < USBReportQueue_Count; pos++ )
+	{
+		if ( usb_report_queues[ pos ].endpoint == endpoint )
+		{
+			usb_report_drain( &usb_report_queues[ pos ] );
+			return;
+		}
+	}
+}
+
+// Allocate report queue resources
+void usb_keyboard_init()
+{
+	usb_report_latency_resource = Latency_add_resource("USBReportTx", LatencyOption_us);
+	usb_wake_latency_resource = Latency_add_resource("USBWake", LatencyOption_ms);
+}
+
+// Start waking the host, if it's suspended
+// Called as soon as a key is pressed, so the resume overlaps with the rest of key processing
+void usb_keyboard_wake()
+{
+	if ( usb_resume() && !usb_wake_latency_pending )
+	{
+		Latency_start_time( usb_wake_latency_resource );
+		usb_wake_latency_pending = 1;
+	}
+}
+
+// Replay the reports held while the host was suspended
+static void usb_report_replay()
+{
+	uint8_t keyboard_reports = 0;
+
+	for ( uint8_t pos = 0; pos < USBReportQueue_Count; pos++ )
+	{
+		USBReportQueue *queue = &usb_report_queues[ pos ];
+
+		// Restart the transmit timeout from the resume
+		queue->progress = Time_now();
+		if ( pos != USBReportQueue_SysCtrl )
+		{
+			keyboard_reports += queue->count;
+		}
+	}
+
+	// Nothing for the host to read, don't count the next unrelated report as the wakeup
+	if ( !keyboard_reports )
+	{
+		usb_wake_latency_pending = 0;
+	}
+
+	usb_report_held = 0;
+}
+
+// Drain all keyboard report queues, and drop queued reports if the host stopped listening
+void usb_keyboard_flush()
+{
+	// Advance remote wakeup signalling
+	usb_resume_poll();
+
+	// Host is back, send everything that was pressed while it was waking up
+	uint8_t pending = usb_resume_pending();
+	if ( usb_report_held && !pending )
+	{
+		usb_report_replay();
+	}
+
+	for ( uint8_t pos = 0; pos < USBReportQueue_Count; pos++ )
+	{
+		USBReportQueue *queue = &usb_report_queues[ pos ];
+
+		if ( !pending )
+		{
+			usb_report_draining = 1;
+			usb_report_drain( queue );
+			usb_report_draining = 0;
+		}
+
+		// USB Timeout, drop the queued reports, and potentially try something more drastic to re-enable the bus
+		// Held reports get longer, the host has to finish resuming first
+		if ( queue->count > 0 && Time_duration_ms( queue->progress ) > ( pending ? RESUME_TIMEOUT_MS : TX_TIMEOUT_MS ) )
+		{
+			__disable_irq();
+			queue->dropped += queue->count;
+			queue->count = 0;
+			if ( usb_report_latency_endpoint == queue->endpoint )
+			{
+				usb_report_latency_endpoint = 0;
+			}
+			__enable_irq();
+
+			// The host may not have the last report, send the next one regardless
+			usb_nkro_last_valid = 0;
+
+			// The host never resumed, nothing wrong with the bus
+			if ( pending )
+			{
+				usb_wake_latency_pending = 0;
+				continue;
+			}
+
+			if ( !transmit_previous_timeout )
+			{
+				transmit_previous_timeout = 1;
+				#if enableDeviceRestartOnUSBTimeout_define == 1
+				warn_print("USB Transmit Timeout...restarting device");
+				usb_device_software_reset();
+				#else
+				warn_print("USB Transmit Timeout...auto-restart disabled");
+				#endif
+			}
+		}
+	}
+}
+
+// Show report queue statistics
+void usb_keyboard_queue_stats()
+{
+	const char *names[] = { "Boot", "NKRO", "SysCtrl" };
+
+	for ( uint8_t pos = 0; pos < USBReportQueue_Count; pos++ )
+	{
+		USBReportQueue *queue = &usb_report_queues[ pos ];
+
+		print( NL );
+		info_msg("");
+		_print( names[ pos ] );
+		print(" Depth: ");
+		printInt8( queue->count );
+		print("/");
+		printInt8( USBReportQueueDepth_define );
+		print(" High: ");
+		printInt8( queue->high_water );
+		print(" Queued: ");
+		printInt32( queue->queued );
+		print(" Dropped: ");
+		printInt32( queue->dropped );
+	}
+
+	print( NL );
+	info_msg("NKRO Unchanged (skipped): ");
+	printInt32( usb_nkro_skipped );
+}
+
 // Re-send the contents of the keyboard buffer, if exceeding the expiry timer
 void usb_keyboard_idle_update()
 {
@@ -77,11 +395,8 @@ void usb_keyboard_idle_update()
 		{
 			USBKeys_idle.changed = USBKeyChangeState_All;
 
-			// Send packets for each of the keyboard interfaces
-			while ( USBKeys_idle.changed )
-			{
-				usb_keyboard_send( (USBKeys*)&USBKeys_idle, USBKeys_Protocol );
-			}
+			// Send packets for each of the keyboard interfaces, even if unchanged
+			usb_keyboard_build( (USBKeys*)&USBKeys_idle, USBKeys_Protocol, 1 );
 		}
 	}
 }
@@ -101,85 +416,27 @@ void usb_keyboard_clear( uint8_t protocol )
 	};
 
 	// Send updates
-	usb_keyboard_send( &buffer, protocol );
+	usb_keyboard_build( &buffer, protocol, 1 );
 }
 
 
-// Send the contents of keyboard_keys and keyboard_modifier_keys
-void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
+// Build every pending report (system control, consumer control and keyboard) in a single pass
+// Each report goes to the queue of its own endpoint, so they are sent in parallel
+// Unless forced, an NKRO report identical to the last one sent is skipped
+static void usb_keyboard_build( USBKeys *buffer, uint8_t protocol, uint8_t force )
 {
-	Time start = Time_now();
-	usb_packet_t *tx_packet;
+	uint8_t report[USB_ReportMaxLen];
 
-	// Wait till ready
-	while ( 1 )
+	if ( !usb_configuration )
 	{
-		if ( !usb_configuration )
-		{
-			erro_print("USB not configured...");
-			return;
-		}
-
-		// Try to wake up the host if it's asleep
-		if ( usb_resume() )
-		{
-			// Drop packet
-			buffer->changed = USBKeyChangeState_None;
-			return;
-		}
-
-		if ( protocol == 0 ) // Boot Mode
-		{
-			if ( usb_tx_packet_count( KEYBOARD_ENDPOINT ) < TX_PACKET_LIMIT )
-			{
-				tx_packet = usb_malloc();
-				if ( tx_packet )
-					break;
-			}
-		}
-		else if ( protocol == 1 ) // NKRO Mode
-		{
-			if ( usb_tx_packet_count( NKRO_KEYBOARD_ENDPOINT ) < TX_PACKET_LIMIT )
-			{
-				tx_packet = usb_malloc();
-				if ( tx_packet )
-					break;
-			}
-		}
-		else if ( buffer->changed &
-			( USBKeyChangeState_System | USBKeyChangeState_Consumer )
-		)
-		{
-			if ( usb_tx_packet_count( SYS_CTRL_ENDPOINT ) < TX_PACKET_LIMIT )
-			{
-				tx_packet = usb_malloc();
-				if ( tx_packet )
-					break;
-			}
-		}
-
-		// USB Timeout, drop the packet, and potentially try something more drastic to re-enable the bus
-		if ( Time_duration_ms( start ) > TX_TIMEOUT_MS || transmit_previous_timeout )
-		{
-			transmit_previous_timeout = 1;
-			buffer->changed = USBKeyChangeState_None; // Indicate packet lost
-			#if enableDeviceRestartOnUSBTimeout == 1
-			warn_print("USB Transmit Timeout...restarting device");
-			usb_device_software_reset();
-			#else
-			warn_print("USB Transmit Timeout...auto-restart disabled");
-			#endif
-			// Try to wakeup
-			return;
-		}
-
-		yield();
+		erro_print("USB not configured...");
+		buffer->changed = USBKeyChangeState_None;
+		return;
 	}
 
-	transmit_previous_timeout = 0;
-
-	// Pointer to USB tx packet buffer
-	uint8_t *tx_buf = tx_packet->buf;
+	// Try to wake up the host if it's asleep
+	// The reports are still queued, and held until the host has resumed
+	usb_keyboard_wake();
 
 	// Check system control keys
 	if ( buffer->changed & USBKeyChangeState_System )
@@ -192,14 +449,11 @@ void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
 		// Store update for idle packet
 		USBKeys_idle.sys_ctrl = buffer->sys_ctrl;
 
-		*tx_buf++ = 0x02; // ID
-		*tx_buf   = buffer->sys_ctrl;
-		tx_packet->len = 2;
+		report[0] = 0x02; // ID
+		report[1] = buffer->sys_ctrl;
 
-		// Send USB Packet
-		usb_tx( SYS_CTRL_ENDPOINT, tx_packet );
-		buffer->changed &= ~USBKeyChangeState_System; // Mark sent
-		return;
+		// Queue USB Packet
+		usb_report_push( &usb_report_queues[ USBReportQueue_SysCtrl ], report, 2, 1 );
 	}
 
 	// Check consumer control keys
@@ -213,14 +467,18 @@ void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
 		// Store update for idle packet
 		USBKeys_idle.cons_ctrl = buffer->cons_ctrl;
 
-		*tx_buf++ = 0x03; // ID
-		*tx_buf++ = (uint8_t)(buffer->cons_ctrl & 0x00FF);
-		*tx_buf   = (uint8_t)(buffer->cons_ctrl >> 8);
-		tx_packet->len = 3;
+		report[0] = 0x03; // ID
+		report[1] = (uint8_t)(buffer->cons_ctrl & 0x00FF);
+		report[2] = (uint8_t)(buffer->cons_ctrl >> 8);
+
+		// Queue USB Packet
+		usb_report_push( &usb_report_queues[ USBReportQueue_SysCtrl ], report, 3, 1 );
+	}
 
-		// Send USB Packet
-		usb_tx( SYS_CTRL_ENDPOINT, tx_packet );
-		buffer->changed &= ~USBKeyChangeState_Consumer; // Mark sent
+	// Keyboard reports
+	if ( !( buffer->changed & ( USBKeyChangeState_Modifiers | USBKeyChangeState_Keys ) ) )
+	{
+		buffer->changed = USBKeyChangeState_None;
 		return;
 	}
 
@@ -239,65 +497,64 @@ void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
 		USBKeys_idle.modifiers = buffer->modifiers;
 
 		// Boot Mode
-		*tx_buf++ = buffer->modifiers;
-		*tx_buf++ = 0;
-		memcpy( tx_buf, buffer->keys, USB_BOOT_MAX_KEYS );
-		tx_packet->len = 8;
+		report[0] = buffer->modifiers;
+		report[1] = 0;
+		memcpy( &report[2], buffer->keys, USB_BOOT_MAX_KEYS );
 
-		// Send USB Packet
-		usb_tx( KEYBOARD_ENDPOINT, tx_packet );
-		buffer->changed = USBKeyChangeState_None;
+		// Queue USB Packet
+		usb_report_push( &usb_report_queues[ USBReportQueue_Boot ], report, 8, 0 );
+
+		// NKRO is re-sent in full after switching back
+		usb_nkro_last_valid = 0;
 		break;
 
 	// Send NKRO keyboard interrupts packet(s)
 	case 1:
-		if ( Output_DebugMode )
-		{
-			dbug_msg("NKRO USB: ");
-		}
+		// Modifiers
+		report[0] = 0x01; // ID
+		report[1] = buffer->modifiers;
 
-		// Standard HID Keyboard
-		if ( buffer->changed )
-		{
-			// USB NKRO Debug output
-			if ( Output_DebugMode )
-			{
-				USB_NKRODebug( buffer );
-			}
+		// 4-164 (first 21 bytes)
+		// 0-3 and 165-168 are masked by the descriptor (padding)
+		memcpy( &report[2], buffer->keys, 21 );
 
-			// Store update for idle packet
-			memcpy( (void*)&USBKeys_idle.keys, buffer->keys, USB_NKRO_BITFIELD_SIZE_KEYS );
-			USBKeys_idle.modifiers = buffer->modifiers;
+		// 176-221 (last 6 bytes)
+		// 222-223 are masked by the descriptor (padding)
+		memcpy( &report[23], buffer->keys + 22, 6 );
 
-			// Clear packet length
-			tx_packet->len = 0;
-
-			// Modifiers
-			*tx_buf++ = 0x01; // ID
-			*tx_buf++ = buffer->modifiers;
-			tx_packet->len += 2;
-
-			// 4-164 (first 21 bytes)
-			// 0-3 and 165-168 are masked by the descriptor (padding)
-			memcpy( tx_buf, buffer->keys, 21 );
-			tx_buf += 21;
-			tx_packet->len += 21;
-
-			// 176-221 (last 6 bytes)
-			// 222-223 are masked by the descriptor (padding)
-			memcpy( tx_buf, buffer->keys + 22, 6 );
-			tx_packet->len += 6;
+		// Skip if the host already has this exact report
+		if ( !force && usb_nkro_last_valid && memcmp( report, usb_nkro_last, USB_ReportMaxLen ) == 0 )
+		{
+			usb_nkro_skipped++;
+			break;
+		}
 
-			// Send USB Packet
-			usb_tx( NKRO_KEYBOARD_ENDPOINT, tx_packet );
-			buffer->changed = USBKeyChangeState_None; // Mark sent
+		// USB NKRO Debug output
+		if ( Output_DebugMode )
+		{
+			dbug_msg("NKRO USB: ");
+			USB_NKRODebug( buffer );
 		}
 
+		// Store update for idle packet
+		memcpy( (void*)&USBKeys_idle.keys, buffer->keys, USB_NKRO_BITFIELD_SIZE_KEYS );
+		USBKeys_idle.modifiers = buffer->modifiers;
+
+		// Queue USB Packet
+		usb_report_push( &usb_report_queues[ USBReportQueue_NKRO ], report, USB_ReportMaxLen, 1 );
+		memcpy( usb_nkro_last, report, USB_ReportMaxLen );
+		usb_nkro_last_valid = 1;
 		break;
 	}
 
-	return;
+	buffer->changed = USBKeyChangeState_None; // Mark sent
 }
 
-#endif
+// Queue the contents of keyboard_keys and keyboard_modifier_keys
+// Returns immediately, the reports are sent by the USB ISR as the endpoints become available
+void usb_keyboard_send( USBKeys *buffer, uint8_t protocol )
+{
+	usb_keyboard_build( buffer, protocol, 0 );
+}
 
+#endif
@@ -41,9 +41,26 @@
 
 
 
+// ----- Enums -----
+
+// Report queues, one per keyboard endpoint
+typedef enum USBReportQueueId {
+	USBReportQueue_Boot,
+	USBReportQueue_NKRO,
+	USBReportQueue_SysCtrl,
+	USBReportQueue_Count,
+} USBReportQueueId;
+
+
+
 // ----- Functions -----
 
+void usb_keyboard_init();
+void usb_keyboard_wake();
 void usb_keyboard_idle_update();
 void usb_keyboard_send( USBKeys *buffer, uint8_t protocol );
 void usb_keyboard_clear( uint8_t protocol );
+void usb_keyboard_flush();
+void usb_keyboard_queue_stats();
+void usb_keyboard_tx_complete( uint32_t endpoint );
 
@@ -33,6 +33,10 @@
 
 // Project Includes
 #include <Lib/OutputLib.h>
+#include <print.h>
+
+// KLL
+#include <kll_defs.h>
 
 // Local Includes
 #include "usb_dev.h"
@@ -40,12 +44,47 @@
 
 
 
+// ----- Defines -----
+
+#if defined(_kinetis_)
+#if USBPoolReserveKeyboard_define + USBPoolReserveRawIO_define >= NUM_USB_BUFFERS
+#error "usbPoolReserveKeyboard + usbPoolReserveRawIO must leave room in the USB packet pool"
+#endif
+#endif
+
+
+
+// ----- Structs -----
+
+// Per-endpoint allocation statistics
+typedef struct USBPoolStats {
+	uint8_t  in_use;
+	uint8_t  high_water;
+	uint16_t failed;
+} USBPoolStats;
+
+
+
 // ----- Variables -----
 
 #if defined(_kinetis_)
 __attribute__ ((section(".usbbuffers"), used))
 unsigned char usb_buffer_memory[ NUM_USB_BUFFERS * sizeof(usb_packet_t) ];
 static uint32_t usb_buffer_available = 0xFFFFFFFF;
+static uint8_t usb_buffer_free = NUM_USB_BUFFERS;
+
+// Endpoint each packet is currently accounted to
+static uint8_t usb_buffer_owner[ NUM_USB_BUFFERS ];
+
+// Minimum number of packets held back for each class, lowest priority class does not need a reservation
+static const uint8_t usb_pool_reserve[ USBPoolClass_Count ] = {
+	USBPoolReserveKeyboard_define,
+	USBPoolReserveRawIO_define,
+	0,
+};
+
+static uint8_t usb_pool_in_use[ USBPoolClass_Count ];
+static USBPoolStats usb_pool_ep_stats[ NUM_ENDPOINTS + 1 ];
 
 #elif defined(_sam_)
 static usb_packet_t usb_packet;
@@ -55,7 +94,7 @@ static usb_packet_t usb_packet;
 
 // ----- Externs -----
 
-extern void usb_rx_memory( usb_packet_t *packet );
+extern uint8_t usb_rx_memory( usb_packet_t *packet );
 
 // for the receive endpoints to request memory
 extern uint8_t usb_rx_memory_needed;
@@ -64,12 +103,75 @@ extern uint8_t usb_rx_memory_needed;
 
 // ----- Functions -----
 
+#if defined(_kinetis_)
+// Class an endpoint allocates from
+static USBPoolClass usb_pool_class( uint8_t endpoint )
+{
+	switch ( endpoint )
+	{
+	case RAWIO_TX_ENDPOINT:
+	case RAWIO_RX_ENDPOINT:
+		return USBPoolClass_RawIO;
+
+	case CDC_ACM_ENDPOINT:
+	case CDC_RX_ENDPOINT:
+	case CDC_TX_ENDPOINT:
+		return USBPoolClass_Serial;
+
+	default:
+		return USBPoolClass_Keyboard;
+	}
+}
+
+// Check whether the class may take a packet, given the number of free packets
+// Must be called with interrupts disabled
+static uint8_t usb_pool_admit( USBPoolClass class, uint8_t free )
+{
+	uint8_t held = 0;
+	for ( uint8_t pos = 0; pos < class; pos++ )
+	{
+		if ( usb_pool_in_use[ pos ] < usb_pool_reserve[ pos ] )
+		{
+			held += usb_pool_reserve[ pos ] - usb_pool_in_use[ pos ];
+		}
+	}
+
+	return free > held;
+}
+
+// Account packet n to endpoint
+// Must be called with interrupts disabled
+static void usb_pool_take( unsigned int n, uint8_t endpoint )
+{
+	USBPoolStats *stats = &usb_pool_ep_stats[ endpoint ];
+
+	usb_buffer_owner[ n ] = endpoint;
+	usb_pool_in_use[ usb_pool_class( endpoint ) ]++;
+	if ( ++stats->in_use > stats->high_water )
+	{
+		stats->high_water = stats->in_use;
+	}
+}
+
+// Remove packet n from its endpoint's accounting
+// Must be called with interrupts disabled
+static void usb_pool_release( unsigned int n )
+{
+	uint8_t endpoint = usb_buffer_owner[ n ];
+
+	usb_pool_in_use[ usb_pool_class( endpoint ) ]--;
+	usb_pool_ep_stats[ endpoint ].in_use--;
+}
+#endif
+
 // use bitmask and CLZ instruction to implement fast free list
 // http://www.archivum.info/gnu.gcc.help/2006-08/00148/Re-GCC-Inline-Assembly.html
 // http://gcc.gnu.org/ml/gcc/2012-06/msg00015.html
 // __builtin_clz()
 
-usb_packet_t *usb_malloc()
+// Allocate a packet for the given endpoint
+// Returns NULL if the pool is empty, or if the remaining packets are reserved for a higher priority class
+usb_packet_t *usb_malloc( uint8_t endpoint )
 {
 #if defined(_kinetis_)
 	unsigned int n, avail;
@@ -78,13 +180,16 @@ usb_packet_t *usb_malloc()
 	__disable_irq();
 	avail = usb_buffer_available;
 	n = __builtin_clz( avail ); // clz = count leading zeros
-	if ( n >= NUM_USB_BUFFERS )
+	if ( n >= NUM_USB_BUFFERS || !usb_pool_admit( usb_pool_class( endpoint ), usb_buffer_free ) )
 	{
+		usb_pool_ep_stats[ endpoint ].failed++;
 		__enable_irq();
 		return NULL;
 	}
 
 	usb_buffer_available = avail & ~(0x80000000 >> n);
+	usb_buffer_free--;
+	usb_pool_take( n, endpoint );
 	__enable_irq();
 	p = usb_buffer_memory + ( n * sizeof(usb_packet_t) );
 	*(uint32_t *)p = 0;
@@ -97,6 +202,27 @@ usb_packet_t *usb_malloc()
 }
 
 
+// Hand an already allocated packet (being freed) over to a receive endpoint
+// Returns 1 if the endpoint's class may take it
+// Must be called with interrupts disabled
+uint8_t usb_pool_claim( usb_packet_t *p, uint8_t endpoint )
+{
+#if defined(_kinetis_)
+	unsigned int n = ( (uint8_t *)p - usb_buffer_memory ) / sizeof(usb_packet_t);
+
+	// The packet being handed over counts as free
+	if ( !usb_pool_admit( usb_pool_class( endpoint ), usb_buffer_free + 1 ) )
+	{
+		usb_pool_ep_stats[ endpoint ].failed++;
+		return 0;
+	}
+
+	usb_pool_take( n, endpoint );
+#endif
+	return 1;
+}
+
+
 void usb_free( usb_packet_t *p )
 {
 #if defined(_kinetis_)
@@ -106,18 +232,68 @@ void usb_free( usb_packet_t *p )
 	if ( n >= NUM_USB_BUFFERS )
 		return;
 
+	__disable_irq();
+	usb_pool_release( n );
+	__enable_irq();
+
 	// if any endpoints are starving for memory to receive
 	// packets, give this memory to them immediately!
-	if ( usb_rx_memory_needed && usb_configuration )
+	if ( usb_rx_memory_needed && usb_configuration && usb_rx_memory( p ) )
 	{
-		usb_rx_memory( p );
 		return;
 	}
 
 	mask = (0x80000000 >> n);
 	__disable_irq();
 	usb_buffer_available |= mask;
+	usb_buffer_free++;
 	__enable_irq();
 #endif
 }
 
+
+// Display pool occupancy and per-endpoint allocation statistics
+void usb_pool_stats()
+{
+#if defined(_kinetis_)
+	const char *names[] = { "Keyboard", "RawIO", "Serial" };
+
+	print( NL );
+	info_msg("Free: ");
+	printInt8( usb_buffer_free );
+	print("/");
+	printInt8( NUM_USB_BUFFERS );
+
+	for ( uint8_t pos = 0; pos < USBPoolClass_Count; pos++ )
+	{
+		print( NL );
+		info_msg("");
+		_print( names[ pos ] );
+		print(" In Use: ");
+		printInt8( usb_pool_in_use[ pos ] );
+		print(" Reserved: ");
+		printInt8( usb_pool_reserve[ pos ] );
+	}
+
+	for ( uint8_t ep = 0; ep <= NUM_ENDPOINTS; ep++ )
+	{
+		USBPoolStats *stats = &usb_pool_ep_stats[ ep ];
+
+		// Skip endpoints that have never allocated
+		if ( stats->high_water == 0 && stats->failed == 0 )
+		{
+			continue;
+		}
+
+		print( NL );
+		info_msg("EP ");
+		printInt8( ep );
+		print(" In Use: ");
+		printInt8( stats->in_use );
+		print(" High: ");
+		printInt8( stats->high_water );
+		print(" Failed: ");
+		printInt16( stats->failed );
+	}
+#endif
+}
@@ -38,6 +38,19 @@
 
 
 
+// ----- Enums -----
+
+// Packet pool classes, in allocation priority order
+// A class may only allocate while enough packets remain for the unmet reservations of higher priority classes
+typedef enum USBPoolClass {
+	USBPoolClass_Keyboard, // Keyboard, NKRO, SysCtrl, Mouse and Joystick endpoints
+	USBPoolClass_RawIO,    // HID-IO
+	USBPoolClass_Serial,   // CDC (virtual serial port)
+	USBPoolClass_Count,
+} USBPoolClass;
+
+
+
 // ----- Structs -----
 
 typedef struct usb_packet_struct {
@@ -51,6 +64,9 @@ typedef struct usb_packet_struct {
 
 // ----- Functions -----
 
-usb_packet_t *usb_malloc();
+usb_packet_t *usb_malloc( uint8_t endpoint );
 void usb_free( usb_packet_t *p );
 
+uint8_t usb_pool_claim( usb_packet_t *p, uint8_t endpoint );
+void usb_pool_stats();
+
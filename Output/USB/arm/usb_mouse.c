@@ -61,39 +61,57 @@
 
 static uint8_t transmit_previous_timeout = 0;
 
+// Time the pending mouse update first had to wait on the endpoint
+static Time transmit_wait_start;
+static uint8_t transmit_waiting = 0;
+
 
 
 // ----- Functions -----
 
 // Process pending mouse commands
+// Does not wait on the endpoint. If it is busy, the update stays pending (relative movement keeps accumulating)
+// and is sent on a following call.
 // XXX Proper support will require KLL generation of the USB descriptors
 //     Similar support will be required for joystick control
 void usb_mouse_send()
 {
-	Time start = Time_now();
-	usb_packet_t *tx_packet;
+	usb_packet_t *tx_packet = 0;
 
-	// Wait till ready
-	while ( 1 )
+	// Nothing is listening yet, drop the update rather than retrying (and logging) every period
+	if ( !usb_configuration )
 	{
-		if ( !usb_configuration )
-		{
-			erro_print("USB not configured...");
-			return;
-		}
+		USBMouse_Buttons = 0;
+		USBMouse_Relative_x = 0;
+		USBMouse_Relative_y = 0;
+		USBMouse_VertWheel = 0;
+		USBMouse_HoriWheel = 0;
+		USBMouse_Changed = 0;
+		return;
+	}
 
-		// Attempt to acquire a USB packet for the mouse endpoint
-		if ( usb_tx_packet_count( MOUSE_ENDPOINT ) < TX_PACKET_LIMIT )
+	// Attempt to acquire a USB packet for the mouse endpoint
+	if ( usb_tx_packet_count( MOUSE_ENDPOINT ) < TX_PACKET_LIMIT )
+	{
+		tx_packet = usb_malloc( MOUSE_ENDPOINT );
+	}
+
+	if ( !tx_packet )
+	{
+		if ( !transmit_waiting )
 		{
-			tx_packet = usb_malloc();
-			if ( tx_packet )
-				break;
+			transmit_waiting = 1;
+			transmit_wait_start = Time_now();
 		}
 
-		if ( Time_duration_ms( start ) > TX_TIMEOUT_MS || transmit_previous_timeout )
+		if ( Time_duration_ms( transmit_wait_start ) > TX_TIMEOUT_MS || transmit_previous_timeout )
 		{
+			if ( !transmit_previous_timeout )
+			{
+				warn_print("USB Transmit Timeout...");
+			}
 			transmit_previous_timeout = 1;
-			warn_print("USB Transmit Timeout...");
+			transmit_waiting = 0;
 
 			// Clear status and state
 			USBMouse_Buttons = 0;
@@ -102,12 +120,12 @@ void usb_mouse_send()
 			USBMouse_VertWheel = 0;
 			USBMouse_HoriWheel = 0;
 			USBMouse_Changed = 0;
-			return;
 		}
-		yield();
+		return;
 	}
 
 	transmit_previous_timeout = 0;
+	transmit_waiting = 0;
 
 	// Prepare USB Mouse Packet
 	// TODO (HaaTa): Dynamically generate this code based on KLL requirements
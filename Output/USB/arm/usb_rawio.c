@@ -44,6 +44,13 @@
 
 
 
+// ----- Variables -----
+
+// Packet currently lent out by usb_rawio_rx_peek
+static usb_packet_t *rx_peek_packet = 0;
+
+
+
 // ----- Functions -----
 
 // Check for packets available from host
@@ -54,7 +61,7 @@ uint32_t usb_rawio_available()
 		return 0;
 
 	// Query number of bytes available from the endpoint
-	return usb_rx_byte_count( RAWIO_RX_ENDPOINT );
+	return usb_rx_byte_count( RAWIO_RX_ENDPOINT ) + ( rx_peek_packet ? RAWIO_RX_SIZE : 0 );
 }
 
 // Retrieve packets from host
@@ -64,6 +71,14 @@ int32_t usb_rawio_rx( void *buf, uint32_t timeout )
 	usb_packet_t *rx_packet;
 	Time start = Time_now();
 
+	// Finish off a packet that was only peeked at
+	if ( rx_peek_packet )
+	{
+		memcpy( buf, rx_peek_packet->buf, RAWIO_RX_SIZE );
+		usb_rawio_rx_pop();
+		return RAWIO_RX_SIZE;
+	}
+
 	// Read
 	while ( 1 )
 	{
@@ -94,6 +109,35 @@ int32_t usb_rawio_rx( void *buf, uint32_t timeout )
 	return RAWIO_RX_SIZE;
 }
 
+// Retrieve packet from host, without copying
+// Returns a pointer to the USB packet buffer (RAWIO_RX_SIZE bytes), 0 if no packets are available
+// The same packet is returned until usb_rawio_rx_pop is called
+uint8_t *usb_rawio_rx_peek()
+{
+	// Error if USB isn't configured
+	if ( !usb_configuration )
+		return 0;
+
+	if ( !rx_peek_packet )
+	{
+		rx_peek_packet = usb_rx( RAWIO_RX_ENDPOINT );
+		if ( !rx_peek_packet )
+			return 0;
+	}
+
+	return rx_peek_packet->buf;
+}
+
+// Release packet returned by usb_rawio_rx_peek, the buffer is handed back to the USB stack
+void usb_rawio_rx_pop()
+{
+	if ( !rx_peek_packet )
+		return;
+
+	usb_free( rx_peek_packet );
+	rx_peek_packet = 0;
+}
+
 // Send packet to host
 // XXX Only transfers RAWIO_TX_SIZE on each call (likely 64 bytes)
 // Always returns RAWIO_TX_SIZE
@@ -112,7 +156,7 @@ int32_t usb_rawio_tx( const void *buf, uint32_t timeout )
 		if ( usb_tx_packet_count( RAWIO_TX_ENDPOINT ) < TX_PACKET_LIMIT )
 		{
 			// Allocate a packet buffer
-			tx_packet = usb_malloc();
+			tx_packet = usb_malloc( RAWIO_TX_ENDPOINT );
 			if ( tx_packet )
 				break;
 		}
@@ -234,7 +234,7 @@ int usb_serial_write( const void *buffer, uint32_t size )
 				if ( usb_tx_packet_count( CDC_TX_ENDPOINT ) < TX_PACKET_LIMIT )
 				{
 					tx_noautoflush = 1;
-					tx_packet = usb_malloc();
+					tx_packet = usb_malloc( CDC_TX_ENDPOINT );
 					if ( tx_packet )
 						break;
 					tx_noautoflush = 0;
@@ -282,7 +282,7 @@ void usb_serial_flush_output()
 	}
 	else
 	{
-		usb_packet_t *tx = usb_malloc();
+		usb_packet_t *tx = usb_malloc( CDC_TX_ENDPOINT );
 		if ( tx )
 		{
 			usb_cdc_transmit_flush_timer = 0;
@@ -306,7 +306,7 @@ void usb_serial_flush_callback()
 		usb_tx( CDC_TX_ENDPOINT, tx_packet );
 		tx_packet = NULL;
 	} else {
-		usb_packet_t *tx = usb_malloc();
+		usb_packet_t *tx = usb_malloc( CDC_TX_ENDPOINT );
 		if ( tx )
 		{
 			usb_tx( CDC_TX_ENDPOINT, tx );
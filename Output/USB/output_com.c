@@ -58,6 +58,9 @@ inline void Output_setup()
 inline void Output_poll()
 {
 	USB_poll();
+
+	// Send buffered debug output
+	Print_flush();
 }
 
 
@@ -124,6 +127,27 @@ int Output_rawio_getbuffer( char* buffer )
 }
 
 
+// USB RawIO peek buffer
+// Packet stays in the USB buffer until popped
+char* Output_rawio_peekbuffer()
+{
+#if enableRawIO_define == 1
+	return USB_rawio_peekbuffer();
+#else
+	return 0;
+#endif
+}
+
+
+// USB RawIO pop buffer
+void Output_rawio_popbuffer()
+{
+#if enableRawIO_define == 1
+	USB_rawio_popbuffer();
+#endif
+}
+
+
 // USB RawIO send buffer
 int Output_rawio_sendbuffer( char* buffer )
 {
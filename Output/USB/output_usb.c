@@ -51,6 +51,13 @@
 #include <output_com.h>
 
 
+// ----- Defines -----
+
+// Time between SOF tokens (full-speed)
+#define USB_FramePeriod_us 1000
+
+
+
 // ----- Macros -----
 
 // Used to build a bitmap lookup table from a byte addressable array
@@ -74,6 +81,8 @@ void cliFunc_readLEDs   ( char* args );
 void cliFunc_usbAddr    ( char* args );
 void cliFunc_usbConf    ( char* args );
 void cliFunc_usbInitTime( char* args );
+void cliFunc_usbPool    ( char* args );
+void cliFunc_usbQueue   ( char* args );
 
 
 
@@ -86,6 +95,8 @@ CLIDict_Entry( readLEDs,    "Read LED byte:" NL "\t\t1 NumLck, 2 CapsLck, 4 Scrl
 CLIDict_Entry( usbAddr,     "Shows the negotiated USB unique Id, given to device by host." );
 CLIDict_Entry( usbConf,     "Shows whether USB is configured or not." );
 CLIDict_Entry( usbInitTime, "Displays the time in ms from usb_init() till the last setup call." );
+CLIDict_Entry( usbPool,     "Shows USB packet pool occupancy, reservations and per-endpoint allocation failures." );
+CLIDict_Entry( usbQueue,    "Shows HID report queue depth, high water mark and dropped reports." );
 
 CLIDict_Def( usbCLIDict, "USB Module Commands" ) = {
 	CLIDict_Item( idle ),
@@ -94,6 +105,8 @@ CLIDict_Def( usbCLIDict, "USB Module Commands" ) = {
 	CLIDict_Item( usbAddr ),
 	CLIDict_Item( usbConf ),
 	CLIDict_Item( usbInitTime ),
+	CLIDict_Item( usbPool ),
+	CLIDict_Item( usbQueue ),
 	{ 0, 0, 0 } // Null entry for dictionary end
 };
 
@@ -147,9 +160,21 @@ volatile uint16_t USBInit_Ticks;
 // USB Address - Set by host, unique to the bus
 volatile uint8_t USBDev_Address;
 
+// USB Codes changed since the last queued keyboard report, one bit per code
+// Used to keep host-visible event order within a single output period
+static uint8_t USBKeys_eventMask[32];
+static uint8_t USBKeys_eventKeys; // Non-modifier code changed since the last queued report
+
 // Latency measurement resource
 static uint8_t outputPeriodicLatencyResource;
 static uint8_t outputPollLatencyResource;
+#if USBSOFAligned_define == 1 && !defined(_host_)
+static uint8_t outputSOFPhaseLatencyResource;
+
+// Frame (SOF count) output was first held in, output is never held past the end of it
+static uint8_t  USB_sofHolding;
+static uint32_t USB_sofHoldFrame;
+#endif
 
 
 
@@ -354,6 +379,64 @@ void Output_sysCtrlSend_capability( TriggerMacro *trigger, uint8_t state, uint8_
 }
 
 
+// Queue the current keyboard state as a report
+// Used by the periodic output, and whenever an event needs to be split off to keep event order
+void USB_queueKeys()
+{
+#if enableKeyboard_define == 1
+	// Boot Mode Only, unset stale keys
+	if ( USBKeys_Protocol == 0 )
+	{
+		for ( uint8_t c = USBKeys_Sent; c < USB_BOOT_MAX_KEYS; c++ )
+		{
+			USBKeys_primary.keys[c] = 0;
+		}
+	}
+
+	// Queue every pending report (keyboard, system and consumer control) in a single pass
+	if ( USBKeys_primary.changed )
+	{
+		usb_keyboard_send( (USBKeys*)&USBKeys_primary, USBKeys_Protocol );
+	}
+
+	memset( USBKeys_eventMask, 0, sizeof( USBKeys_eventMask ) );
+	USBKeys_eventKeys = 0;
+#endif
+}
+
+
+// Keep event order when several USB Codes change within the same output period
+// The pending state is queued as its own report before applying a change that would otherwise
+// collapse or reorder the pending changes:
+//  - The same code changing twice (e.g. press and release within one period)
+//  - A modifier changing after a normal key (the host would apply the modifier to the key)
+// With chord compression disabled, every change is sent as its own report.
+// Queued reports are sent one per USB frame.
+static void USB_orderEvent( uint8_t key )
+{
+	uint8_t modifier = (key & 0xE0) == 0xE0;
+	uint8_t conflict;
+
+#if USBChordCompression_define == 1
+	conflict = USBKeys_eventMask[ key >> 3 ] & (1 << (key & 0x07));
+	conflict |= modifier && USBKeys_eventKeys;
+#else
+	conflict = USBKeys_primary.changed & ( USBKeyChangeState_Modifiers | USBKeyChangeState_Keys );
+#endif
+
+	if ( conflict )
+	{
+		USB_queueKeys();
+	}
+
+	USBKeys_eventMask[ key >> 3 ] |= 1 << (key & 0x07);
+	if ( !modifier )
+	{
+		USBKeys_eventKeys = 1;
+	}
+}
+
+
 // Adds a single USB Code to the USB Output buffer
 // Argument #1: USB Code
 void Output_usbCodeSend_capability( TriggerMacro *trigger, uint8_t state, uint8_t stateType, uint8_t *args )
@@ -411,6 +494,9 @@ void Output_usbCodeSend_capability( TriggerMacro *trigger, uint8_t state, uint8_
 		print( NL );
 	}
 
+	// Split off pending changes if this event would collapse or reorder them
+	USB_orderEvent( key );
+
 	// Depending on which mode the keyboard is in, USBKeys_Keys array is used differently
 	// Boot mode - Maximum of 6 byte codes
 	// NKRO mode - Each bit of the 26 byte corresponds to a key
@@ -766,6 +852,14 @@ inline void USB_setup()
 	// Latency resource allocation
 	outputPeriodicLatencyResource = Latency_add_resource("USBOutputPeri", LatencyOption_Ticks);
 	outputPollLatencyResource = Latency_add_resource("USBOutputPoll", LatencyOption_Ticks);
+#if USBSOFAligned_define == 1 && !defined(_host_)
+	outputSOFPhaseLatencyResource = Latency_add_resource("USBSOFPhase", LatencyOption_us);
+#endif
+
+#if enableKeyboard_define == 1
+	// Setup HID report queues
+	usb_keyboard_init();
+#endif
 }
 
 
@@ -793,6 +887,16 @@ inline void USB_poll()
 }
 
 
+// Start waking the host as soon as a key is pressed
+// Called from the scan stage, the reports that follow are held until the host has resumed
+void USB_wake()
+{
+#if enableKeyboard_define == 1 && !defined(_avr_at_)
+	usb_keyboard_wake();
+#endif
+}
+
+
 // Gather USB HID LED states
 // Keeps track of previous state, and sends new state to PartialMap
 void USB_indicator_update()
@@ -879,15 +983,77 @@ void USB_suspend_status_update()
 }
 
 
+// Check whether output should be held until the end of the current USB frame
+// Reports are queued just before the next SOF, so the following IN token reads the newest state
+// Output is held for at most one frame, if the periodic call missed the window it is released right away
+// Returns 1 if output should wait
+static uint8_t USB_sofHold()
+{
+#if USBSOFAligned_define == 1 && !defined(_host_)
+	__disable_irq();
+	Time sof = usb_sof_time;
+	uint32_t frame = usb_sof_count;
+	__enable_irq();
+
+	// No SOF tokens yet (not enumerated), nothing to align to
+	if ( frame == 0 )
+	{
+		return 0;
+	}
+
+	// SOF tokens stopped (suspended), don't hold output indefinitely
+	uint32_t phase = Time_duration_us( sof );
+	if ( phase >= USB_FramePeriod_us )
+	{
+		USB_sofHolding = 0;
+		return 0;
+	}
+
+#if USBSOFLead_us_define < USB_FramePeriod_us
+	if ( phase < USB_FramePeriod_us - USBSOFLead_us_define )
+	{
+		// Hold until the end of the frame the hold started in
+		if ( !USB_sofHolding )
+		{
+			USB_sofHolding = 1;
+			USB_sofHoldFrame = frame;
+			return 1;
+		}
+		if ( frame == USB_sofHoldFrame )
+		{
+			return 1;
+		}
+
+		// A SOF passed while holding, the window was missed, don't wait another frame
+	}
+#endif
+	USB_sofHolding = 0;
+
+	// Measure where in the frame output is queued
+	if ( USBKeys_primary.changed || USBMouse_Changed )
+	{
+		Latency_start_time_at( outputSOFPhaseLatencyResource, sof );
+		Latency_end_time( outputSOFPhaseLatencyResource );
+	}
+#endif
+
+	return 0;
+}
+
+
 // USB Data Periodic
 inline void USB_periodic()
 {
 	// Start latency measurement
 	Latency_start_time( outputPeriodicLatencyResource );
 
+	// Hold new reports until the end of the USB frame, if aligned to SOF
+	uint8_t hold = USB_sofHold();
+
 #if enableMouse_define == 1
 	// Process mouse actions
-	while ( USBMouse_Changed )
+	// If the endpoint is busy, the update stays pending until the next period
+	if ( USBMouse_Changed && !hold )
 		usb_mouse_send();
 #endif
 
@@ -903,20 +1069,15 @@ inline void USB_periodic()
 		USBKeys_Protocol_Change = 0;
 	}
 
-	// Boot Mode Only, unset stale keys
-	if ( USBKeys_Protocol == 0 )
+	// Queue keypresses while there are pending changes
+	// The reports are sent from the USB ISR, this does not wait on the host
+	if ( !hold )
 	{
-		for ( uint8_t c = USBKeys_Sent; c < USB_BOOT_MAX_KEYS; c++ )
-		{
-			USBKeys_primary.keys[c] = 0;
-		}
+		USB_queueKeys();
 	}
 
-	// Send keypresses while there are pending changes
-	while ( USBKeys_primary.changed )
-	{
-		usb_keyboard_send( (USBKeys*)&USBKeys_primary, USBKeys_Protocol );
-	}
+	// Push out any reports still waiting on their endpoint
+	usb_keyboard_flush();
 
 	// Signal Scan Module we are finished
 	switch ( USBKeys_Protocol )
@@ -1090,6 +1251,27 @@ int USB_rawio_getbuffer( char* buffer )
 }
 
 
+// USB RawIO peek buffer
+// Points directly at the USB packet buffer, valid until USB_rawio_popbuffer
+char* USB_rawio_peekbuffer()
+{
+#if enableRawIO_define == 1
+	return (char*)usb_rawio_rx_peek();
+#else
+	return 0;
+#endif
+}
+
+
+// USB RawIO pop buffer
+void USB_rawio_popbuffer()
+{
+#if enableRawIO_define == 1
+	usb_rawio_rx_pop();
+#endif
+}
+
+
 // USB RawIO send buffer
 // XXX Must be a 64 byte buffer
 int USB_rawio_sendbuffer( char* buffer )
@@ -1200,3 +1382,23 @@ void cliFunc_usbInitTime( char* args )
 	print(" ticks");
 }
 
+
+void cliFunc_usbPool( char* args )
+{
+	print(NL);
+	info_msg("USB Packet Pool");
+#if defined(_kinetis_)
+	usb_pool_stats();
+#endif
+}
+
+
+void cliFunc_usbQueue( char* args )
+{
+	print(NL);
+	info_msg("HID Report Queues");
+#if !defined(_host_) && enableKeyboard_define == 1
+	usb_keyboard_queue_stats();
+#endif
+}
+
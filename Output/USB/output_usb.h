@@ -138,6 +138,8 @@ void USB_poll();
 void USB_periodic();
 
 void USB_flushBuffers();
+void USB_wake();
+void USB_queueKeys();
 
 void USB_firmwareReload(); // Request firmware reload
 void USB_softReset();      // Request soft reset
@@ -150,6 +152,8 @@ int USB_putstr( char* str );
 
 unsigned int USB_rawio_availablechar();
 int USB_rawio_getbuffer( char* buffer );
+char* USB_rawio_peekbuffer();
+void USB_rawio_popbuffer();
 int USB_rawio_sendbuffer( char* buffer );
 
 void USB_ConsCtrlDebug( USBKeys *buffer );
@@ -29,6 +29,7 @@
 // Project Includes
 #include <print.h>
 #include <kll_defs.h>
+#include <trace.h>
 
 // Local Includes
 #include "i2c.h"
@@ -50,9 +51,55 @@ Twi *twi_devs[] = {
 };
 #endif
 
+// Bus clock speed levels, fastest first
+// When a bus keeps erroring, the clock is stepped down a level at a time
+#if defined(_kinetis_)
+#if ISSI_Chip_31FL3731_define == 1 && defined(_kii_v1_)
+// 0x53 -> 48 MHz / (2 * 72) = 333.333 kBaud
+// 0x40 => mul(2)
+// 0x13 => ICR(30)
+const uint8_t i2c_speed_f[]   = { 0x53 };
+const uint8_t i2c_speed_flt[] = { 0x05 };
+#elif ISSI_Chip_31FL3731_define == 1 && defined(_kii_v2_)
+// 0x4E -> 36 MHz / (2 * 56) = 321.428 kBaud
+// 0x40 => mul(2)
+// 0x0E => ICR(56)
+const uint8_t i2c_speed_f[]   = { 0x4E };
+const uint8_t i2c_speed_flt[] = { 0x04 };
+#elif ISSI_Chip_31FL3732_define == 1 || ISSI_Chip_31FL3733_define == 1
+// 0x40 -> 36 MHz / (2 * 20) = 900 kBaud, 86 fps, no errors, using frame delay of 50 us
+// 0x0C -> 36 MHz / (1 * 44) = 818.181 kBaud, 80 fps, no errors (flicker?)
+// 0x84 -> 36 MHz / (4 * 28) = 321.428 kBaud
+const uint8_t i2c_speed_f[]   = { 0x40, 0x0C, 0x84 };
+const uint8_t i2c_speed_flt[] = { 0x02, 0x02, 0x02 }; // Glitch protection, reduce if you see bus errors
+#endif
+#define I2C_SpeedLevels ( sizeof( i2c_speed_f ) / sizeof( i2c_speed_f[0] ) )
+
+#elif defined(_sam_)
+#if ISSI_Chip_31FL3731_define == 1
+#define BAUD 400000
+#define CK 1
+#elif ISSI_Chip_31FL3732_define == 1 || ISSI_Chip_31FL3733_define == 1
+#define BAUD 800000
+#define CK 0
+#endif
+// BAUD, BAUD / 2, BAUD / 4
+#define I2C_SpeedLevels 3
+
+// CLDIV/CHDIV are 8 bits, CKDIV is raised at runtime (up to 7) for the slower levels
+// Make sure even the slowest level fits
+#if ( ( F_CPU / ( BAUD >> ( I2C_SpeedLevels - 1 ) ) - 4 ) / ( 2 << 7 ) ) > 255
+#error "Slowest I2C speed level does not fit in TWI_CWGR"
+#endif
+
+#else
+#define I2C_SpeedLevels 1
+#endif
+
 // ----- Functions -----
 
 void i2c_isr( uint8_t ch );
+void i2c_setup_bus( uint8_t ch );
 
 // Initialize error counters
 void i2c_initial()
@@ -62,154 +109,153 @@ void i2c_initial()
 		volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
 		channel->error_count = 0;
 		channel->last_error = 0; // No error to begin with (resets on successful transaction)
+		channel->speed_level = 0;
 	}
+
+	i2c_clearStats();
 }
 
-void i2c_setup()
+// Clear bus health telemetry
+void i2c_clearStats()
 {
 	for ( uint8_t ch = ISSI_I2C_FirstBus_define; ch < ISSI_I2C_Buses_define + ISSI_I2C_FirstBus_define; ch++ )
 	{
+		volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+		channel->transactions = 0;
+		channel->bytes_sent = 0;
+		channel->bytes_read = 0;
+		channel->nack_count = 0;
+		channel->arbl_count = 0;
+		channel->timeout_count = 0;
+		for ( uint8_t bucket = 0; bucket < I2C_LatencyBuckets; bucket++ )
+		{
+			channel->latency[ bucket ] = 0;
+		}
+	}
+}
+
+// Configure a single bus, using the current speed level of the channel
+void i2c_setup_bus( uint8_t ch )
+{
+	volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+
 #if defined(_kinetis_)
-		volatile uint8_t *I2C_F   = (uint8_t*)(&I2C0_F) + i2c_offset[ch];
-		volatile uint8_t *I2C_FLT = (uint8_t*)(&I2C0_FLT) + i2c_offset[ch];
-		volatile uint8_t *I2C_C1  = (uint8_t*)(&I2C0_C1) + i2c_offset[ch];
-		volatile uint8_t *I2C_C2  = (uint8_t*)(&I2C0_C2) + i2c_offset[ch];
+	volatile uint8_t *I2C_F   = (uint8_t*)(&I2C0_F) + i2c_offset[ch];
+	volatile uint8_t *I2C_FLT = (uint8_t*)(&I2C0_FLT) + i2c_offset[ch];
+	volatile uint8_t *I2C_C1  = (uint8_t*)(&I2C0_C1) + i2c_offset[ch];
+	volatile uint8_t *I2C_C2  = (uint8_t*)(&I2C0_C2) + i2c_offset[ch];
 
-		switch ( ch )
-		{
-		case 0:
-			// Enable I2C internal clock
-			SIM_SCGC4 |= SIM_SCGC4_I2C0; // Bus 0
+	switch ( ch )
+	{
+	case 0:
+		// Enable I2C internal clock
+		SIM_SCGC4 |= SIM_SCGC4_I2C0; // Bus 0
 
-			// External pull-up resistor
-			PORTB_PCR0 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
-			PORTB_PCR1 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
+		// External pull-up resistor
+		PORTB_PCR0 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
+		PORTB_PCR1 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
 
-			break;
+		break;
 
-	#if defined(_kii_v2_)
-		case 1:
-			// Enable I2C internal clock
-			SIM_SCGC4 |= SIM_SCGC4_I2C1; // Bus 1
+#if defined(_kii_v2_)
+	case 1:
+		// Enable I2C internal clock
+		SIM_SCGC4 |= SIM_SCGC4_I2C1; // Bus 1
 
-			// External pull-up resistor
-			PORTC_PCR10 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
-			PORTC_PCR11 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
+		// External pull-up resistor
+		PORTC_PCR10 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
+		PORTC_PCR11 = PORT_PCR_ODE | PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(2);
 
-			break;
-	#endif
-		}
+		break;
+#endif
+	}
 
-		// SCL Frequency Divider
-	#if ISSI_Chip_31FL3731_define == 1 && defined(_kii_v1_)
-		// 0x53 -> 48 MHz / (2 * 72) = 333.333 kBaud
-		// 0x40 => mul(2)
-		// 0x13 => ICR(30)
-		*I2C_F = 0x53;
-		*I2C_FLT = 0x05;
-	#elif ISSI_Chip_31FL3731_define == 1 && defined(_kii_v2_)
-		// 0x4E -> 36 MHz / (2 * 56) = 321.428 kBaud
-		// 0x40 => mul(2)
-		// 0x0E => ICR(56)
-		*I2C_F = 0x4E;
-		*I2C_FLT = 0x04;
-	#elif ISSI_Chip_31FL3732_define == 1 || ISSI_Chip_31FL3733_define == 1
-		/*
-		// Works
-		// 0x84 -> 36 MHz / (4 * 28) = 321.428 kBaud
-		// 0x80 => mul(4)
-		// 0x04 => ICR(28)
-		*I2C_F = 0x84;
-		*I2C_FLT = 0x02;
-
-		// Also works, 80 fps, no errors (flicker?)
-		// 0x0C -> 36 MHz / (1 * 44) = 818.181 kBaud
-		// 0x00 => mul(1)
-		// 0x0C => ICR(44)
-		*I2C_F = 0x0C;
-		*I2C_FLT = 0x02; // Glitch protection, reduce if you see bus errors
-		*/
+	// SCL Frequency Divider
+	*I2C_F = i2c_speed_f[ channel->speed_level ];
+	*I2C_FLT = i2c_speed_flt[ channel->speed_level ];
 
-		// Also works, 86 fps, no errors, using frame delay of 50 us
-		// 0x40 -> 36 MHz / (2 * 20) = 900 kBaud
-		// 0x40 => mul(2)
-		// 0x00 => ICR(20)
-		*I2C_F = 0x40;
-		*I2C_FLT = 0x02;
-	#endif
-		*I2C_C1 = I2C_C1_IICEN;
-		*I2C_C2 = I2C_C2_HDRS; // High drive select
-
-		switch ( ch )
-		{
-		case 0:
-			// Enable I2C Interrupt
-			NVIC_ENABLE_IRQ( IRQ_I2C0 );
+	*I2C_C1 = I2C_C1_IICEN;
+	*I2C_C2 = I2C_C2_HDRS; // High drive select
 
-			// Set priority below USB, but not too low to maintain performance
-			NVIC_SET_PRIORITY( IRQ_PIT_CH0, 150 );
-			break;
+	switch ( ch )
+	{
+	case 0:
+		// Enable I2C Interrupt
+		NVIC_ENABLE_IRQ( IRQ_I2C0 );
 
-	#if defined(_kii_v2_)
-		case 1:
+		// Set priority below USB, but not too low to maintain performance
+		NVIC_SET_PRIORITY( IRQ_PIT_CH0, 150 );
+		break;
 
-			// Enable I2C Interrupt
-			NVIC_ENABLE_IRQ( IRQ_I2C1 );
+#if defined(_kii_v2_)
+	case 1:
 
-			// Set priority below USB, but not too low to maintain performance
-			NVIC_SET_PRIORITY( IRQ_PIT_CH1, 150 );
-			break;
-	#endif
-		}
+		// Enable I2C Interrupt
+		NVIC_ENABLE_IRQ( IRQ_I2C1 );
+
+		// Set priority below USB, but not too low to maintain performance
+		NVIC_SET_PRIORITY( IRQ_PIT_CH1, 150 );
+		break;
+#endif
+	}
 
 #elif defined(_sam_)
 
-#if ISSI_Chip_31FL3731_define == 1
-#define BAUD 400000
-#define CK 1
-#elif ISSI_Chip_31FL3732_define == 1 || ISSI_Chip_31FL3733_define == 1
-#define BAUD 800000
-#define CK 0
-#endif
+	switch ( ch )
+	{
+	case 0:
+		// Enable Peripheral / Disable PIO
+		PIOA->PIO_PDR = (1 << 3) | (1 << 4);
+		// Enable i2c clock
+		PMC->PMC_PCER0 = (1 << ID_TWI0);
+		break;
+	case 1:
+		MATRIX->CCFG_SYSIO |= CCFG_SYSIO_SYSIO4 | CCFG_SYSIO_SYSIO5; // Switch PB4 from TDI to GPIO
+		PIOB->PIO_PDR = (1 << 4) | (1 << 5);
+		PMC->PMC_PCER0 = (1 << ID_TWI1);
+		break;
+	}
 
-		switch ( ch )
-		{
-		case 0:
-			// Enable Peripheral / Disable PIO
-			PIOA->PIO_PDR = (1 << 3) | (1 << 4);
-			// Enable i2c clock
-			PMC->PMC_PCER0 = (1 << ID_TWI0);
-			break;
-		case 1:
-			MATRIX->CCFG_SYSIO |= CCFG_SYSIO_SYSIO4 | CCFG_SYSIO_SYSIO5; // Switch PB4 from TDI to GPIO
-			PIOB->PIO_PDR = (1 << 4) | (1 << 5);
-			PMC->PMC_PCER0 = (1 << ID_TWI1);
-			break;
-		}
+	Twi *twi_dev = twi_devs[ch];
+	// Each speed level halves the baud rate
+	uint32_t baud = BAUD >> channel->speed_level;
+	uint8_t ckdiv = CK;
+	uint32_t div = (F_CPU/baud - 4) / (2<<ckdiv);
 
-		Twi *twi_dev = twi_devs[ch];
-		uint16_t div = (F_CPU/BAUD - 4) / (2<<CK);
+	// CLDIV/CHDIV are only 8 bits wide, increase the clock divider until the divisor fits
+	while ( div > 255 && ckdiv < 7 )
+	{
+		ckdiv++;
+		div = (F_CPU/baud - 4) / (2<<ckdiv);
+	}
 
-		// Set clock
-		twi_dev->TWI_CWGR = TWI_CWGR_CLDIV(div) + TWI_CWGR_CHDIV(div) + TWI_CWGR_CKDIV(CK);
+	// Set clock
+	twi_dev->TWI_CWGR = TWI_CWGR_CLDIV(div) + TWI_CWGR_CHDIV(div) + TWI_CWGR_CKDIV(ckdiv);
 
-		// Enable master mode
-		twi_dev->TWI_CR = TWI_CR_MSDIS | TWI_CR_SVDIS;
-		twi_dev->TWI_CR = TWI_CR_MSEN;
+	// Enable master mode
+	twi_dev->TWI_CR = TWI_CR_MSDIS | TWI_CR_SVDIS;
+	twi_dev->TWI_CR = TWI_CR_MSEN;
 
-		switch ( ch )
-		{
-		case 0:
-			NVIC_SetPriority(TWI0_IRQn, 150);
-			NVIC_EnableIRQ(TWI0_IRQn);
-			break;
-		case 1:
-			NVIC_SetPriority(TWI1_IRQn, 150);
-			NVIC_EnableIRQ(TWI1_IRQn);
-			break;
-		}
+	switch ( ch )
+	{
+	case 0:
+		NVIC_SetPriority(TWI0_IRQn, 150);
+		NVIC_EnableIRQ(TWI0_IRQn);
+		break;
+	case 1:
+		NVIC_SetPriority(TWI1_IRQn, 150);
+		NVIC_EnableIRQ(TWI1_IRQn);
+		break;
+	}
 
 #endif
+}
+
+void i2c_setup()
+{
+	for ( uint8_t ch = ISSI_I2C_FirstBus_define; ch < ISSI_I2C_Buses_define + ISSI_I2C_FirstBus_define; ch++ )
+	{
+		i2c_setup_bus( ch );
 	}
 }
 
@@ -240,6 +286,70 @@ void i2c_reset()
 	i2c_setup();
 }
 
+void i2c_recover( uint8_t ch )
+{
+	volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+	channel->status = I2C_AVAILABLE;
+
+	i2c_setup_bus( ch );
+}
+
+uint8_t i2c_timeout( uint32_t timeout_ms )
+{
+	uint8_t count = 0;
+
+	for ( uint8_t ch = ISSI_I2C_FirstBus_define; ch < ISSI_I2C_Buses_define + ISSI_I2C_FirstBus_define; ch++ )
+	{
+		volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+		if ( channel->status != I2C_BUSY )
+			continue;
+
+		if ( Time_duration_ms( channel->start ) < timeout_ms )
+			continue;
+
+		// Stop the transaction, the bus will be recovered like any other error
+#if defined(_kinetis_)
+		volatile uint8_t *I2C_C1 = (uint8_t*)(&I2C0_C1) + i2c_offset[ch];
+		*I2C_C1 &= ~( I2C_C1_MST | I2C_C1_IICIE );
+#elif defined(_sam_)
+		Twi *twi_dev = twi_devs[ch];
+		twi_dev->TWI_CR |= TWI_CR_STOP;
+		twi_dev->TWI_IDR = 0xFFFFFFFF;
+#endif
+		channel->timeout_count++;
+		channel->error_count++;
+		channel->last_error++;
+		channel->status = I2C_ERROR;
+		count++;
+	}
+
+	return count;
+}
+
+uint8_t i2c_slowdown( uint8_t ch )
+{
+	volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+	if ( channel->speed_level + 1 >= I2C_SpeedLevels )
+	{
+		return 0;
+	}
+
+	channel->speed_level++;
+	return 1;
+}
+
+uint8_t i2c_speedup( uint8_t ch )
+{
+	volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+	if ( channel->speed_level == 0 )
+	{
+		return 0;
+	}
+
+	channel->speed_level--;
+	return 1;
+}
+
 uint8_t i2c_busy( uint8_t ch )
 {
 	volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
@@ -262,14 +372,16 @@ uint8_t i2c_any_busy()
 }
 
 // These are here for readability and correspond to bit 0 of the address byte.
-#define I2C_WRITING 0
-#define I2C_READING 1
+#define I2C_WRITING    0
+#define I2C_READING    1
+#define I2C_RESTARTING 2
 
 int32_t i2c_send_sequence(
 	uint8_t ch,
-	uint16_t *sequence,
+	uint8_t *sequence,
 	uint32_t sequence_length,
 	uint8_t *received_data,
+	uint8_t read_length,
 	void ( *callback_fn )( void* ),
 	void *user_data
 ) {
@@ -294,7 +406,7 @@ int32_t i2c_send_sequence(
 
 	// Check if there are back-to-back errors
 	// in succession
-	if ( channel->last_error > 5 )
+	if ( channel->last_error > ISSI_I2C_ErrorThreshold_define )
 	{
 		warn_msg("I2C Bus Error: ");
 		printInt8( ch );
@@ -316,10 +428,16 @@ int32_t i2c_send_sequence(
 	channel->sequence = sequence;
 	channel->sequence_end = sequence + sequence_length;
 	channel->received_data = received_data;
+	channel->read_address = *sequence | 0x01;
+	channel->read_length = read_length;
 	channel->status = I2C_BUSY;
 	channel->txrx = I2C_WRITING;
 	channel->callback_fn = callback_fn;
 	channel->user_data = user_data;
+	channel->start = Time_now();
+
+	// Address byte (R/W bit is always 0 here) with the bus number in the lower bit
+	Trace_event( TraceEvent_I2C, ( *sequence & 0xFE ) | ( ch & 0x01 ), sequence_length );
 
 	// reads_ahead does not need to be initialized
 
@@ -335,6 +453,7 @@ int32_t i2c_send_sequence(
 	if ( status & I2C_S_ARBL )
 	{
 		warn_print("Arbitration lost");
+		channel->arbl_count++;
 		result = -1;
 		goto i2c_send_sequence_cleanup;
 	}
@@ -342,6 +461,7 @@ int32_t i2c_send_sequence(
 	// Write the first (address) byte.
 	address = *channel->sequence++;
 	*I2C_D = address;
+	channel->bytes_sent++;
 
 	// Everything is OK.
 	return result;
@@ -367,6 +487,7 @@ i2c_send_sequence_cleanup:
 
 	// Set slave address
 	twi_dev->TWI_MMR = TWI_MMR_DADR(address) | (mread ? TWI_MMR_MREAD : 0);
+	channel->bytes_sent++;
 
 	// Enable interrupts
 	twi_dev->TWI_IER = TWI_IER_RXRDY | TWI_IER_TXRDY | TWI_IER_TXCOMP | TWI_IER_ARBLST;
@@ -399,7 +520,7 @@ void i2c_isr( uint8_t ch )
 	Twi *twi_dev = twi_devs[ch];
 #endif
 
-	uint16_t element;
+	uint8_t element;
 	uint8_t status;
 
 #if defined(_kinetis_)
@@ -418,6 +539,7 @@ void i2c_isr( uint8_t ch )
 		*/
 
 		*I2C_S |= I2C_S_ARBL;
+		channel->arbl_count++;
 		goto i2c_isr_error;
 	}
 #elif defined(_sam_)
@@ -429,70 +551,31 @@ void i2c_isr( uint8_t ch )
 		warn_msg("Arbitration error. Bus: ");
 		printHex( ch );
 		print(NL);
+		channel->arbl_count++;
 		goto i2c_isr_error;
 	}
 #endif
 
-	if ( channel->txrx == I2C_READING )
+	switch ( channel->txrx )
 	{
+	case I2C_READING:
 		switch( channel->reads_ahead )
 		{
 		// All the reads in the sequence have been processed ( but note that the final data register read still needs to
-		// be done below! Now, the next thing is either a restart or the end of a sequence.
+		// be done below! A read always ends the sequence.
 		case 0:
 #if defined(_kinetis_)
-		// In any case, we need to switch to TX mode, either to generate a repeated start condition, or to avoid
-		// triggering another I2C read when reading the contents of the data register.
+			// Switch to TX mode to avoid triggering another I2C read when reading the contents of the data register.
 			*I2C_C1 |= I2C_C1_TX;
 
 			// Perform the final data register read now that it's safe to do so.
 			*channel->received_data++ = *I2C_D;
-
-			// Do we have a repeated start?
-			if ( ( channel->sequence < channel->sequence_end ) && ( *channel->sequence == I2C_RESTART ) )
-			{
-
-				// Generate a repeated start condition.
-				*I2C_C1 |= I2C_C1_RSTA;
-
-				// A restart is processed immediately, so we need to get a new element from our sequence. This is safe, because
-				// a sequence cannot end with a RESTART: there has to be something after it. Note that the only thing that can
-				// come after a restart is an address write.
-				channel->txrx = I2C_WRITING;
-				channel->sequence++;
-				element = *channel->sequence;
-				*I2C_D = element;
-			}
-			else
-			{
-				goto i2c_isr_stop;
-			}
 #elif defined(_sam_)
-
 			// Perform the final data register read now that it's safe to do so.
 			*channel->received_data++ = twi_dev->TWI_RHR;
-
-			// Do we have a repeated start?
-			if ( ( channel->sequence < channel->sequence_end ) && ( *channel->sequence == I2C_RESTART ) )
-			{
-				// Generate a repeated start condition.
-				twi_dev->TWI_MMR &= ~TWI_MMR_MREAD;
-				twi_dev->TWI_CR |= TWI_CR_START;
-
-				// A restart is processed immediately, so we need to get a new element from our sequence. This is safe, because
-				// a sequence cannot end with a RESTART: there has to be something after it. Note that the only thing that can
-				// come after a restart is an address write.
-				channel->txrx = I2C_WRITING;
-				channel->sequence++;
-				element = *channel->sequence;
-				twi_dev->TWI_THR = element;
-			}
-			else
-			{
-				goto i2c_isr_stop;
-			}
 #endif
-			break;
+			channel->bytes_read++;
+			goto i2c_isr_stop;
 
 		case 1:
 #if defined(_kinetis_)
@@ -518,123 +601,129 @@ void i2c_isr( uint8_t ch )
 		//printHex( *channel->received_data );
 		//print( NL );
 
+		channel->bytes_read++;
 		channel->reads_ahead--;
+		break;
 
-	}
-	// channel->txrx == I2C_WRITING
-	else
-	{
-		// First, check if we are at the end of a sequence.
-		if ( channel->sequence == channel->sequence_end )
-			goto i2c_isr_stop;
-
+	// Read address has been sent after the repeated start, begin reading
+	case I2C_RESTARTING:
 		// We received a NACK. Generate a STOP condition and abort.
 #if defined(_kinetis_)
 		if ( status & I2C_S_RXAK )
 		{
 			warn_print("NACK Received");
+			channel->nack_count++;
 			goto i2c_isr_error;
 		}
 #elif defined(_sam_)
 		if ( status & TWI_SR_NACK )
 		{
 			warn_print("NACK Received");
+			channel->nack_count++;
 			goto i2c_isr_error;
 		}
 #endif
 
-		// check next thing in our sequence
-		element = *channel->sequence;
+		channel->txrx = I2C_READING;
 
-		// Do we have a restart? If so, generate repeated start and make sure TX is on.
-		if ( element == I2C_RESTART )
-		{
+		// For reads we need to know the segment length to correctly plan NACK transmissions.
+		channel->reads_ahead = channel->read_length;
+
+		// Switch to RX mode.
 #if defined(_kinetis_)
-			*I2C_C1 |= I2C_C1_RSTA | I2C_C1_TX;
+		*I2C_C1 &= ~I2C_C1_TX;
 #elif defined(_sam_)
-			twi_dev->TWI_MMR &= ~TWI_MMR_MREAD;
-			twi_dev->TWI_CR |= TWI_CR_START;
+		twi_dev->TWI_MMR |= TWI_MMR_MREAD;
 #endif
 
-			// A restart is processed immediately, so we need to get a new element from our sequence.
-			// This is safe, because a sequence cannot end with a RESTART: there has to be something after it.
-			channel->sequence++;
-			element = *channel->sequence;
-
-			// Note that the only thing that can come after a restart is a write.
+		// do not ACK the final read
+		if ( channel->reads_ahead == 1 )
+		{
 #if defined(_kinetis_)
-			*I2C_D = element;
+			*I2C_C1 |= I2C_C1_TXAK;
 #elif defined(_sam_)
-			twi_dev->TWI_THR = element;
+			twi_dev->TWI_CR |= TWI_CR_STOP;
 #endif
 		}
+		// ACK all but the final read
 		else
 		{
-			if ( element == I2C_READ ) {
-				channel->txrx = I2C_READING;
-				// How many reads do we have ahead of us ( not including this one )?
-				// For reads we need to know the segment length to correctly plan NACK transmissions.
-				// We already know about one read
-				channel->reads_ahead = 1;
-				while (
-					(  ( channel->sequence + channel->reads_ahead ) < channel->sequence_end ) &&
-					( *( channel->sequence + channel->reads_ahead ) == I2C_READ )
-				) {
-					channel->reads_ahead++;
-				}
-
-				// Switch to RX mode.
 #if defined(_kinetis_)
-				*I2C_C1 &= ~I2C_C1_TX;
-#elif defined(_sam_)
-				twi_dev->TWI_MMR |= TWI_MMR_MREAD;
+			*I2C_C1 &= ~( I2C_C1_TXAK );
 #endif
+		}
 
-				// do not ACK the final read
-				if ( channel->reads_ahead == 1 )
-				{
+		// Dummy read comes first, note that this is not valid data!
+		// This only triggers a read, actual data will come in the next interrupt call and overwrite this.
+		// This is why we do not increment the received_data pointer.
 #if defined(_kinetis_)
-					*I2C_C1 |= I2C_C1_TXAK;
+		*channel->received_data = *I2C_D;
 #elif defined(_sam_)
-					twi_dev->TWI_CR |= TWI_CR_STOP;
+		*channel->received_data = twi_dev->TWI_RHR;
 #endif
-				}
-				// ACK all but the final read
-				else
-				{
+		channel->reads_ahead--;
+		break;
+
+	// I2C_WRITING
+	default:
+		// First, check if we are at the end of the write sequence.
+		// If there is nothing to read, we're done.
+		if ( channel->sequence == channel->sequence_end && channel->read_length == 0 )
+			goto i2c_isr_stop;
+
+		// We received a NACK. Generate a STOP condition and abort.
 #if defined(_kinetis_)
-					*I2C_C1 &= ~( I2C_C1_TXAK );
+		if ( status & I2C_S_RXAK )
+		{
+			warn_print("NACK Received");
+			channel->nack_count++;
+			goto i2c_isr_error;
+		}
+#elif defined(_sam_)
+		if ( status & TWI_SR_NACK )
+		{
+			warn_print("NACK Received");
+			channel->nack_count++;
+			goto i2c_isr_error;
+		}
 #endif
-				}
 
-				// Dummy read comes first, note that this is not valid data!
-				// This only triggers a read, actual data will come in the next interrupt call and overwrite this.
-				// This is why we do not increment the received_data pointer.
+		// End of the write sequence, generate repeated start and make sure TX is on.
+		// The only thing that can come after a restart is the read address.
+		if ( channel->sequence == channel->sequence_end )
+		{
 #if defined(_kinetis_)
-				*channel->received_data = *I2C_D;
+			*I2C_C1 |= I2C_C1_RSTA | I2C_C1_TX;
+			*I2C_D = channel->read_address;
 #elif defined(_sam_)
-				*channel->received_data = twi_dev->TWI_RHR;
+			twi_dev->TWI_MMR &= ~TWI_MMR_MREAD;
+			twi_dev->TWI_CR |= TWI_CR_START;
+			twi_dev->TWI_THR = channel->read_address;
 #endif
-				channel->reads_ahead--;
-			}
-			// Not a restart, not a read, must be a write.
-			else
-			{
-				//print("WRITE: ");
-				//printHex(element);
+			channel->txrx = I2C_RESTARTING;
+			channel->bytes_sent++;
+			break;
+		}
+
+		// Must be a write.
+		element = *channel->sequence;
+
+		//print("WRITE: ");
+		//printHex(element);
 #if defined(_kinetis_)
-				*I2C_D = element;
+		*I2C_D = element;
 #elif defined(_sam_)
-				// while (! (status & TWI_SR_TXRDY));
-				if (!(status & TWI_SR_TXRDY)) return;
-				twi_dev->TWI_THR = element;
+		// while (! (status & TWI_SR_TXRDY));
+		if (!(status & TWI_SR_TXRDY)) return;
+		twi_dev->TWI_THR = element;
 #endif
-				//print( NL );
-			}
-		}
+		//print( NL );
+
+		channel->sequence++;
+		channel->bytes_sent++;
+		break;
 	}
 
-	channel->sequence++;
 	channel->last_error = 0; // No error
 	return;
 
@@ -649,6 +738,20 @@ i2c_isr_stop:
 	twi_dev->TWI_IDR = 0xFFFFFFFF;
 #endif
 	channel->status = I2C_AVAILABLE;
+	channel->last_error = 0;
+
+	// Record transaction latency
+	{
+		uint32_t slot = Time_duration_us( channel->start ) >> I2C_LatencyBaseShift;
+		uint8_t bucket = 0;
+		while ( slot && bucket < I2C_LatencyBuckets - 1 )
+		{
+			slot >>= 1;
+			bucket++;
+		}
+		channel->latency[ bucket ]++;
+		channel->transactions++;
+	}
 
 	// Call the user-supplied callback function upon successful completion (if it exists).
 	if ( channel->callback_fn )
@@ -37,18 +37,21 @@
 #define I2C_BUSY 1
 #define I2C_ERROR 2
 
-
-#define I2C_RESTART 1<<8
-#define I2C_READ    2<<8
+// Transaction latency histogram
+// Bucket 0 is < 64 us, each following bucket doubles, the final bucket catches everything >= 4096 us
+#define I2C_LatencyBuckets 8
+#define I2C_LatencyBaseShift 6
 
 
 
 // ----- Structs -----
 
 typedef struct {
-	uint16_t *sequence;
-	uint16_t *sequence_end;
+	uint8_t *sequence;
+	uint8_t *sequence_end;
 	uint8_t *received_data;
+	uint8_t read_address;
+	uint8_t read_length;
 	void (*callback_fn)(void*);
 	void *user_data;
 	uint8_t reads_ahead;
@@ -56,10 +59,27 @@ typedef struct {
 	uint8_t txrx;
 	uint32_t error_count;
 	uint32_t last_error;
+
+	// Bus health telemetry
+	Time start;               // Start time of the current transaction
+	uint8_t speed_level;      // Current bus clock level (0 is fastest)
+	uint32_t transactions;    // Successfully completed transactions
+	uint32_t bytes_sent;      // Bytes written to the bus (including addresses)
+	uint32_t bytes_read;      // Bytes read from the bus
+	uint32_t nack_count;      // NACKs received
+	uint32_t arbl_count;      // Arbitration losses
+	uint32_t timeout_count;   // Transactions that stalled and had to be aborted
+	uint32_t latency[I2C_LatencyBuckets];
 } I2C_Channel;
 
 
 
+// ----- Variables -----
+
+extern volatile I2C_Channel i2c_channels[];
+
+
+
 // ----- Functions -----
 
 /*
@@ -75,18 +95,21 @@ void i2c_setup();
 
 
 /*
- * Sends a command/data sequence that can include restarts, writes and reads. Every transmission begins with a START,
- * and ends with a STOP so you do not have to specify that.
+ * Sends a command/data sequence consisting of a write, optionally followed by a repeated start and a read. Every
+ * transmission begins with a START, and ends with a STOP so you do not have to specify that.
+ *
+ * sequence is the I2C write that should be performed. The first byte is the (8-bit) device address, the remaining
+ * bytes are written as-is. The sequence is plain uint8_t data so buffers can be handed directly to the driver, there
+ * is no in-band signalling.
  *
- * sequence is the I2C operation sequence that should be performed. It can include any number of writes, restarts and
- * reads. Note that the sequence is composed of uint16_t, not uint8_t. This is because we have to support out-of-band
- * signalling of I2C_RESTART and I2C_READ operations, while still passing through 8-bit data.
+ * sequence_length is the number of bytes in the sequence (including the address). Sequences of arbitrary length are
+ * supported. The minimum sequence length is (rather obviously) 2.
  *
- * sequence_length is the number of sequence elements (not bytes). Sequences of arbitrary length are supported. The
- * minimum sequence length is (rather obviously) 2.
+ * received_data should point to a buffer that can hold read_length bytes. If there are no reads, 0 can be passed, as
+ * this parameter will not be used.
  *
- * received_data should point to a buffer that can hold as many bytes as there are I2C_READ operations in the
- * sequence. If there are no reads, 0 can be passed, as this parameter will not be used.
+ * read_length is the number of bytes to read after the write. If non-zero, a repeated start is generated once the
+ * sequence has been written, followed by the device address (with the read bit set) and read_length reads.
  *
  * callback_fn is a pointer to a function that will get called upon successful completion of the entire sequence. If 0 is
  * supplied, no function will be called. Note that the function will be called fron an interrupt handler, so it should do
@@ -97,9 +120,10 @@ void i2c_setup();
 
 int32_t i2c_send_sequence(
 	uint8_t ch,
-	uint16_t *sequence,
+	uint8_t *sequence,
 	uint32_t sequence_length,
 	uint8_t *received_data,
+	uint8_t read_length,
 	void (*callback_fn)(void*),
 	void *user_data
 );
@@ -107,8 +131,8 @@ int32_t i2c_send_sequence(
 /*
  * Convenience macros
  */
-#define i2c_send(ch, seq, seq_len)      i2c_send_sequence( ch, seq, seq_len, 0, 0, 0 )
-#define i2c_read(ch, seq, seq_len, rec) i2c_send_sequence( ch, seq, seq_len, rec, 0, 0 )
+#define i2c_send(ch, seq, seq_len)               i2c_send_sequence( ch, seq, seq_len, 0, 0, 0, 0 )
+#define i2c_read(ch, seq, seq_len, rec, rec_len) i2c_send_sequence( ch, seq, seq_len, rec, rec_len, 0, 0 )
 
 /*
  * Check if busy
@@ -121,6 +145,29 @@ uint8_t i2c_any_busy();
  */
 void i2c_reset();
 
+/*
+ * Reset a single i2c bus after an error, keeping the current speed level
+ */
+void i2c_recover( uint8_t ch );
+
+/*
+ * Abort any transaction that has been busy for longer than timeout_ms
+ * Returns the number of buses that timed out
+ */
+uint8_t i2c_timeout( uint32_t timeout_ms );
+
+/*
+ * Step the bus clock down (slower) or up (faster) a level
+ * Returns 1 if the speed was changed, 0 if already at the limit
+ */
+uint8_t i2c_slowdown( uint8_t ch );
+uint8_t i2c_speedup( uint8_t ch );
+
+/*
+ * Clear bus health telemetry
+ */
+void i2c_clearStats();
+
 /*
  * Check to see if there was an error on any bus
  */
@@ -139,6 +139,13 @@
 
 #define LED_TotalChannels     (LED_BufferLength * ISSI_Chips_define)
 
+// Batched register writes
+#define LED_BatchOps      24 // Queued transactions before the batch is run
+#define LED_BatchBurstLen  4 // Consecutive register writes coalesced into a single transaction
+
+#define LED_FramerateBackoffStep 5 // ms per frame added each time a bus at its slowest clock keeps erroring
+#define LED_FramerateBackoffMax 40 // Maximum ms per frame added while an I2C bus is unstable
+
 
 
 // ----- Macros -----
@@ -161,17 +168,17 @@
 // ----- Structs -----
 
 typedef struct LED_Buffer {
-	uint16_t i2c_addr;
-	uint16_t reg_addr;
-	uint16_t ledctrl[ISSI_LEDCtrlLength];
-	uint16_t unused[ISSI_LEDBlink];
-	uint16_t buffer[LED_BufferLength];
+	uint8_t i2c_addr;
+	uint8_t reg_addr;
+	uint8_t ledctrl[ISSI_LEDCtrlLength];
+	uint8_t unused[ISSI_LEDBlink];
+	uint8_t buffer[LED_BufferLength];
 } LED_Buffer;
 
 typedef struct LED_EnableBuffer {
-	uint16_t i2c_addr;
-	uint16_t reg_addr;
-	uint16_t buffer[LED_EnableBufferLength];
+	uint8_t i2c_addr;
+	uint8_t reg_addr;
+	uint8_t buffer[LED_EnableBufferLength];
 } LED_EnableBuffer;
 
 typedef struct LED_ChannelMap {
@@ -179,6 +186,22 @@ typedef struct LED_ChannelMap {
 	uint8_t addr;
 } LED_ChannelMap;
 
+// Single register write transaction
+// data points to burst for coalesced writes, or 0 to write zeros
+typedef struct LED_BatchOp {
+	const uint8_t *data;
+	uint8_t chip;
+	uint8_t page;
+	uint8_t reg;
+	uint8_t len;
+	uint8_t burst[LED_BatchBurstLen];
+} LED_BatchOp;
+
+typedef struct LED_Batch {
+	uint8_t count;
+	LED_BatchOp ops[LED_BatchOps];
+} LED_Batch;
+
 
 
 // ----- Function Declarations -----
@@ -186,6 +209,7 @@ typedef struct LED_ChannelMap {
 // CLI Functions
 void cliFunc_ledCheck ( char* args );
 void cliFunc_ledFPS   ( char* args );
+void cliFunc_ledI2C   ( char* args );
 void cliFunc_ledReset ( char* args );
 void cliFunc_ledSet   ( char* args );
 void cliFunc_ledToggle( char* args );
@@ -200,6 +224,7 @@ void LED_printConfig();
 // Scan Module command dictionary
 CLIDict_Entry( ledCheck,    "Run LED diagnostics. Not all ISSI chips support this.");
 CLIDict_Entry( ledFPS,      "Show/set FPS of LED driver, r - Reset framerate" );
+CLIDict_Entry( ledI2C,      "Show I2C bus health statistics, r - Reset counters" );
 CLIDict_Entry( ledReset,    "Reset ISSI chips." );
 CLIDict_Entry( ledSet,      "Set ISSI overall brightness." );
 CLIDict_Entry( ledToggle,   "Toggle ISSI hardware shutdown." );
@@ -207,6 +232,7 @@ CLIDict_Entry( ledToggle,   "Toggle ISSI hardware shutdown." );
 CLIDict_Def( ledCLIDict, "ISSI LED Module Commands" ) = {
 	CLIDict_Item( ledCheck ),
 	CLIDict_Item( ledFPS ),
+	CLIDict_Item( ledI2C ),
 	CLIDict_Item( ledReset ),
 	CLIDict_Item( ledSet ),
 	CLIDict_Item( ledToggle ),
@@ -248,7 +274,10 @@ uint8_t LED_enable_current; // Enable/disable ISSI chips (based on USB current a
 uint8_t LED_pause;          // Pause ISSI updates
 uint8_t LED_brightness;     // Global brightness for LEDs
 
-uint32_t LED_framerate;     // Configured led framerate, given in ms per frame
+uint32_t LED_framerate;        // Configured led framerate, given in ms per frame
+uint32_t LED_framerateBackoff; // Additional ms per frame, added while an I2C bus keeps erroring
+uint32_t LED_cleanFrames;      // Frames sent since the last I2C error
+uint8_t LED_i2cErrors[ISSI_I2C_Buses_define]; // Errors per bus since the last clean period
 
 Time LED_timePrev; // Last frame processed
 
@@ -306,14 +335,14 @@ void LED_setupPage( uint8_t bus, uint8_t addr, uint8_t page )
 #if ISSI_Chip_31FL3733_define == 1
 	// See http://www.issi.com/WW/pdf/31FL3733.pdf Table 3 Page 12
 	// See http://www.issi.com/WW/pdf/31FL3736.pdf Table 3 Page 13
-	uint16_t pageEnable[] = { addr, 0xFE, 0xC5 };
-	while ( i2c_send( bus, pageEnable, sizeof( pageEnable ) / 2 ) == -1 )
+	uint8_t pageEnable[] = { addr, 0xFE, 0xC5 };
+	while ( i2c_send( bus, pageEnable, sizeof( pageEnable ) ) == -1 )
 		delay_us( ISSI_SendDelay );
 #endif
 
 	// Setup page
-	uint16_t pageSetup[] = { addr, 0xFD, page };
-	while ( i2c_send( bus, pageSetup, sizeof( pageSetup ) / 2 ) == -1 )
+	uint8_t pageSetup[] = { addr, 0xFD, page };
+	while ( i2c_send( bus, pageSetup, sizeof( pageSetup ) ) == -1 )
 		delay_us( ISSI_SendDelay );
 
 	// Delay until written
@@ -321,44 +350,216 @@ void LED_setupPage( uint8_t bus, uint8_t addr, uint8_t page )
 		delay_us( ISSI_SendDelay );
 }
 
-// Zero out given ISSI page
-void LED_zeroPages( uint8_t bus, uint8_t addr, uint8_t startPage, uint8_t numPages, uint8_t startReg, uint8_t endReg )
+// Start a new batch of register writes
+void LED_batchInit( LED_Batch *batch )
+{
+	batch->count = 0;
+}
+
+// Run all queued transactions
+// Each round starts the next transaction of one chip per bus, so chips on different buses are written concurrently
+// Page changes are only sent when a chip's page differs from the previous transaction
+void LED_batchRun( LED_Batch *batch )
 {
-	// Clear Page
+	uint8_t next[ ISSI_Chips_define ]; // Next op per chip
+	uint8_t page[ ISSI_Chips_define ]; // Current page per chip, 0xFF if unknown
+#if ISSI_Chip_31FL3733_define == 1
+	uint8_t unlocked[ ISSI_Chips_define ];
+#endif
+
 	// Max length of a page + chip id + reg start
-	uint16_t clearPage[2 + ISSI_PageLength] = { 0 };
-	clearPage[0] = addr;
-	clearPage[1] = startReg;
+	uint8_t sequence[ ISSI_I2C_Buses_define ][ 2 + ISSI_PageLength ];
 
-	// Iterate through given pages, zero'ing out the given register regions
-	for ( uint8_t page = startPage; page < startPage + numPages; page++ )
+	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		// Page Setup
-		LED_setupPage( bus, addr, page );
+		next[ ch ] = 0;
+		while ( next[ ch ] < batch->count && batch->ops[ next[ ch ] ].chip != ch )
+			next[ ch ]++;
+		page[ ch ] = 0xFF;
+#if ISSI_Chip_31FL3733_define == 1
+		unlocked[ ch ] = 0;
+#endif
+	}
+
+	for ( ;; )
+	{
+		uint8_t buses_used = 0;
+
+		for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
+		{
+			// Nothing left for this chip
+			if ( next[ ch ] >= batch->count )
+				continue;
+
+			// Only one transaction per bus each round
+			uint8_t bus = LED_ChannelMapping[ ch ].bus;
+			uint8_t bus_index = bus - ISSI_I2C_FirstBus_define;
+			if ( buses_used & ( 1 << bus_index ) )
+				continue;
+
+			LED_BatchOp *op = &batch->ops[ next[ ch ] ];
+			uint8_t *seq = sequence[ bus_index ];
+			uint16_t len;
+			seq[0] = LED_ChannelMapping[ ch ].addr;
+
+			// Page Setup
+			if ( page[ ch ] != op->page )
+			{
+#if ISSI_Chip_31FL3733_define == 1
+				// IS31FL3733 requires unlocking the 0xFD register before each page change
+				// See http://www.issi.com/WW/pdf/31FL3733.pdf Table 3 Page 12
+				if ( !unlocked[ ch ] )
+				{
+					seq[1] = 0xFE;
+					seq[2] = 0xC5;
+					unlocked[ ch ] = 1;
+				}
+				else
+				{
+					seq[1] = 0xFD;
+					seq[2] = op->page;
+					unlocked[ ch ] = 0;
+					page[ ch ] = op->page;
+				}
+#else
+				seq[1] = 0xFD;
+				seq[2] = op->page;
+				page[ ch ] = op->page;
+#endif
+				len = 3;
+			}
+			// Register write
+			else
+			{
+				seq[1] = op->reg;
+				for ( uint8_t byte = 0; byte < op->len; byte++ )
+				{
+					seq[ 2 + byte ] = op->data ? op->data[ byte ] : 0;
+				}
+				len = 2 + op->len;
+
+				// Find next op for this chip
+				do {
+					next[ ch ]++;
+				} while ( next[ ch ] < batch->count && batch->ops[ next[ ch ] ].chip != ch );
+
+				// Page change only
+				if ( op->len == 0 )
+					continue;
+			}
+
+			while ( i2c_send( bus, seq, len ) == -1 )
+				delay_us( ISSI_SendDelay );
+			buses_used |= 1 << bus_index;
+		}
 
-		// Zero out page
-		while ( i2c_send( bus, clearPage, 2 + endReg - startReg ) == -1 )
+		// Finished
+		if ( !buses_used )
+		{
+			// Check for chips that only had a page change left
+			uint8_t remaining = 0;
+			for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
+			{
+				if ( next[ ch ] < batch->count )
+					remaining = 1;
+			}
+			if ( !remaining )
+				break;
+		}
+
+		// Wait for the round to finish on all buses
+		while ( i2c_any_busy() )
 			delay_us( ISSI_SendDelay );
 	}
 
-	// Wait until finished zero'ing
-	while ( i2c_busy( bus ) )
-		delay_us( ISSI_SendDelay );
+	batch->count = 0;
+}
+
+// Queue a transaction, running the batch first if it is full
+LED_BatchOp *LED_batchAdd( LED_Batch *batch, uint8_t chip, uint8_t page, uint8_t reg )
+{
+	if ( batch->count >= LED_BatchOps )
+	{
+		LED_batchRun( batch );
+	}
+
+	LED_BatchOp *op = &batch->ops[ batch->count++ ];
+	op->chip = chip;
+	op->page = page;
+	op->reg = reg;
+	op->len = 0;
+	op->data = op->burst;
+	return op;
+}
+
+// Queue a single register write
+// Coalesced with the previous write to the chip if it was to the preceding register
+void LED_batchWrite( LED_Batch *batch, uint8_t chip, uint8_t reg, uint8_t val, uint8_t page )
+{
+	// Find the previous transaction for this chip
+	for ( int16_t pos = batch->count - 1; pos >= 0; pos-- )
+	{
+		LED_BatchOp *op = &batch->ops[ pos ];
+		if ( op->chip != chip )
+			continue;
+
+		// Auto-increment burst
+		if (
+			op->data == op->burst
+			&& op->page == page
+			&& op->reg + op->len == reg
+			&& op->len < LED_BatchBurstLen
+		)
+		{
+			op->burst[ op->len++ ] = val;
+			return;
+		}
+		break;
+	}
+
+	LED_BatchOp *op = LED_batchAdd( batch, chip, page, reg );
+	op->burst[ op->len++ ] = val;
+}
+
+// Queue a write of len bytes from data
+// data must remain valid until the batch is run
+void LED_batchSend( LED_Batch *batch, uint8_t chip, uint8_t page, uint8_t reg, const uint8_t *data, uint8_t len )
+{
+	LED_BatchOp *op = LED_batchAdd( batch, chip, page, reg );
+	op->data = data;
+	op->len = len;
+}
+
+// Queue zeroing of registers startReg to endReg (exclusive)
+void LED_batchZero( LED_Batch *batch, uint8_t chip, uint8_t page, uint8_t startReg, uint8_t endReg )
+{
+	LED_BatchOp *op = LED_batchAdd( batch, chip, page, startReg );
+	op->data = 0;
+	op->len = endReg - startReg;
+}
+
+// Queue a page change
+void LED_batchPage( LED_Batch *batch, uint8_t chip, uint8_t page )
+{
+	LED_batchAdd( batch, chip, page, 0 );
 }
 
 // Zero control ISSI pages
 void LED_zeroControlPages()
 {
+	LED_Batch batch;
+	LED_batchInit( &batch );
+
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		uint8_t addr = LED_ChannelMapping[ ch ].addr;
-		uint8_t bus = LED_ChannelMapping[ ch ].bus;
-		LED_zeroPages( bus, addr, ISSI_ConfigPage, 1, 0x00, ISSI_ConfigPageLength ); // Control Registers
+		LED_batchZero( &batch, ch, ISSI_ConfigPage, 0x00, ISSI_ConfigPageLength ); // Control Registers
 	}
+
+	LED_batchRun( &batch );
 }
 
 // Write ISSI page
-void LED_sendPage( uint8_t bus, uint8_t addr, uint16_t *buffer, uint32_t len, uint8_t page )
+void LED_sendPage( uint8_t bus, uint8_t addr, uint8_t *buffer, uint32_t len, uint8_t page )
 {
 	/*
 	info_msg("I2C Send Page: bus(");
@@ -401,7 +602,7 @@ void LED_syncReg( uint8_t reg, uint8_t val, uint8_t page )
 	}
 
 	// Reg Write Setup
-	uint16_t writeData[] = { 0, reg, val };
+	uint8_t writeData[] = { 0, reg, val };
 
 	// Write to all the registers
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
@@ -410,7 +611,7 @@ void LED_syncReg( uint8_t reg, uint8_t val, uint8_t page )
 		uint8_t bus = LED_ChannelMapping[ ch ].bus;
 
 		// Delay very little to help with synchronization
-		while ( i2c_send( bus, writeData, sizeof( writeData ) / 2 ) == -1 )
+		while ( i2c_send( bus, writeData, sizeof( writeData ) ) == -1 )
 			delay_us(10);
 	}
 
@@ -437,13 +638,13 @@ void LED_writeReg( uint8_t bus, uint8_t addr, uint8_t reg, uint8_t val, uint8_t
 	*/
 
 	// Reg Write Setup
-	uint16_t writeData[] = { addr, reg, val };
+	uint8_t writeData[] = { addr, reg, val };
 
 	// Setup page
 	LED_setupPage( bus, addr, page );
 
 	// Write register
-	while ( i2c_send( bus, writeData, sizeof( writeData ) / 2 ) == -1 )
+	while ( i2c_send( bus, writeData, sizeof( writeData ) ) == -1 )
 		delay_us( ISSI_SendDelay );
 
 	// Delay until written
@@ -475,11 +676,12 @@ uint8_t LED_readReg( uint8_t bus, uint8_t addr, uint8_t reg, uint8_t page )
 	LED_setupPage( bus, addr, page );
 
 	// Register Read Command
-	uint16_t regReadCmd[] = { addr, reg, I2C_RESTART, addr | 0x1, I2C_READ };
+	// Repeated start and read address are generated by the driver
+	uint8_t regReadCmd[] = { addr, reg };
 	uint8_t recv_data;
 
 	// Request single register byte
-	while ( i2c_read( bus, regReadCmd, sizeof( regReadCmd ) / 2, &recv_data ) == -1 )
+	while ( i2c_read( bus, regReadCmd, sizeof( regReadCmd ), &recv_data, 1 ) == -1 )
 		delay_us( ISSI_SendDelay );
 
 #if ISSI_Chip_31FL3731_define == 1 || ISSI_Chip_31FL3732_define == 1
@@ -506,29 +708,39 @@ void LED_reset()
 	GPIO_Ctrl( iirst_pin, GPIO_Type_DriveLow, GPIO_Config_Pullup );
 #endif
 
+#if ISSI_Chip_31FL3733_define == 1
+	// POR (Power-on-Reset)
+	// Clears all registers to default value (i.e. zeros)
+	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
+	{
+		LED_readReg( LED_ChannelMapping[ ch ].bus, LED_ChannelMapping[ ch ].addr, 0x11, ISSI_ConfigPage );
+	}
+#endif
+
+	// Register writes are queued per chip and sent together, see LED_batchRun
+	LED_Batch batch;
+	LED_batchInit( &batch );
+
 	// Clear LED Pages
 	// Enable LEDs based upon mask
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		uint8_t addr = LED_ChannelMapping[ ch ].addr;
-		uint8_t bus = LED_ChannelMapping[ ch ].bus;
-
 #if ISSI_Chip_31FL3733_define == 1
-		// POR (Power-on-Reset)
-		// Clears all registers to default value (i.e. zeros)
-		LED_readReg( bus, addr, 0x11, ISSI_ConfigPage );
-
 		// Set the enable mask
-		LED_sendPage(
-			bus,
-			addr,
-			(uint16_t*)&LED_ledEnableMask[ ch ],
-			sizeof( LED_EnableBuffer ) / 2,
-			0
+		LED_batchSend(
+			&batch,
+			ch,
+			0,
+			LED_ledEnableMask[ ch ].reg_addr,
+			(const uint8_t*)LED_ledEnableMask[ ch ].buffer,
+			LED_EnableBufferLength
 		);
 #else
 		// Clear LED control pages
-		LED_zeroPages( bus, addr, 0x00, ISSI_LEDPages, 0x00, ISSI_PageLength ); // LED Registers
+		for ( uint8_t page = 0; page < ISSI_LEDPages; page++ )
+		{
+			LED_batchZero( &batch, ch, page, 0x00, ISSI_PageLength ); // LED Registers
+		}
 
 		// Copy enable mask to send buffer
 		for ( uint8_t reg = 0; reg < LED_EnableBufferLength; reg++ )
@@ -546,30 +758,21 @@ void LED_reset()
 	// Set global brightness control
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		uint8_t addr = LED_ChannelMapping[ ch ].addr;
-		uint8_t bus = LED_ChannelMapping[ ch ].bus;
-
-		LED_writeReg( bus, addr, 0x01, LED_brightness, ISSI_ConfigPage );
-		LED_writeReg( bus, addr, 0x0F, 0x07, ISSI_ConfigPage ); // Pull-up
-		LED_writeReg( bus, addr, 0x10, 0x07, ISSI_ConfigPage ); // Pull-down
+		LED_batchWrite( &batch, ch, 0x01, LED_brightness, ISSI_ConfigPage );
+		LED_batchWrite( &batch, ch, 0x0F, 0x07, ISSI_ConfigPage ); // Pull-up
+		LED_batchWrite( &batch, ch, 0x10, 0x07, ISSI_ConfigPage ); // Pull-down
 	}
 #elif ISSI_Chip_31FL3732_define == 1
 	// Set global brightness control
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		uint8_t addr = LED_ChannelMapping[ ch ].addr;
-		uint8_t bus = LED_ChannelMapping[ ch ].bus;
-
-		LED_writeReg( bus, addr, 0x04, LED_brightness, ISSI_ConfigPage );
+		LED_batchWrite( &batch, ch, 0x04, LED_brightness, ISSI_ConfigPage );
 	}
 #endif
 
 	// Setup ISSI frame and sync modes; then disable software shutdown
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		uint8_t addr = LED_ChannelMapping[ ch ].addr;
-		uint8_t bus = LED_ChannelMapping[ ch ].bus;
-
 #if ISSI_Chip_31FL3733_define == 1
 		// Enable master sync for the last chip and disable software shutdown
 		// XXX (HaaTa); The last chip is used as it is the last chip all of the frame data is sent to
@@ -577,37 +780,39 @@ void LED_reset()
 		// between frames.
 		if ( ch == ISSI_Chips_define - 1 )
 		{
-			LED_writeReg( bus, addr, 0x00, 0x41, ISSI_ConfigPage );
+			LED_batchWrite( &batch, ch, 0x00, 0x41, ISSI_ConfigPage );
 		}
 		// Slave sync for the rest and disable software shutdown
 		else
 		{
-			LED_writeReg( bus, addr, 0x00, 0x81, ISSI_ConfigPage );
+			LED_batchWrite( &batch, ch, 0x00, 0x81, ISSI_ConfigPage );
 		}
 
 #elif ISSI_Chip_31FL3732_define == 1
 		// Enable master sync for the first chip
 		if ( ch == 0 )
 		{
-			LED_writeReg( bus, addr, 0x00, 0x40, ISSI_ConfigPage );
+			LED_batchWrite( &batch, ch, 0x00, 0x40, ISSI_ConfigPage );
 		}
 		// Slave sync for the rest
 		else
 		{
-			LED_writeReg( bus, addr, 0x00, 0x80, ISSI_ConfigPage );
+			LED_batchWrite( &batch, ch, 0x00, 0x80, ISSI_ConfigPage );
 		}
 
 		// Disable Software shutdown of ISSI chip
-		LED_writeReg( bus, addr, 0x0A, 0x01, ISSI_ConfigPage );
+		LED_batchWrite( &batch, ch, 0x0A, 0x01, ISSI_ConfigPage );
 #else
 		// Set MODE to Picture Frame
-		LED_writeReg( bus, addr, 0x00, 0x00, ISSI_ConfigPage );
+		LED_batchWrite( &batch, ch, 0x00, 0x00, ISSI_ConfigPage );
 
 		// Disable Software shutdown of ISSI chip
-		LED_writeReg( bus, addr, 0x0A, 0x01, ISSI_ConfigPage );
+		LED_batchWrite( &batch, ch, 0x0A, 0x01, ISSI_ConfigPage );
 #endif
 	}
 
+	LED_batchRun( &batch );
+
 	// Force PixelMap to be ready for the next frame
 	Pixel_FrameState = FrameState_Update;
 
@@ -697,6 +902,8 @@ inline void LED_setup()
 
 	// Initialize framerate
 	LED_framerate = ISSI_FrameRate_ms_define;
+	LED_framerateBackoff = 0;
+	LED_cleanFrames = 0;
 
 	// Global brightness setting
 	LED_brightness = ISSI_Global_Brightness_define;
@@ -778,42 +985,72 @@ inline void LED_setup()
 
 
 // LED Linked Send
-// Call-back for i2c write when updating led display
-// TODO Optimize linked send for multiple i2c buses
-uint8_t LED_chipSend;
-void LED_linkedSend()
+// Each I2C bus runs its own send chain, so chips on different buses are sent concurrently
+// Call-back for i2c write when updating led display, data is the bus index (bus - ISSI_I2C_FirstBus)
+uint8_t LED_busChip[ ISSI_I2C_Buses_define ];          // Next chip to check on each bus
+volatile uint8_t LED_busSending[ ISSI_I2C_Buses_define ]; // Set while the bus has a send chain in progress
+volatile uint8_t LED_frameAbort;                      // Set to stop all send chains at their next transfer
+
+// Returns 1 if any bus still has a send chain in progress
+uint8_t LED_frameSending()
+{
+	for ( uint8_t bus_index = 0; bus_index < ISSI_I2C_Buses_define; bus_index++ )
+	{
+		if ( LED_busSending[ bus_index ] )
+			return 1;
+	}
+	return 0;
+}
+
+// Mark the send chain of a bus as finished
+// Once every bus has finished, ready to update the frame buffer
+// Each bus only clears its own flag, so this is safe from both the I2C interrupts and LED_scan
+void LED_frameBusDone( uint8_t bus_index )
 {
-	// Check if we've updated all the ISSI chips for this frame
-	if ( LED_chipSend >= ISSI_Chips_define )
+	LED_busSending[ bus_index ] = 0;
+	if ( !LED_frameSending() )
 	{
-		// Now ready to update the frame buffer
 		Pixel_FrameState = FrameState_Update;
+	}
+}
 
-		// Finished sending the buffer, exit linked send
-		return;
+void LED_linkedSend( void *data )
+{
+	uint8_t bus_index = (uint8_t)(uintptr_t)data;
+	uint8_t bus = bus_index + ISSI_I2C_FirstBus_define;
+
+	// Find the next chip on this bus
+	uint8_t chip = LED_busChip[ bus_index ];
+	while ( chip < ISSI_Chips_define && LED_ChannelMapping[ chip ].bus != bus )
+	{
+		chip++;
 	}
 
-	// Update ISSI Frame State
-	Pixel_FrameState = FrameState_Sending;
+	// Check if we've updated all the ISSI chips on this bus, or if the frame was aborted
+	if ( chip >= ISSI_Chips_define || LED_frameAbort )
+	{
+		LED_frameBusDone( bus_index );
 
-	// Lookup bus number
-	uint8_t bus = LED_ChannelMapping[ LED_chipSend ].bus;
+		// Finished sending the buffer, exit linked send
+		return;
+	}
+	LED_busChip[ bus_index ] = chip + 1;
 
 	/*
 	// Debug
 	dbug_msg("Linked Send: chip(");
-	printHex( LED_chipSend );
+	printHex( chip );
 	print(")addr(");
-	printHex( LED_pageBuffer[ LED_chipSend ].i2c_addr );
+	printHex( LED_pageBuffer[ chip ].i2c_addr );
 	print(")reg(");
-	printHex( LED_pageBuffer[ LED_chipSend ].reg_addr );
+	printHex( LED_pageBuffer[ chip ].reg_addr );
 	print(")len(");
-	printHex( sizeof( LED_Buffer ) / 2 );
+	printHex( sizeof( LED_Buffer ) );
 	print(")data[](");
 	//for ( uint8_t c = 0; c < 9; c++ )
-	for ( uint8_t c = 0; c < sizeof( LED_Buffer ) / 2 - 2; c++ )
+	for ( uint8_t c = 0; c < sizeof( LED_Buffer ) - 2; c++ )
 	{
-		printHex( LED_pageBuffer[ LED_chipSend ].buffer[c] );
+		printHex( LED_pageBuffer[ chip ].buffer[c] );
 		print(" ");
 	}
 	print("..)" NL);
@@ -824,25 +1061,134 @@ void LED_linkedSend()
 	//delay_us( delay_tm );
 
 	// Send, and recursively call this function when finished
+	// The bus is released before the callback, so this only retries if the bus is in use elsewhere
 	while ( i2c_send_sequence(
 		bus,
 #if ISSI_Chip_31FL3731_define == 1
 		/* Brightness emulation */
-		(uint16_t*)&LED_pageBuffer_brightness[ LED_chipSend ],
+		(uint8_t*)&LED_pageBuffer_brightness[ chip ],
 #else
-		(uint16_t*)&LED_pageBuffer[ LED_chipSend ],
+		(uint8_t*)&LED_pageBuffer[ chip ],
 #endif
-		sizeof( LED_Buffer ) / 2,
+		sizeof( LED_Buffer ),
+		0,
 		0,
 		LED_linkedSend,
-		0
+		data
 	) == -1 )
 		delay_us( delay_tm );
+}
+
+// Start a send chain on every bus that has ISSI chips
+// Pixel_FrameState is set to FrameState_Update once all buses have finished
+void LED_frameSend()
+{
+	// Update ISSI Frame State
+	Pixel_FrameState = FrameState_Sending;
+	LED_frameAbort = 0;
+
+	// Mark buses in use before starting any chain, a chain may finish before the next is started
+	uint8_t buses = 0;
+	for ( uint8_t bus_index = 0; bus_index < ISSI_I2C_Buses_define; bus_index++ )
+	{
+		LED_busChip[ bus_index ] = 0;
+		for ( uint8_t chip = 0; chip < ISSI_Chips_define; chip++ )
+		{
+			if ( LED_ChannelMapping[ chip ].bus == bus_index + ISSI_I2C_FirstBus_define )
+			{
+				buses |= 1 << bus_index;
+				LED_busSending[ bus_index ] = 1;
+				break;
+			}
+		}
+	}
+
+	// No chips, nothing to send
+	if ( buses == 0 )
+	{
+		Pixel_FrameState = FrameState_Update;
+		return;
+	}
+
+	for ( uint8_t bus_index = 0; bus_index < ISSI_I2C_Buses_define; bus_index++ )
+	{
+		if ( buses & ( 1 << bus_index ) )
+		{
+			LED_linkedSend( (void*)(uintptr_t)bus_index );
+		}
+	}
+}
+
+
+// Recover errored I2C buses
+// Isolated errors only reset the offending bus. Repeated errors step the bus clock down, and once the slowest clock
+// is reached, lower the framerate. This way a marginal chip slows the lighting down instead of constantly resetting it.
+void LED_i2cRecover()
+{
+	LED_cleanFrames = 0;
+
+	for ( uint8_t ch = ISSI_I2C_FirstBus_define; ch < ISSI_I2C_Buses_define + ISSI_I2C_FirstBus_define; ch++ )
+	{
+		volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+		if ( channel->status != I2C_ERROR )
+			continue;
+
+		uint8_t *errors = &LED_i2cErrors[ch - ISSI_I2C_FirstBus_define];
+		if ( ++*errors >= ISSI_I2C_ErrorThreshold_define )
+		{
+			*errors = 0;
+
+			if ( i2c_slowdown( ch ) )
+			{
+				warn_msg("I2C bus ");
+				printInt8( ch );
+				print(" unstable, lowering clock to level ");
+				printInt8( channel->speed_level );
+				print( NL );
+			}
+			else if ( LED_framerateBackoff < LED_FramerateBackoffMax )
+			{
+				LED_framerateBackoff += LED_FramerateBackoffStep;
+				warn_msg("I2C bus ");
+				printInt8( ch );
+				print(" unstable, adding frame delay: ");
+				printInt32( LED_framerateBackoff );
+				print("ms" NL);
+			}
+		}
+
+		i2c_recover( ch );
 
-	// Increment chip position
-	LED_chipSend++;
+		// The send chain of an errored bus never gets its callback, finish it here
+		if ( LED_busSending[ch - ISSI_I2C_FirstBus_define] )
+		{
+			LED_frameBusDone( ch - ISSI_I2C_FirstBus_define );
+		}
+	}
 }
 
+// Undo a single step of I2C error backoff, framerate first, then bus clocks
+void LED_i2cRestore()
+{
+	memset( LED_i2cErrors, 0, sizeof( LED_i2cErrors ) );
+
+	if ( LED_framerateBackoff > 0 )
+	{
+		LED_framerateBackoff = LED_framerateBackoff > LED_FramerateBackoffStep
+			? LED_framerateBackoff - LED_FramerateBackoffStep
+			: 0;
+		return;
+	}
+
+	for ( uint8_t ch = ISSI_I2C_FirstBus_define; ch < ISSI_I2C_Buses_define + ISSI_I2C_FirstBus_define; ch++ )
+	{
+		// Only reconfigure idle buses
+		if ( i2c_busy( ch ) || !i2c_speedup( ch ) )
+			continue;
+
+		i2c_recover( ch );
+	}
+}
 
 // LED State processing loop
 unsigned int LED_currentEvent = 0;
@@ -892,17 +1238,23 @@ inline void LED_scan()
 		goto led_finish_scan;
 	}
 
-	// Check if any I2C buses have errored
-	// Reset the buses and restart the Frame State
+	// Abort any stalled transactions, then check if any I2C buses have errored
+	// Stop the send chains on the other buses, then recover the errored buses
+	// The Frame State is restarted once every chain has stopped
+	i2c_timeout( ISSI_I2C_Timeout_ms_define );
 	if ( i2c_error() )
 	{
-		i2c_reset();
-		Pixel_FrameState = FrameState_Update;
+		LED_frameAbort = 1;
+		LED_i2cRecover();
+		if ( !LED_frameSending() )
+		{
+			Pixel_FrameState = FrameState_Update;
+		}
 	}
 
 	// Only start if we haven't already
 	// And if we've finished updating the buffers
-	if ( Pixel_FrameState == FrameState_Sending )
+	if ( Pixel_FrameState == FrameState_Sending || LED_frameSending() )
 		goto led_finish_scan;
 
 	// Only send frame to ISSI chip if buffers are ready
@@ -911,9 +1263,16 @@ inline void LED_scan()
 
 	// Adjust frame rate (i.e. delay and do something else for a bit)
 	Time duration = Time_duration( LED_timePrev );
-	if ( duration.ms < LED_framerate )
+	if ( duration.ms < LED_framerate + LED_framerateBackoff )
 		goto led_finish_scan;
 
+	// Buses have been stable for a while, undo one step of the error backoff
+	if ( ++LED_cleanFrames >= ISSI_I2C_RecoverFrames_define )
+	{
+		LED_i2cRestore();
+		LED_cleanFrames = 0;
+	}
+
 	// FPS Display
 	if ( LED_displayFPS )
 	{
@@ -965,22 +1324,18 @@ inline void LED_scan()
 
 	// Set the page of all the ISSI chips
 	// This way we can easily link the buffers to send the brightnesses in the background
+	LED_Batch batch;
+	LED_batchInit( &batch );
 	for ( uint8_t ch = 0; ch < ISSI_Chips_define; ch++ )
 	{
-		uint8_t bus = LED_ChannelMapping[ ch ].bus;
-		// Page Setup
-		LED_setupPage(
-			bus,
-			LED_ChannelMapping[ ch ].addr,
-			ISSI_LEDPwmPage
-		);
+		LED_batchPage( &batch, ch, ISSI_LEDPwmPage );
 	}
+	LED_batchRun( &batch );
 
 	// Send current set of buffers
-	// Uses interrupts to send to all the ISSI chips
+	// Uses interrupts to send to all the ISSI chips, one send chain per bus
 	// Pixel_FrameState will be updated when complete
-	LED_chipSend = 0; // Start with chip 0
-	LED_linkedSend();
+	LED_frameSend();
 
 led_finish_scan:
 	// Latency measurement end
@@ -1171,13 +1526,16 @@ void cliFunc_ledReset( char* args )
 #endif
 	i2c_reset();
 
+	// Every bus was reset, none of the send chains will call back
+	memset( (void*)LED_busSending, 0, sizeof( LED_busSending ) );
+
 	// Clear control registers
 	LED_zeroControlPages();
 
 	// Clear buffers
 	for ( uint8_t buf = 0; buf < ISSI_Chips_define; buf++ )
 	{
-		memset( (void*)LED_pageBuffer[ buf ].buffer, 0, LED_BufferLength * 2 );
+		memset( (void*)LED_pageBuffer[ buf ].buffer, 0, LED_BufferLength );
 	}
 
 	// Reset LEDs
@@ -1223,6 +1581,72 @@ void cliFunc_ledFPS( char* args )
 	print("ms");
 }
 
+void cliFunc_ledI2C( char* args )
+{
+	print( NL ); // No \r\n by default after the command is entered
+
+	char* curArgs;
+	char* arg1Ptr;
+	char* arg2Ptr = args;
+
+	curArgs = arg2Ptr;
+	CLI_argumentIsolation( curArgs, &arg1Ptr, &arg2Ptr );
+
+	// Reset counters
+	switch ( *arg1Ptr )
+	{
+	case 'r':
+	case 'R':
+		i2c_clearStats();
+		info_msg("I2C statistics cleared");
+		return;
+	}
+
+	info_msg("Frame delay backoff: ");
+	printInt32( LED_framerateBackoff );
+	print("ms  Clean frames: ");
+	printInt32( LED_cleanFrames );
+
+	for ( uint8_t ch = ISSI_I2C_FirstBus_define; ch < ISSI_I2C_Buses_define + ISSI_I2C_FirstBus_define; ch++ )
+	{
+		volatile I2C_Channel *channel = &( i2c_channels[ch - ISSI_I2C_FirstBus_define] );
+
+		print( NL );
+		info_msg("Bus ");
+		printInt8( ch );
+		print(" Speed level: ");
+		printInt8( channel->speed_level );
+		print(" Status: ");
+		printInt8( channel->status );
+
+		print( NL "  Transactions: ");
+		printInt32( channel->transactions );
+		print(" Sent: ");
+		printInt32( channel->bytes_sent );
+		print(" Read: ");
+		printInt32( channel->bytes_read );
+
+		print( NL "  Errors: ");
+		printInt32( channel->error_count );
+		print(" NACK: ");
+		printInt32( channel->nack_count );
+		print(" Arbitration: ");
+		printInt32( channel->arbl_count );
+		print(" Timeout: ");
+		printInt32( channel->timeout_count );
+
+		// Latency histogram, each bucket doubles
+		print( NL "  Latency:");
+		for ( uint8_t bucket = 0; bucket < I2C_LatencyBuckets; bucket++ )
+		{
+			print( bucket == I2C_LatencyBuckets - 1 ? " >=" : " <" );
+			printInt32( 1 << ( I2C_LatencyBaseShift + bucket - ( bucket == I2C_LatencyBuckets - 1 ) ) );
+			print("us:");
+			printInt32( channel->latency[ bucket ] );
+		}
+	}
+}
+
 void cliFunc_ledToggle( char* args )
 {
 	print( NL ); // No \r\n by default after the command is entered
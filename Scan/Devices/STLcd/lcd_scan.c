@@ -35,6 +35,7 @@
 #include <kll.h>
 
 // Local Includes
+#include "font.h"
 #include "lcd_scan.h"
 
 
@@ -45,23 +46,44 @@
 #define LCD_TOTAL_PAGES 9
 #define LCD_PAGE_LEN 128
 
+// Layer stack display, 4 numbers of 32x32
+#define LCD_LayerGlyphs     4
+#define LCD_LayerGlyphWidth 32
 
+// Short transfers (control sequences, single bytes) are copied into the queue entry
+#define SPI_InlineLen 4
 
-// ----- Macros -----
-
-// Number of entries in the SPI0 TxFIFO
-#define SPI0_TxFIFO_CNT ( ( SPI0_SR & SPI_SR_TXCTR ) >> 12 )
+// DMA channel used for SPI0 Tx (0 and 1 are used by UARTConnect)
+#define SPI_DMA_Channel 2
 
 
 
 // ----- Structs -----
 
+// A0 register select, set before each transfer is started
+typedef enum SPI_Register {
+	SPI_Register_Control = 0, // A0 low
+	SPI_Register_Data    = 1, // A0 high
+} SPI_Register;
+
+// Queued SPI transfer
+// buffer must remain valid until the callback is called (unless len <= SPI_InlineLen)
+typedef struct SPI_Transfer {
+	const uint8_t *buffer;
+	uint16_t len;
+	uint8_t reg; // SPI_Register
+	uint8_t inline_data[SPI_InlineLen];
+	void (*callback_fn)(void*);
+	void *user_data;
+} SPI_Transfer;
+
 // ----- Function Declarations -----
 
 // CLI Functions
 void cliFunc_lcdCmd  ( char* args );
 void cliFunc_lcdColor( char* args );
 void cliFunc_lcdDisp ( char* args );
+void cliFunc_lcdFb   ( char* args );
 void cliFunc_lcdInit ( char* args );
 void cliFunc_lcdTest ( char* args );
 
@@ -72,6 +94,37 @@ void cliFunc_lcdTest ( char* args );
 // Default Image - Displays on startup
 const uint8_t STLcdDefaultImage[] = { STLcdDefaultImage_define };
 
+// Layer number images and backlight colors, if provided by the layout
+#if defined(STLcdNumber0_define)
+static const uint8_t LCD_numbers[10][LCD_LayerGlyphWidth * LCD_TOTAL_VISIBLE_PAGES] = {
+	{ STLcdNumber0_define },
+	{ STLcdNumber1_define },
+	{ STLcdNumber2_define },
+	{ STLcdNumber3_define },
+	{ STLcdNumber4_define },
+	{ STLcdNumber5_define },
+	{ STLcdNumber6_define },
+	{ STLcdNumber7_define },
+	{ STLcdNumber8_define },
+	{ STLcdNumber9_define },
+};
+#endif
+
+#if defined(STLcdNumber0Color_define)
+static const uint16_t LCD_numberColors[10][3] = {
+	{ STLcdNumber0Color_define },
+	{ STLcdNumber1Color_define },
+	{ STLcdNumber2Color_define },
+	{ STLcdNumber3Color_define },
+	{ STLcdNumber4Color_define },
+	{ STLcdNumber5Color_define },
+	{ STLcdNumber6Color_define },
+	{ STLcdNumber7Color_define },
+	{ STLcdNumber8Color_define },
+	{ STLcdNumber9Color_define },
+};
+#endif
+
 // Full Toggle State
 uint8_t cliFullToggleState = 0;
 
@@ -82,6 +135,7 @@ uint8_t cliNormalReverseToggleState = 0;
 CLIDict_Entry( lcdCmd,      "Send byte via SPI, second argument enables a0. Defaults to control." );
 CLIDict_Entry( lcdColor,    "Set backlight color. 3 16-bit numbers: R G B. i.e. 0xFFF 0x1444 0x32" );
 CLIDict_Entry( lcdDisp,     "Write byte(s) to given page starting at given address. i.e. 0x1 0x5 0xFF 0x00" );
+CLIDict_Entry( lcdFb,       "Show the LCD framebuffer and dirty pages." );
 CLIDict_Entry( lcdInit,     "Re-initialize the LCD display." );
 CLIDict_Entry( lcdTest,     "Test out the LCD display." );
 
@@ -89,6 +143,7 @@ CLIDict_Def( lcdCLIDict, "ST LCD Module Commands" ) = {
 	CLIDict_Item( lcdCmd ),
 	CLIDict_Item( lcdColor ),
 	CLIDict_Item( lcdDisp ),
+	CLIDict_Item( lcdFb ),
 	CLIDict_Item( lcdInit ),
 	CLIDict_Item( lcdTest ),
 	{ 0, 0, 0 } // Null entry for dictionary end
@@ -97,10 +152,62 @@ CLIDict_Def( lcdCLIDict, "ST LCD Module Commands" ) = {
 // Latency resource allocation
 static uint8_t stlcdLatencyResource;
 
+// SPI transfer queue
+// Entries are started in order, the head entry is the one currently on the bus
+static volatile SPI_Transfer SPI_queue[STLcdSPIQueueSize_define];
+static volatile uint8_t SPI_queueHead = 0;
+static volatile uint8_t SPI_queueUsed = 0;
+
+// Total bytes sent over SPI
+uint32_t SPI_bytesSent = 0;
+
+// Blank page, used to clear the display without a stack buffer
+static const uint8_t LCD_blankPage[LCD_PAGE_LEN] = { 0 };
+
+// Framebuffer of the visible display, one bit per pixel in display page order
+// Pages are only sent to the display when marked dirty
+uint8_t LCD_framebuffer[LCD_TOTAL_VISIBLE_PAGES][LCD_PAGE_LEN];
+volatile uint8_t LCD_dirtyPages = 0;
+
+// Number of pages sent by LCD_fbFlush
+uint32_t LCD_pagesFlushed = 0;
+
 
 
 // ----- Interrupt Functions -----
 
+void SPI_complete();
+
+#if defined(_kinetis_)
+// DMA has moved all but the final byte into the TxFIFO
+// The final byte is pushed with EOQ so we are notified once it has actually been shifted out
+void dma_ch2_isr()
+{
+	DMA_CINT = SPI_DMA_Channel;
+
+	volatile SPI_Transfer *transfer = &SPI_queue[SPI_queueHead];
+
+	SPI0_RSER = SPI_RSER_EOQF_RE;
+
+	// DMA has just filled the TxFIFO, wait for room (at most one frame) or the EOQ byte would be lost
+	while ( !( SPI0_SR & SPI_SR_TFFF ) );
+	SPI0_PUSHR = transfer->buffer[transfer->len - 1] | SPI_PUSHR_PCS(1) | SPI_PUSHR_EOQ;
+}
+
+// Final byte of the transfer has been sent
+void spi0_isr()
+{
+	if ( !( SPI0_SR & SPI_SR_EOQF ) )
+		return;
+
+	// Clearing EOQF restarts the DSPI for the next transfer
+	SPI0_RSER = 0;
+	SPI0_SR = SPI_SR_EOQF | SPI_SR_TCF;
+
+	SPI_complete();
+}
+#endif
+
 
 
 // ----- Functions -----
@@ -131,6 +238,19 @@ void SPI_setup()
 		| SPI_CTAR_CSSCK(7)
 		| SPI_CTAR_PBR(0) | SPI_CTAR_BR(7);
 
+	// Setup DMA clocks
+	SIM_SCGC6 |= SIM_SCGC6_DMAMUX;
+	SIM_SCGC7 |= SIM_SCGC7_DMA;
+
+	// Route SPI0 Tx requests to the DMA channel
+	DMAMUX0_CHCFG2 = 0;
+	DMA_TCD2_CSR = 0;
+	DMAMUX0_CHCFG2 = DMAMUX_ENABLE | DMAMUX_SOURCE_SPI0_TX;
+
+	// Transfer completion interrupts
+	NVIC_ENABLE_IRQ( IRQ_DMA_CH2 );
+	NVIC_ENABLE_IRQ( IRQ_SPI0 );
+
 #elif defined(_sam_)
 	/*
 	// Power SPI
@@ -154,116 +274,185 @@ void SPI_setup()
 #endif
 }
 
-// Write buffer to SPI FIFO
-void SPI_write( uint8_t *buffer, uint8_t len )
+// Start the transfer at the head of the queue
+// Must be called with the SPI bus idle
+void SPI_start()
 {
+	volatile SPI_Transfer *transfer = &SPI_queue[SPI_queueHead];
+	SPI_bytesSent += transfer->len;
 
-	for ( uint8_t byte = 0; byte < len; byte++ )
-	{
+	// Set A0 now that the previous transfer has completely shifted out
 #if defined(_kinetis_)
-		// Wait for SPI TxFIFO to have 4 or fewer entries
-		while ( !( SPI0_SR & SPI_SR_TFFF ) )
-			delay_us(10);
+	if ( transfer->reg == SPI_Register_Data )
+		GPIOC_PSOR = (1<<7);
+	else
+		GPIOC_PCOR = (1<<7);
 
-		// Write byte to TxFIFO
-		// CS0, CTAR0
-		SPI0_PUSHR = ( buffer[ byte ] & 0xff ) | SPI_PUSHR_PCS(1);
+	// Single byte, no need for DMA
+	if ( transfer->len == 1 )
+	{
+		SPI0_RSER = SPI_RSER_EOQF_RE;
+		SPI0_PUSHR = transfer->buffer[0] | SPI_PUSHR_PCS(1) | SPI_PUSHR_EOQ;
+		return;
+	}
 
-		// Indicate transfer has completed
-		while ( !( SPI0_SR & SPI_SR_TCF ) );
-		SPI0_SR |= SPI_SR_TCF;
+	// DMA all but the last byte into the TxFIFO, see dma_ch2_isr
+	// 8-bit writes to PUSHR re-use the command half-word (CS0, CTAR0)
+	// Rewritten every transfer, the EOQ pushes leave EOQ set in the command half-word
+	*(volatile uint16_t*)((uint32_t)&SPI0_PUSHR + 2) = SPI_PUSHR_PCS(1) >> 16;
+
+	DMA_TCD2_SADDR = (void*)transfer->buffer;
+	DMA_TCD2_SOFF = 1;
+	DMA_TCD2_ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);
+	DMA_TCD2_NBYTES_MLNO = 1;
+	DMA_TCD2_SLAST = 0;
+	DMA_TCD2_DADDR = (void*)&SPI0_PUSHR;
+	DMA_TCD2_DOFF = 0;
+	DMA_TCD2_CITER_ELINKNO = transfer->len - 1;
+	DMA_TCD2_BITER_ELINKNO = transfer->len - 1;
+	DMA_TCD2_DLASTSGA = 0;
+	DMA_TCD2_CSR = DMA_TCD_CSR_INTMAJOR | DMA_TCD_CSR_DREQ;
+
+	// TxFIFO fill requests go to the DMA
+	SPI0_RSER = SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
+	DMA_SERQ = SPI_DMA_Channel;
 #elif defined(_sam_)
-		/*
+	if ( transfer->reg == SPI_Register_Data )
+		PIOC->PIO_SODR = (1<<7);
+	else
+		PIOC->PIO_CODR = (1<<7);
+
+	/*
+	for ( uint16_t byte = 0; byte < transfer->len; byte++ )
+	{
 		// Wait for transmit register to be empty
 		while (!(SPI0->SPI_SR & SPI_SR_TDRE));
 		// Send data to transmit register
-		SPI0->SPI_TDR = data;
-		*/
-#endif
+		SPI0->SPI_TDR = transfer->buffer[ byte ];
 	}
+	*/
+	SPI_complete();
+#else
+	SPI_complete();
+#endif
 }
 
-// Write to a control register
-void LCD_writeControlReg( uint8_t byte )
+// Current transfer has finished, notify and start the next one
+// Called from interrupt context
+void SPI_complete()
 {
-#if defined(_kinetis_)
-	// Wait for TxFIFO to be empt
-	while ( SPI0_TxFIFO_CNT != 0 );
+	volatile SPI_Transfer *transfer = &SPI_queue[SPI_queueHead];
+	void (*callback_fn)(void*) = transfer->callback_fn;
+	void *user_data = transfer->user_data;
 
-	// Set A0 low to enter control register mode
-	GPIOC_PCOR |= (1<<7);
+	// Release entry before the callback, so it may queue more data
+	SPI_queueHead = ( SPI_queueHead + 1 ) % STLcdSPIQueueSize_define;
+	SPI_queueUsed--;
 
-	// Write byte to SPI FIFO
-	SPI_write( &byte, 1 );
+	if ( callback_fn )
+	{
+		callback_fn( user_data );
+	}
 
-	// Wait for TxFIFO to be empty
-	while ( SPI0_TxFIFO_CNT != 0 );
+	// Next transfer
+	if ( SPI_queueUsed > 0 )
+	{
+		SPI_start();
+	}
+}
 
-	// Make sure data has transferred
-	delay_us(10); // XXX Adjust if SPI speed changes
+// Queue an SPI transfer, A0 is set to reg before the transfer starts
+// Returns -1 if the queue is full
+int8_t SPI_send( uint8_t reg, const uint8_t *buffer, uint16_t len, void (*callback_fn)(void*), void *user_data )
+{
+	if ( len == 0 )
+		return 0;
 
-	// Set A0 high to go back to display register mode
-	GPIOC_PSOR |= (1<<7);
-#elif defined(_sam_)
-	// Set A0 low to enter control register mode
-	PIOC->PIO_CODR= (1<<7);
+#if defined(_kinetis_)
+	__disable_irq();
+#endif
+	if ( SPI_queueUsed >= STLcdSPIQueueSize_define )
+	{
+#if defined(_kinetis_)
+		__enable_irq();
+#endif
+		return -1;
+	}
 
-	// Write byte to SPI FIFO
-	SPI_write( &byte, 1 );
+	volatile SPI_Transfer *transfer = &SPI_queue[( SPI_queueHead + SPI_queueUsed ) % STLcdSPIQueueSize_define];
 
-	// Make sure data has transferred
-	delay_us(10); // XXX Adjust if SPI speed changes
+	// Copy small transfers so the caller may use stack buffers
+	if ( len <= SPI_InlineLen )
+	{
+		for ( uint8_t byte = 0; byte < len; byte++ )
+			transfer->inline_data[ byte ] = buffer[ byte ];
+		transfer->buffer = (const uint8_t*)transfer->inline_data;
+	}
+	else
+	{
+		transfer->buffer = buffer;
+	}
+	transfer->len = len;
+	transfer->reg = reg;
+	transfer->callback_fn = callback_fn;
+	transfer->user_data = user_data;
 
-	// Set A0 high to go back to display register mode
-	PIOC->PIO_SODR= (1<<7);
+	// Start immediately if the bus is idle
+	if ( SPI_queueUsed++ == 0 )
+	{
+		SPI_start();
+	}
+#if defined(_kinetis_)
+	__enable_irq();
 #endif
+
+	return 0;
 }
 
-// Write to a data register with a0 bit high
-void LCD_writeDataReg( uint8_t byte )
+// Queue an SPI transfer, waiting for space in the queue if necessary
+void SPI_queueWait( uint8_t reg, const uint8_t *buffer, uint16_t len )
 {
-#if defined(_kinetis_)
-	// Wait for TxFIFO to be empt
-	while ( SPI0_TxFIFO_CNT != 0 );
-
-	// Set A0 high to enter display register mode
-	GPIOC_PSOR |= (1<<7);
-
-	// Write byte to SPI FIFO
-	SPI_write( &byte, 1 );
-
-	// Wait for TxFIFO to be empty
-	while ( SPI0_TxFIFO_CNT != 0 );
+	while ( SPI_send( reg, buffer, len, 0, 0 ) == -1 );
+}
 
-	// Make sure data has transferred
-	delay_us(10); // XXX Adjust if SPI speed changes
-#elif defined(_sam_)
-	// Set A0 high to enter display register mode
-	PIOC->PIO_SODR= (1<<7);
+// Queue display data
+// buffer must remain valid until sent if longer than SPI_InlineLen
+void SPI_write( const uint8_t *buffer, uint16_t len )
+{
+	SPI_queueWait( SPI_Register_Data, buffer, len );
+}
 
-	// Write byte to SPI FIFO
-	SPI_write( &byte, 1 );
+// Write to a control register
+void LCD_writeControlReg( uint8_t byte )
+{
+	SPI_queueWait( SPI_Register_Control, &byte, 1 );
+}
 
-	// Make sure data has transferred
-	delay_us(10); // XXX Adjust if SPI speed changes
-#endif
+// Write to a data register with a0 bit high
+void LCD_writeDataReg( uint8_t byte )
+{
+	SPI_queueWait( SPI_Register_Data, &byte, 1 );
+}
 
+// Set page, start line and column address in a single control transfer
+void LCD_setPage( uint8_t page )
+{
+	uint8_t cmd[] = {
+		0xB0 | ( 0x0F & page ), // Register page
+		0x40,                   // Display start line
+		0x10,                   // Column address
+		0x00,
+	};
+	SPI_queueWait( SPI_Register_Control, cmd, sizeof( cmd ) );
 }
 
 // Write to display register
 // Pages 0-7 normal display
 // Page  8   icon buffer
-void LCD_writeDisplayReg( uint8_t page, uint8_t *buffer, uint8_t len )
+// buffer must remain valid until sent
+void LCD_writeDisplayReg( uint8_t page, const uint8_t *buffer, uint8_t len )
 {
-	// Set the register page
-	LCD_writeControlReg( 0xB0 | ( 0x0F & page ) );
-
-	// Set display start line
-	LCD_writeControlReg( 0x40 );
-
-	// Reset Column Address
-	LCD_writeControlReg( 0x10 );
-	LCD_writeControlReg( 0x00 );
+	LCD_setPage( page );
 
 	// Write buffer to SPI
 	SPI_write( buffer, len );
@@ -271,49 +460,141 @@ void LCD_writeDisplayReg( uint8_t page, uint8_t *buffer, uint8_t len )
 
 void LCD_clearPage( uint8_t page )
 {
-	// Set the register page
-	LCD_writeControlReg( 0xB0 | ( 0x0F & page ) );
+	LCD_writeDisplayReg( page, LCD_blankPage, LCD_PAGE_LEN );
+}
+
+// Clear Display
+void LCD_clear()
+{
+	// Setup each page
+	for ( uint8_t page = 0; page < LCD_TOTAL_PAGES; page++ )
+	{
+		LCD_clearPage( page );
+	}
+
+	// Reset Page, Start Line, and Column Address
+	LCD_setPage( 0 );
+
+	// Display RAM now matches an empty framebuffer
+	memset( LCD_framebuffer, 0, sizeof( LCD_framebuffer ) );
+	LCD_dirtyPages = 0;
+}
 
-	// Set display start line
-	LCD_writeControlReg( 0x40 );
 
-	// Reset Column Address
-	LCD_writeControlReg( 0x10 );
-	LCD_writeControlReg( 0x00 );
 
-	for ( uint8_t page_reg = 0; page_reg < LCD_PAGE_LEN; page_reg++ )
+// ----- Framebuffer -----
+
+// Write a framebuffer byte, marking the page dirty only if it changed
+static inline void LCD_fbWrite( uint8_t page, uint8_t col, uint8_t val )
+{
+	if ( LCD_framebuffer[ page ][ col ] != val )
 	{
-		uint8_t byte = 0;
+		LCD_framebuffer[ page ][ col ] = val;
+		LCD_dirtyPages |= 1 << page;
+	}
+}
 
-		// Write buffer to SPI
-		SPI_write( &byte, 1 );
+// Clear framebuffer
+void LCD_fbClear()
+{
+	for ( uint8_t page = 0; page < LCD_TOTAL_VISIBLE_PAGES; page++ )
+	{
+		for ( uint8_t col = 0; col < LCD_PAGE_LEN; col++ )
+		{
+			LCD_fbWrite( page, col, 0 );
+		}
 	}
+}
 
-	// Wait for TxFIFO to be empty
-#if defined(_kinetis_)
-	while ( SPI0_TxFIFO_CNT != 0 );
-#endif
+// Set or clear a single pixel
+void LCD_fbPixel( uint8_t x, uint8_t y, uint8_t on )
+{
+	if ( x >= LCD_WIDTH || y >= LCD_HEIGHT )
+		return;
+
+	uint8_t page = y >> 3;
+	uint8_t mask = 1 << ( y & 0x7 );
+	uint8_t val = LCD_framebuffer[ page ][ x ];
+
+	LCD_fbWrite( page, x, on ? val | mask : val & ~mask );
 }
 
-// Clear Display
-void LCD_clear()
+// Copy a page aligned bitmap into the framebuffer
+// data is laid out the same as the display, pages rows of width bytes
+// Clipped to the display
+void LCD_fbBlit( uint8_t x, uint8_t page, const uint8_t *data, uint8_t width, uint8_t pages )
 {
-	// Setup each page
-	for ( uint8_t page = 0; page < LCD_TOTAL_PAGES; page++ )
+	for ( uint8_t row = 0; row < pages && page + row < LCD_TOTAL_VISIBLE_PAGES; row++ )
 	{
-		LCD_clearPage( page );
+		for ( uint8_t col = 0; col < width && x + col < LCD_WIDTH; col++ )
+		{
+			LCD_fbWrite( page + row, x + col, data[ row * width + col ] );
+		}
 	}
+}
 
-	// Reset Page, Start Line, and Column Address
-	// Page
-	LCD_writeControlReg( 0xB0 );
+// Draw a character using the 5x7 font, the cell (including spacing) is drawn with the background cleared
+// Returns the x position of the next character
+uint8_t LCD_fbChar( uint8_t x, uint8_t y, char c )
+{
+	// Unknown characters are drawn as ?
+	if ( c < LCD_FontFirst || c > LCD_FontLast )
+	{
+		c = '?';
+	}
+	const uint8_t *glyph = LCD_font[ c - LCD_FontFirst ];
 
-	// Start Line
-	LCD_writeControlReg( 0x40 );
+	for ( uint8_t col = 0; col < LCD_FontWidth + LCD_FontSpacing; col++ )
+	{
+		uint8_t bits = col < LCD_FontWidth ? glyph[ col ] : 0;
 
-	// Reset Column Address
-	LCD_writeControlReg( 0x10 );
-	LCD_writeControlReg( 0x00 );
+		// Page aligned, write the column directly
+		if ( ( y & 0x7 ) == 0 && x + col < LCD_WIDTH && y < LCD_HEIGHT )
+		{
+			uint8_t page = y >> 3;
+			uint8_t mask = ( 1 << ( LCD_FontHeight + 1 ) ) - 1;
+			LCD_fbWrite( page, x + col, ( LCD_framebuffer[ page ][ x + col ] & ~mask ) | bits );
+			continue;
+		}
+
+		for ( uint8_t row = 0; row < LCD_FontHeight + 1; row++ )
+		{
+			LCD_fbPixel( x + col, y + row, bits & ( 1 << row ) );
+		}
+	}
+
+	return x + LCD_FontWidth + LCD_FontSpacing;
+}
+
+// Draw a string, no wrapping
+// Returns the x position after the last character
+uint8_t LCD_fbText( uint8_t x, uint8_t y, const char *str )
+{
+	while ( *str != '\0' && x < LCD_WIDTH )
+	{
+		x = LCD_fbChar( x, y, *str++ );
+	}
+
+	return x;
+}
+
+// Send dirty pages to the display
+// Waits until the previous flush has been sent, as the queue references the framebuffer directly
+void LCD_fbFlush()
+{
+	if ( LCD_dirtyPages == 0 || SPI_queueUsed > 0 )
+		return;
+
+	for ( uint8_t page = 0; page < LCD_TOTAL_VISIBLE_PAGES; page++ )
+	{
+		if ( !( LCD_dirtyPages & ( 1 << page ) ) )
+			continue;
+
+		// Clear first, so any change during the transfer is sent again
+		LCD_dirtyPages &= ~( 1 << page );
+		LCD_writeDisplayReg( page, LCD_framebuffer[ page ], LCD_PAGE_LEN );
+		LCD_pagesFlushed++;
+	}
 }
 
 // Intialize display
@@ -389,10 +670,8 @@ inline void LCD_setup()
 	LCD_initialize();
 
 	// Write default image to LCD
-	for ( uint8_t page = 0; page < LCD_TOTAL_VISIBLE_PAGES; page++ )
-	{
-		LCD_writeDisplayReg( page, (uint8_t*)&STLcdDefaultImage[page * LCD_PAGE_LEN], LCD_PAGE_LEN );
-	}
+	LCD_fbBlit( 0, 0, STLcdDefaultImage, LCD_PAGE_LEN, LCD_TOTAL_VISIBLE_PAGES );
+	LCD_fbFlush();
 
 #if defined(_kinetis_)
 	// Setup Backlight
@@ -509,6 +788,9 @@ inline uint8_t LCD_scan()
 
 	check_caps_lock();
 
+	// Send any framebuffer changes
+	LCD_fbFlush();
+
 	// Latency measurement end
 	Latency_end_time( stlcdLatencyResource );
 
@@ -546,7 +828,7 @@ uint8_t LCD_layerStackExact_size = 0;
 typedef struct LCD_layerStackExact_args {
 	uint8_t numArgs;
 	uint16_t layers[4];
-} LCD_layerStackExact_args;
+} __attribute__((packed)) LCD_layerStackExact_args;
 void LCD_layerStackExact_capability( TriggerMacro *trigger, uint8_t state, uint8_t stateType, uint8_t *args )
 {
 	CapabilityState cstate = KLL_CapabilityState( state, stateType );
@@ -569,83 +851,54 @@ void LCD_layerStackExact_capability( TriggerMacro *trigger, uint8_t state, uint8
 	// Read arguments
 	LCD_layerStackExact_args *stack_args = (LCD_layerStackExact_args*)args;
 
-	// Number data for LCD
-	const uint8_t numbers[10][128] = {
-		{ STLcdNumber0_define },
-		{ STLcdNumber1_define },
-		{ STLcdNumber2_define },
-		{ STLcdNumber3_define },
-		{ STLcdNumber4_define },
-		{ STLcdNumber5_define },
-		{ STLcdNumber6_define },
-		{ STLcdNumber7_define },
-		{ STLcdNumber8_define },
-		{ STLcdNumber9_define },
-	};
-
-	// Color data for numbers
-	const uint16_t colors[10][3] = {
-		{ STLcdNumber0Color_define },
-		{ STLcdNumber1Color_define },
-		{ STLcdNumber2Color_define },
-		{ STLcdNumber3Color_define },
-		{ STLcdNumber4Color_define },
-		{ STLcdNumber5Color_define },
-		{ STLcdNumber6Color_define },
-		{ STLcdNumber7Color_define },
-		{ STLcdNumber8Color_define },
-		{ STLcdNumber9Color_define },
-	};
-
 	// Only display if there are layers active
 	if ( stack_args->numArgs > 0 )
 	{
 		// Set the color according to the "top-of-stack" layer
 		uint16_t layerIndex = stack_args->layers[0];
-#if defined(_kinetis_)
-		FTM0_C0V = colors[ layerIndex ][0];
-		FTM0_C1V = colors[ layerIndex ][1];
-		FTM0_C2V = colors[ layerIndex ][2];
+#if defined(_kinetis_) && defined(STLcdNumber0Color_define)
+		if ( layerIndex > 9 )
+		{
+			layerIndex = 0;
+		}
+		FTM0_C0V = LCD_numberColors[ layerIndex ][0];
+		FTM0_C1V = LCD_numberColors[ layerIndex ][1];
+		FTM0_C2V = LCD_numberColors[ layerIndex ][2];
 #elif defined(_sam_)
 		//SAM TODO
 #endif
 
-		// Iterate through each of the pages
-		// XXX Many of the values here are hard-coded
-		//     Eventually a proper font rendering engine should take care of things like this... -HaaTa
-		for ( uint8_t page = 0; page < LCD_TOTAL_VISIBLE_PAGES; page++ )
+		// Draw each layer number, top of stack on the left
+		for ( uint8_t layer = 0; layer < LCD_LayerGlyphs; layer++ )
 		{
-			// Set the register page
-			LCD_writeControlReg( 0xB0 | ( 0x0F & page ) );
-
-			// Set starting address
-			LCD_writeControlReg( 0x10 );
-			LCD_writeControlReg( 0x00 );
+			uint8_t x = layer * LCD_LayerGlyphWidth;
 
-			// Write data
-			for ( uint16_t layer = 0; layer < stack_args->numArgs; layer++ )
+			// Blank out rest of display
+			if ( layer >= stack_args->numArgs )
 			{
-				layerIndex = stack_args->layers[ layer ];
-
-				// Default to 0, if over 9
-				if ( layerIndex > 9 )
-				{
-					layerIndex = 0;
-				}
-
-				// Write page of number to display
-				SPI_write( (uint8_t*)&numbers[ layerIndex ][ page * 32 ], 32 );
+				LCD_fbBlit( x, 0, LCD_blankPage, LCD_LayerGlyphWidth, LCD_TOTAL_VISIBLE_PAGES );
+				continue;
 			}
 
-			// Blank out rest of display
-			uint8_t data = 0;
-			for ( uint8_t c = 0; c < 4 - stack_args->numArgs; c++ )
+			layerIndex = stack_args->layers[ layer ];
+
+			// Default to 0, if over 9
+			if ( layerIndex > 9 )
 			{
-				for ( uint8_t byte = 0; byte < 32; byte++ )
-				{
-					SPI_write( &data, 1 );
-				}
+				layerIndex = 0;
 			}
+
+#if defined(STLcdNumber0_define)
+			LCD_fbBlit( x, 0, LCD_numbers[ layerIndex ], LCD_LayerGlyphWidth, LCD_TOTAL_VISIBLE_PAGES );
+#else
+			// No number images in the layout, use the font
+			LCD_fbBlit( x, 0, LCD_blankPage, LCD_LayerGlyphWidth, LCD_TOTAL_VISIBLE_PAGES );
+			LCD_fbChar(
+				x + ( LCD_LayerGlyphWidth - LCD_FontWidth ) / 2,
+				( LCD_HEIGHT - LCD_FontHeight ) / 2,
+				'0' + layerIndex
+			);
+#endif
 		}
 	}
 	else
@@ -660,8 +913,7 @@ void LCD_layerStackExact_capability( TriggerMacro *trigger, uint8_t state, uint8
 #endif
 
 		// Write default image
-		for ( uint8_t page = 0; page < LCD_TOTAL_VISIBLE_PAGES; page++ )
-			LCD_writeDisplayReg( page, (uint8_t *)&STLcdDefaultImage[page * LCD_PAGE_LEN], LCD_PAGE_LEN );
+		LCD_fbBlit( 0, 0, STLcdDefaultImage, LCD_PAGE_LEN, LCD_TOTAL_VISIBLE_PAGES );
 	}
 }
 
@@ -746,10 +998,40 @@ void cliFunc_lcdInit( char* args )
 void cliFunc_lcdTest( char* args )
 {
 	// Write default image
-	for ( uint8_t page = 0; page < LCD_TOTAL_VISIBLE_PAGES; page++ )
+	LCD_fbBlit( 0, 0, STLcdDefaultImage, LCD_PAGE_LEN, LCD_TOTAL_VISIBLE_PAGES );
+}
+
+// Show framebuffer, pages waiting to be sent are marked with a *
+void LCD_dispFramebuffer()
+{
+	for ( uint8_t y = 0; y < LCD_HEIGHT; y++ )
 	{
-		LCD_writeDisplayReg( page, (uint8_t *)&STLcdDefaultImage[page * LCD_PAGE_LEN], LCD_PAGE_LEN );
+		uint8_t page = y >> 3;
+		for ( uint8_t x = 0; x < LCD_WIDTH; x++ )
+		{
+			print( LCD_framebuffer[ page ][ x ] & ( 1 << ( y & 0x7 ) ) ? "#" : " " );
+		}
+
+		// Dirty page indicator
+		if ( ( y & 0x7 ) == 0 && LCD_dirtyPages & ( 1 << page ) )
+		{
+			print(" *");
+		}
+		print( NL );
 	}
+
+	info_msg("Pages flushed: ");
+	printInt32( LCD_pagesFlushed );
+	print(" SPI bytes: ");
+	printInt32( SPI_bytesSent );
+	print( NL );
+}
+
+void cliFunc_lcdFb( char* args )
+{
+	print( NL ); // No \r\n by default after the command is entered
+
+	LCD_dispFramebuffer();
 }
 
 void cliFunc_lcdCmd( char* args )
@@ -1,4 +1,4 @@
-/* Copyright (C) 2015-2016 by Jacob Alexander
+/* Copyright (C) 2015-2018 by Jacob Alexander
  *
  * This file is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -23,6 +23,14 @@
 
 
 
+// ----- Defines -----
+
+// Visible display size in pixels
+#define LCD_WIDTH  128
+#define LCD_HEIGHT 32
+
+
+
 // ----- Functions -----
 
 void LCD_setup();
@@ -30,3 +38,11 @@ uint8_t LCD_scan();
 
 void LCD_currentChange( unsigned int current );
 
+// Framebuffer drawing, changes are sent to the display by LCD_scan
+void LCD_fbClear();
+void LCD_fbPixel( uint8_t x, uint8_t y, uint8_t on );
+void LCD_fbBlit( uint8_t x, uint8_t page, const uint8_t *data, uint8_t width, uint8_t pages );
+uint8_t LCD_fbChar( uint8_t x, uint8_t y, char c );
+uint8_t LCD_fbText( uint8_t x, uint8_t y, const char *str );
+void LCD_fbFlush();
+
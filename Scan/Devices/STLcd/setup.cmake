@@ -27,5 +27,6 @@ set( Module_SRCS
 #
 set( ModuleCompatibility
 	arm
+	host
 )
 
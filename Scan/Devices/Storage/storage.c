@@ -45,6 +45,14 @@ CLIDict_Def( storageCLIDict, "Storage Module Commands" ) = {
 
 
 
+// ----- Defines -----
+
+// Module settings are stored in chunks, only changed chunks are written when saving
+// Each chunk is a record in the settings log, keyed by module index and chunk index
+#define StorageChunkSize 8
+
+
+
 // ----- Variables -----
 
 StorageModule* storage_modules[StorageMaxModules];
@@ -60,38 +68,65 @@ void Storage_init() {
 	CLI_registerDictionary( storageCLIDict, storageCLIDictName );
 }
 
+// Compact the settings log while idle, rather than when the next setting is saved
+void Storage_poll() {
+	if (storage_needs_compaction(Storage_CompactThreshold_define)) {
+		storage_compact();
+	}
+}
+
 void Storage_registerModule(StorageModule *config) {
 	storage_modules[module_count++] = config;
 }
 
+// Copy a stored chunk into the module settings
+static void storage_apply(uint8_t module, uint8_t key, const uint8_t* data, uint8_t size) {
+	uint16_t offset = key * StorageChunkSize;
+
+	// Ignore records from a different settings layout
+	if (module >= module_count || offset + size > storage_modules[module]->size) {
+		return;
+	}
+	memcpy((uint8_t*)storage_modules[module]->settings + offset, data, size);
+}
+
+// Stored chunks are applied on top of the defaults
+// Settings that have never been saved keep their default value
 uint8_t storage_load_settings() {
-	uint8_t buffer[STORAGE_SIZE];
+	storage_default_settings();
+	storage_replay(storage_apply);
 
-	uint8_t success = storage_read(buffer, 0, sizeof(buffer)) == 1;
-	if (success) {
-		uint8_t offset = 0;
-		for (uint8_t i=0; i<module_count; i++) {
-			if (storage_is_storage_cleared()) {
-				memcpy(storage_modules[i]->settings, storage_modules[i]->defaults, storage_modules[i]->size);
-			} else {
-				memcpy(storage_modules[i]->settings, buffer+offset, storage_modules[i]->size);
-			}
-			storage_modules[i]->onLoad();
-			offset += storage_modules[i]->size;
-		}
+	for (uint8_t i=0; i<module_count; i++) {
+		storage_modules[i]->onLoad();
 	}
-	return success;
+	return 1;
 }
 
+// Only chunks that differ from the stored value are written
+// Saving a single changed setting appends a single record
 uint8_t storage_save_settings() {
-	uint8_t buffer[STORAGE_SIZE];
-	uint8_t offset = 0;
+	uint8_t success = 1;
+	uint8_t stored[StorageChunkSize];
 	for (uint8_t i=0; i<module_count; i++) {
 		storage_modules[i]->onSave();
-		memcpy(buffer+offset, storage_modules[i]->settings, storage_modules[i]->size);
-		offset += storage_modules[i]->size;
+
+		uint8_t* settings = storage_modules[i]->settings;
+		for (uint16_t offset=0; offset<storage_modules[i]->size; offset+=StorageChunkSize) {
+			uint8_t key = offset / StorageChunkSize;
+			uint8_t size = storage_modules[i]->size - offset;
+			if (size > StorageChunkSize) {
+				size = StorageChunkSize;
+			}
+
+			if (storage_read(i, key, stored, size) == size && memcmp(stored, settings+offset, size) == 0) {
+				continue;
+			}
+			if (storage_write(i, key, settings+offset, size) != 1) {
+				success = 0;
+			}
+		}
 	}
-	return storage_write(buffer, 0, sizeof(buffer), 0) == 1;
+	return success;
 }
 
 void storage_default_settings() {
@@ -103,17 +138,22 @@ void storage_default_settings() {
 void cliFunc_storage( char* args )
 {
 	print( NL );
-	print("Page: ");
-	printHex( storage_page_position() );
-	print(", Block: ");
-	printHex( storage_block_position() );
+	print("Sector: ");
+	printHex( storage_sector_position() );
+	print(", Sequence: ");
+	printHex( storage_sequence() );
 	print( NL );
 	print("Address: ");
 	printHex32((STORAGE_FLASH_START
-		+ storage_page_position() * STORAGE_FLASH_PAGE_SIZE)
-		+ (storage_block_position() * (STORAGE_SIZE + 1))
+		+ storage_sector_position() * STORAGE_SECTOR_SIZE)
+		+ storage_log_position()
 	);
 	print( NL );
+	print("Used: ");
+	printInt16( storage_log_position() );
+	print(", Free: ");
+	printInt16( storage_free() );
+	print( NL );
 	print("Cleared?: ");
 	printInt8( storage_is_storage_cleared() );
 	print( NL );
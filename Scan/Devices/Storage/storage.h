@@ -26,4 +26,5 @@
 // ----- Functions -----
 
 void Storage_init();
+void Storage_poll();
 
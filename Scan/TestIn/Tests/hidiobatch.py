@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+'''
+HID-IO batch packet tests for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+# Reference to callback datastructure
+data = i.control.data
+
+kiibohd = i.control.kiibohd
+
+# HID-IO packet types
+Data = 0
+ACK = 1
+Batch = 5
+
+# HID-IO ids
+InfoId = 0x01
+TestId = 0x02
+
+# Info property, transmit window size
+WindowSize = 0x10
+
+# Must match hidioBatchDeadline
+Deadline = 5
+
+# Current host time (ms)
+now = 0
+
+
+
+### Functions ###
+
+def advance( ms ):
+    '''
+    Move host time forward
+    '''
+    global now
+    now += ms
+    kiibohd.Host_set_systick( now )
+
+
+def batches():
+    '''
+    Pop the Batch packets sent by the device, returns a list of record lists [ ( id, payload ) ]
+    '''
+    packets = []
+    while len( data.rawio_incoming_buffer ) > 0:
+        hdr, idval, payload, raw = data.rawio_incoming_buffer.pop(0)
+        check( hdr.type == Batch )
+
+        body = list( raw[2:2 + hdr.full_len()] )
+        records = []
+        while len( body ) >= 3:
+            size = body[2]
+            records.append( ( body[0] | ( body[1] << 8 ), body[3:3 + size] ) )
+            body = body[3 + size:]
+        packets.append( records )
+    return packets
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+i.control.cmd('setRawIOPacketSize')( 64 )
+i.control.cmd('setRawIOLoopback')( False )
+i.control.loop(1)
+
+
+## Deadline ##
+logger.info(header("-- Batch deadline --"))
+
+for count in range( 10 ):
+    check( i.control.cmd('HIDIO_batch_push')( TestId, [ count, 0xAC, 0xAD ] ) == 1 )
+
+# Held until the deadline
+i.control.loop(1)
+check( len( data.rawio_incoming_buffer ) == 0 )
+
+advance( Deadline )
+i.control.loop(1)
+packets = batches()
+logger.info("Batches: {}", packets)
+check( len( packets ) == 1 )
+check( len( packets[0] ) == 10 )
+check( all( rec[0] == TestId and rec[1] == [ pos, 0xAC, 0xAD ] for pos, rec in enumerate( packets[0] ) ) )
+
+
+## Full packets ##
+logger.info(header("-- Full batches --"))
+
+messages = 25
+for count in range( messages ):
+    i.control.cmd('HIDIO_batch_push')( TestId, [ count, 0xAC, 0xAD ] )
+
+# Full packets are sent straight away
+full = len( data.rawio_incoming_buffer )
+check( full > 0 )
+
+advance( Deadline )
+i.control.loop(1)
+packets = batches()
+logger.info("{} messages in {} packets ({} sent when full)", messages, len( packets ), full)
+check( sum( len( records ) for records in packets ) == messages )
+check( len( packets ) == full + 1 )
+
+# Too large for a single packet
+check( i.control.cmd('HIDIO_batch_push')( TestId, [ 0 ] * 62 ) == 0 )
+
+
+## Receive ##
+logger.info(header("-- Incoming batch --"))
+
+# Set the window, then query it, neither is ACK'd
+i.control.cmd('HIDIO_host_batch')( [ ( InfoId, [ WindowSize, 3 ] ), ( InfoId, [ WindowSize ] ) ] )
+i.control.loop(1)
+logger.info("Incoming Buf: {}", data.rawio_incoming_buffer)
+check( len( data.rawio_incoming_buffer ) == 0 )
+
+# Regular call shows the batched call was applied
+i.control.cmd('HIDIO_host_packet')( Data, InfoId, [ WindowSize ] )
+i.control.loop(1)
+check( len( data.rawio_incoming_buffer ) == 1 )
+hdr, idval, payload, raw = data.rawio_incoming_buffer.pop(0)
+logger.info("Window: {}", list( payload ))
+check( hdr.type == ACK )
+check( list( payload ) == [ WindowSize, 3 ] )
+
+i.control.cmd('HIDIO_host_packet')( Data, InfoId, [ WindowSize, 1 ] )
+i.control.loop(1)
+data.rawio_incoming_buffer.clear()
+
+
+
+### Results ###
+
+result()
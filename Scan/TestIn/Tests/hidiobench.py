@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+'''
+HID-IO throughput and latency benchmark for Host-side KLL
+
+Sweeps packet size, payload size (and with it the number of continued packets) and packet loss.
+Each message is a HIDIO_test_2_request sent in loopback, latency is measured until its final ACK is received.
+Results are written as JSON (HIDIO_BENCH_JSON environment variable, defaults to hidiobench.json).
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import json
+import logging
+import os
+import random
+import time
+
+from ctypes import c_int, c_uint8, c_uint16, c_uint32, c_void_p, Structure
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+# Reference to callback datastructure
+data = i.control.data
+
+kiibohd = i.control.kiibohd
+
+# Sweep
+PacketSizes = [ 8, 16, 32, 64 ]
+Payloads = [ 1, 16, 60, 150 ]
+LossRates = [ 0.0, 0.01, 0.05 ]
+Messages = 20
+
+# Each HIDIO_process call is one ms of host time (drives the retransmit timer)
+LoopMs = 1
+
+# Give up on a message after this many loops (well past hidioMaxRetries timeouts)
+LoopLimit = 5000
+
+# Fixed seed, so packet loss is the same between runs
+Seed = 0x4849
+
+# HID-IO ids
+TestId = 0x02
+
+# Output file
+OutputFile = os.environ.get( 'HIDIO_BENCH_JSON', 'hidiobench.json' )
+
+
+# C structures (see Output/HID-IO/hidio_com.h and hidio_com.c)
+class HIDIO_Buffer( Structure ):
+    _fields_ = [
+        ( 'head',          c_uint16 ),
+        ( 'tail',          c_uint16 ),
+        ( 'cur_buf_head',  c_uint16 ),
+        ( 'waiting',       c_uint8 ),
+        ( 'len',           c_uint16 ),
+        ( 'packets_ready', c_uint16 ),
+        ( 'data',          c_void_p ),
+    ]
+
+class HIDIO_Window( Structure ):
+    _fields_ = [
+        ( 'state',       c_int ),
+        ( 'size',        c_uint8 ),
+        ( 'in_flight',   c_uint8 ),
+        ( 'retries',     c_uint8 ),
+        ( 'next',        c_uint16 ),
+        ( 'sent_ms',     c_uint32 ),
+        ( 'sent_ticks',  c_uint32 ),
+        ( 'packets',     c_uint32 ),
+        ( 'retransmits', c_uint32 ),
+        ( 'timeouts',    c_uint32 ),
+        ( 'dropped',     c_uint32 ),
+    ]
+
+class HIDIO_Id_Entry( Structure ):
+    _fields_ = [
+        ( 'id',         c_uint32 ),
+        ( 'call_func',  c_void_p ),
+        ( 'reply_func', c_void_p ),
+        ( 'calls',      c_uint32 ),
+        ( 'replies',    c_uint32 ),
+        ( 'time_us',    c_uint32 ),
+        ( 'max_us',     c_uint32 ),
+    ]
+
+tx_buf = HIDIO_Buffer.in_dll( kiibohd, 'HIDIO_tx_buf' )
+tx_window = HIDIO_Window.in_dll( kiibohd, 'HIDIO_tx_window' )
+
+
+
+### Functions ###
+
+now = 0
+
+def process():
+    '''
+    Run HIDIO_process once, returns CPU time in ns
+    '''
+    global now
+    start = time.perf_counter_ns()
+    kiibohd.HIDIO_process()
+    elapsed = time.perf_counter_ns() - start
+
+    now += LoopMs
+    kiibohd.Host_set_systick( now )
+    return elapsed
+
+
+def delivered():
+    '''
+    Number of test messages fully received (loopback receive side)
+    '''
+    size = c_uint32.in_dll( kiibohd, 'HIDIO_Id_List_Size' ).value
+    entries = ( HIDIO_Id_Entry * size ).in_dll( kiibohd, 'HIDIO_Id_List' )
+    return next( entry.calls for entry in entries if entry.id == TestId )
+
+
+def lose( rng, rate ):
+    '''
+    Drop packets sent during the last loop, returns the number dropped
+    '''
+    kept = [ pkt for pkt in data.rawio_outgoing_buffer if rng.random() >= rate ]
+    dropped = len( data.rawio_outgoing_buffer ) - len( kept )
+    data.rawio_outgoing_buffer[:] = kept
+    return dropped
+
+
+def percentiles( values ):
+    '''
+    p50, p90, p99 and max of a list of values
+    '''
+    values = sorted( values )
+    pick = lambda pct: values[ min( len( values ) - 1, int( len( values ) * pct / 100 ) ) ]
+    return { 'p50': pick( 50 ), 'p90': pick( 90 ), 'p99': pick( 99 ), 'max': values[-1] }
+
+
+def run( packet_size, payload, loss ):
+    '''
+    Send Messages test messages, one at a time, returns a result dictionary
+    Returns None if a message doesn't fit in the tx buffer
+    '''
+    # Each packet has a 2 byte header and a 16 bit id
+    packets = -( -payload // ( packet_size - 4 ) )
+    if payload + 4 * packets > tx_buf.len:
+        return None
+
+    i.control.cmd('setRawIOPacketSize')( packet_size )
+    rng = random.Random( Seed )
+
+    start_delivered = delivered()
+    start_window = HIDIO_Window.from_buffer_copy( tx_window )
+
+    latency_ms = []
+    latency_us = []
+    lost = 0
+    stuck = 0
+    total_ns = 0
+    for count in range( Messages ):
+        i.control.cmd('HIDIO_test_2_request')( payload, 0xAC )
+
+        loops = 0
+        cpu = 0
+        while True:
+            cpu += process()
+            loops += 1
+            lost += lose( rng, loss )
+
+            # Final ACK received, and nothing left on the wire
+            if tx_buf.packets_ready == 0 and len( data.rawio_outgoing_buffer ) == 0:
+                break
+            if loops >= LoopLimit:
+                stuck += 1
+                break
+
+        latency_ms.append( loops * LoopMs )
+        latency_us.append( cpu / 1000 )
+        total_ns += cpu
+
+    received = delivered() - start_delivered
+    sent_bytes = received * payload
+    total_ms = sum( latency_ms )
+
+    return {
+        'packet_size': packet_size,
+        'payload': payload,
+        'packets_per_message': packets,
+        'loss': loss,
+        'messages': Messages,
+        'delivered': received,
+        'stuck': stuck,
+        'packets_lost': lost,
+        'packets_sent': tx_window.packets - start_window.packets,
+        'retransmits': tx_window.retransmits - start_window.retransmits,
+        'timeouts': tx_window.timeouts - start_window.timeouts,
+        'dropped': tx_window.dropped - start_window.dropped,
+        'throughput_bytes_per_ms': sent_bytes / total_ms,
+        'throughput_bytes_per_s': sent_bytes / ( total_ns / 1e9 ) if total_ns > 0 else 0,
+        'latency_ms': percentiles( latency_ms ),
+        'latency_us': percentiles( latency_us ),
+        'process_us': {
+            'total': total_ns / 1000,
+            'per_message': total_ns / 1000 / Messages,
+        },
+    }
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+i.control.cmd('setRawIOLoopback')( True )
+i.control.cmd('setRawIOPacketSize')( 64 )
+i.control.loop(1)
+
+# HIDIO_process is called directly
+i.control.refresh_callback()
+
+# Lossless runs first, a lossy run may leave a partially received message behind
+results = []
+for loss in LossRates:
+    for packet_size in PacketSizes:
+        for payload in Payloads:
+            res = run( packet_size, payload, loss )
+            if res is None:
+                logger.info("Packet {:2} Payload {:3}: skipped, larger than the tx buffer", packet_size, payload)
+                continue
+            results.append( res )
+            logger.info(
+                "Packet {:2} Payload {:3} ({:2} pkts) Loss {:4.2f}: {:7.2f} B/ms {:10.0f} B/s p50 {:4} ms p99 {:5} ms {:8.1f} us/msg retx {}",
+                packet_size, payload, res['packets_per_message'], loss,
+                res['throughput_bytes_per_ms'], res['throughput_bytes_per_s'],
+                res['latency_ms']['p50'], res['latency_ms']['p99'],
+                res['process_us']['per_message'], res['retransmits'],
+            )
+
+            # Every message must finish, lossless runs deliver everything first time
+            check( res['stuck'] == 0 )
+            if loss == 0:
+                check( res['delivered'] == Messages )
+                check( res['retransmits'] == 0 )
+                check( res['dropped'] == 0 )
+
+# Smallest messages take one round trip (data, ACK, release)
+check( all( res['latency_ms']['max'] == 3 * LoopMs for res in results if res['loss'] == 0 and res['packets_per_message'] == 1 ) )
+
+# Larger packets move the same payload in fewer loops
+for payload in Payloads:
+    lossless = [ res for res in results if res['payload'] == payload and res['loss'] == 0 ]
+    check( all( lossless[pos]['latency_ms']['p50'] <= lossless[pos - 1]['latency_ms']['p50'] for pos in range( 1, len( lossless ) ) ) )
+
+with open( OutputFile, 'w' ) as output:
+    json.dump( {
+        'benchmark': 'hidio',
+        'config': {
+            'messages': Messages,
+            'loop_ms': LoopMs,
+            'loop_limit': LoopLimit,
+            'seed': Seed,
+            'window': tx_window.size,
+        },
+        'results': results,
+    }, output, indent=2 )
+logger.info("Results written to {}", OutputFile)
+
+
+
+### Results ###
+
+result()
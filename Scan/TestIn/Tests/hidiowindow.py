@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+'''
+HID-IO sliding window tests and throughput benchmark for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+import time
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+# Reference to callback datastructure
+data = i.control.data
+
+kiibohd = i.control.kiibohd
+
+# HID-IO packet types
+Data = 0
+ACK = 1
+Sync = 3
+
+# HID-IO ids
+SupportedId = 0x00
+InfoId = 0x01
+TestId = 0x02
+
+# Info property, transmit window size
+WindowSize = 0x10
+
+# Largest single packet payload (64 byte packets)
+Payload = 60
+
+# Time to run each benchmark pass (seconds)
+BenchmarkTime = 0.5
+
+
+
+### Functions ###
+
+def host_call( idval, payload ):
+    '''
+    Send a call as the host and return the reply (header, id, payload)
+    '''
+    i.control.cmd('HIDIO_host_packet')( Data, idval, payload )
+    i.control.loop(1)
+    check( len( data.rawio_incoming_buffer ) == 1 )
+    reply = data.rawio_incoming_buffer.pop(0)
+    return reply[0], reply[1], list( reply[2] )
+
+
+def set_window( size ):
+    '''
+    Negotiate the transmit window, returns the granted size
+    '''
+    i.control.cmd('setRawIOLoopback')( False )
+    hdr, idval, payload = host_call( InfoId, [ WindowSize, size ] )
+    check( hdr.type == ACK )
+    check( idval == InfoId )
+    check( payload[0] == WindowSize )
+    i.control.cmd('setRawIOLoopback')( True )
+    return payload[1]
+
+
+def data_packets():
+    '''
+    Number of data packets the device sent in the last loop
+    '''
+    return sum( 1 for pkt in data.rawio_outgoing_buffer if pkt[0].type in ( Data, 4 ) )
+
+
+def drain( limit=20 ):
+    '''
+    Loop until nothing is left in flight, returns (loops, data packets sent)
+    '''
+    loops = 0
+    packets = 0
+    while loops < limit:
+        i.control.loop(1)
+        loops += 1
+        packets += data_packets()
+        if len( data.rawio_outgoing_buffer ) == 0:
+            break
+    return loops, packets
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+i.control.cmd('setRawIOPacketSize')( 64 )
+i.control.cmd('setRawIOLoopback')( False )
+
+
+## Negotiation ##
+logger.info(header("-- Window negotiation --"))
+
+# Supported ids, list of 16 bit ids
+hdr, idval, payload = host_call( SupportedId, [] )
+ids = [ payload[pos] | ( payload[pos + 1] << 8 ) for pos in range( 0, len( payload ), 2 ) ]
+logger.info("Supported: {}", [ hex( val ) for val in ids ])
+check( hdr.type == ACK )
+check( all( val in ids for val in ( SupportedId, InfoId, TestId ) ) )
+
+# Query, then request more than the device allows
+hdr, idval, payload = host_call( InfoId, [ WindowSize ] )
+logger.info("Window: {}", payload)
+check( hdr.type == ACK )
+check( payload[1] == 1 ) # Stop-and-wait until negotiated
+
+maximum = set_window( 255 )
+logger.info("Max window: {}", maximum)
+check( maximum >= 1 )
+check( set_window( 0 ) == 1 )
+
+
+## Pipelining ##
+logger.info(header("-- Pipelining --"))
+
+size = set_window( maximum )
+for count in range( size ):
+    i.control.cmd('HIDIO_test_2_request')( Payload, 0xAC )
+
+# Whole window should go out in a single loop
+i.control.loop(1)
+logger.info("Outgoing Buf: {}", len( data.rawio_outgoing_buffer ))
+check( data_packets() == size )
+
+loops, packets = drain()
+logger.info("Drained in {} loops", loops)
+check( len( data.rawio_outgoing_buffer ) == 0 )
+
+
+## Retransmission ##
+logger.info(header("-- Retransmission --"))
+
+for count in range( size ):
+    i.control.cmd('HIDIO_test_2_request')( Payload, 0x5A )
+i.control.loop(1)
+check( data_packets() == size )
+
+# Lose the whole window, then let the retransmit timer expire
+data.rawio_outgoing_buffer.clear()
+now = 1000
+kiibohd.Host_set_systick( now )
+i.control.loop(1)
+logger.info("Outgoing Buf: {}", [ pkt[0].type for pkt in data.rawio_outgoing_buffer ])
+check( len( data.rawio_outgoing_buffer ) == 1 )
+check( data.rawio_outgoing_buffer[0][0].type == Sync )
+
+# Sync request, reply, then everything is resent
+loops, packets = drain()
+logger.info("Resent {} packets in {} loops", packets, loops)
+check( packets == size )
+check( len( data.rawio_outgoing_buffer ) == 0 )
+
+
+## Benchmark ##
+logger.info(header("-- Throughput --"))
+
+results = []
+for size in range( 1, maximum + 1 ):
+    check( set_window( size ) == size )
+
+    sent = 0
+    loops = 0
+    start = time.time()
+    while time.time() - start < BenchmarkTime:
+        for count in range( size ):
+            i.control.cmd('HIDIO_test_2_request')( Payload, 0x33 )
+        batch_loops, packets = drain()
+        loops += batch_loops
+        sent += packets * Payload
+    elapsed = time.time() - start
+
+    results.append( sent / loops )
+    logger.info("Window {}: {:.0f} bytes/s, {:.1f} bytes/loop", size, sent / elapsed, sent / loops)
+
+# Each round trip carries a full window
+check( all( results[pos] > results[pos - 1] for pos in range( 1, len( results ) ) ) )
+
+set_window( 1 )
+kiibohd.Host_set_systick( 0 )
+
+
+
+### Results ###
+
+result()
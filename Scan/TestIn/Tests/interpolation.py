@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+'''
+PixelMap Interpolation Benchmark for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+import time
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+logger.info(header("-- Interpolation Benchmark --"))
+loops = 10000
+results = {}
+
+# Full keyboard gradient, scalar vs. packed paths
+for name, packed in [ ( "Scalar", 0 ), ( "Packed", 1 ) ]:
+    time_start = time.perf_counter()
+    checksum = i.control.cmd('interpolationBenchmark')( packed, loops )
+    time_secs = time.perf_counter() - time_start
+    results[name] = ( checksum, time_secs )
+
+    logger.info(header(name))
+    logger.info(" Checksum: {0:08X}", checksum)
+    logger.info(" Time:     {0:.4f} secs", time_secs)
+    logger.info(" Frames:   {0:.0f} gradients/sec", loops / time_secs)
+
+# Both paths must give identical results
+check( results["Scalar"][0] == results["Packed"][0] )
+logger.info(" Speedup:  {0:.2f}x", results["Scalar"][1] / results["Packed"][1])
+
+
+
+##### Tests Complete #####
+
+result()
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+'''
+STLcd framebuffer rendering test for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+# 5x7 font glyph for '2' (see Scan/Devices/STLcd/font.h)
+glyph_2 = [ 0x42, 0x61, 0x51, 0x49, 0x46 ]
+
+
+
+### Functions ###
+
+def layer_stack( layers ):
+    '''
+    Display the given layer stack (top first), an empty list displays the default image
+    '''
+    args = [ len( layers ) ] + layers + [ 0 ] * ( 4 - len( layers ) )
+    i.control.cmd('capability')('LCD_layerStackExact', None, 0x1, 0x0, args)
+
+
+def dirty_count( mask ):
+    '''
+    Number of dirty pages in mask
+    '''
+    return bin( mask ).count('1')
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+# Default image is flushed at setup
+i.control.loop(1)
+dirty, flushed, spi_bytes = i.control.cmd('lcdInfo')()
+logger.info("Setup: dirty {} flushed {} spi bytes {}", dirty, flushed, spi_bytes)
+check( dirty == 0 )
+
+
+## Unchanged Redraw ##
+logger.info(header("-- Unchanged redraw --"))
+layer_stack( [] )
+check( i.control.cmd('lcdInfo')()[0] == 0 )
+i.control.loop(1)
+check( i.control.cmd('lcdInfo')()[1] == flushed )
+
+
+## Layer Number ##
+logger.info(header("-- Layer number --"))
+layer_stack( [ 2 ] )
+dirty = i.control.cmd('lcdInfo')()[0]
+logger.info("Dirty pages: {:04b}", dirty)
+i.control.cmd('lcdFb')()
+
+fb = i.control.cmd('lcdFramebuffer')()
+
+# Glyph is centered in the first 32x32 cell
+x0 = ( 32 - 5 ) // 2
+y0 = ( 32 - 7 ) // 2
+for col, bits in enumerate( glyph_2 ):
+    for row in range( 8 ):
+        check( fb[ y0 + row ][ x0 + col ] == ( bits >> row ) & 0x1 )
+
+# Remaining cells are blank
+check( all( px == 0 for row in fb for px in row[32:] ) )
+
+# Only the dirty pages are sent
+i.control.loop(1)
+info = i.control.cmd('lcdInfo')()
+check( info[0] == 0 )
+check( info[1] == flushed + dirty_count( dirty ) )
+flushed = info[1]
+
+# Same layer again, nothing to send
+layer_stack( [ 2 ] )
+check( i.control.cmd('lcdInfo')()[0] == 0 )
+
+
+## Text ##
+logger.info(header("-- Text --"))
+spi_bytes = i.control.cmd('lcdInfo')()[2]
+next_x = i.control.cmd('lcdText')( 40, 0, "Hi" )
+check( next_x == 40 + 2 * 6 )
+
+# Page aligned text only touches the first page
+check( i.control.cmd('lcdInfo')()[0] == 0x1 )
+i.control.loop(1)
+info = i.control.cmd('lcdInfo')()
+check( info[1] == flushed + 1 )
+
+# Page address sequence (4 bytes) and one page of data
+check( info[2] == spi_bytes + 4 + 128 )
+i.control.cmd('lcdFb')()
+
+
+
+##### Tests Complete #####
+
+result()
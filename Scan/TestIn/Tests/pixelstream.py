@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+'''
+PixelMap HID-IO Frame Streaming Test Cases for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+import time
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+
+# Reference to callback datastructure
+data = i.control.data
+
+# HIDIO_Id__PixelStream
+PixelStreamId = 0x21
+
+
+
+### Functions ###
+
+def stream_frame( segments ):
+    '''
+    Send each segment of a frame, resending any segment NAK'd due to a full stream buffer
+    Each processing loop also plays back a single frame (if queued)
+
+    Returns the number of packets sent
+    '''
+    packets = 0
+    for seg in segments:
+        while True:
+            i.control.cmd('HIDIO_host_packet')( 0, PixelStreamId, seg )
+            i.control.cmd('setFrameState')( 2 )
+            i.control.loop(1)
+            packets += 1
+
+            # Reply contains [free bytes:2][queued frames:2]
+            check( len( data.rawio_incoming_buffer ) == 1 )
+            reply = data.rawio_incoming_buffer.pop(0)
+            check( reply[1] == PixelStreamId )
+            check( len( reply[2] ) == 4 )
+
+            # ACK, segment queued
+            if reply[0].type == 1:
+                break
+
+            # NAK, buffer is full (segment is valid), retry
+            check( reply[0].type == 2 )
+            free_bytes = reply[2][0] | ( reply[2][1] << 8 )
+            check( free_bytes < len( seg ) + 1 )
+
+    return packets
+
+
+def play_queued():
+    '''
+    Loop until all queued frames have been played
+    '''
+    while i.control.cmd('pixelStreamInfo')()[1] > 0:
+        i.control.cmd('setFrameState')( 2 )
+        i.control.loop(1)
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+i.control.cmd('setRawIOPacketSize')( 64 )
+i.control.cmd('setRawIOLoopback')( False )
+
+# Stop animations so only streamed frames are displayed
+i.control.cmd('setAnimationControl')( 3 )
+i.control.cmd('setFrameState')( 2 )
+i.control.loop(1)
+
+channels = i.control.cmd('pixelStreamInfo')()[0]
+logger.info("Channels: {}", channels)
+
+
+## Raw Frame ##
+logger.info(header("-- Raw frame --"))
+frame = [ 0x20 ] * channels
+stream_frame( i.control.cmd('PixelStream_segments')( frame ) )
+play_queued()
+
+# Check first pixel
+chans, values = i.control.cmd('readPixel')( 1 )
+logger.info("Pixel 1: {} {}", chans, values)
+check( all( val == 0x20 for val in values ) )
+check( i.control.cmd('pixelStreamInfo')()[2] == 1 )
+
+
+## Delta Frame ##
+logger.info(header("-- Delta frame --"))
+previous = frame
+frame = list( previous )
+for ch in chans:
+    frame[ch] = 0x40
+segments = i.control.cmd('PixelStream_segments')( frame, previous )
+check( len( segments ) == 1 )
+stream_frame( segments )
+play_queued()
+
+chans, values = i.control.cmd('readPixel')( 1 )
+logger.info("Pixel 1: {} {}", chans, values)
+check( all( val == 0x40 for val in values ) )
+check( i.control.cmd('pixelStreamInfo')()[2] == 2 )
+
+
+## Invalid Segment ##
+logger.info(header("-- Invalid segment --"))
+i.control.cmd('HIDIO_host_packet')( 0, PixelStreamId, [ 0x80, channels & 0xFF, channels >> 8, 0x00 ] )
+i.control.cmd('setFrameState')( 2 )
+i.control.loop(1)
+check( len( data.rawio_incoming_buffer ) == 1 )
+check( data.rawio_incoming_buffer.pop(0)[0].type == 2 )
+check( i.control.cmd('pixelStreamInfo')()[3] == 1 )
+
+
+## Sustained Frame Rate ##
+for delta in [ False, True ]:
+    print("")
+    logger.info(header("- Sustained {} frame rate -".format( "delta" if delta else "raw" )))
+    time_secs = 0.5
+    time_end = time.time() + time_secs
+    played_start = i.control.cmd('pixelStreamInfo')()[2]
+    packets = 0
+    frames = 0
+    previous = frame
+
+    while time.time() < time_end:
+        # Moving gradient
+        frame = [ ( ch + frames * 4 ) & 0xFF for ch in range( channels ) ]
+        packets += stream_frame( i.control.cmd('PixelStream_segments')( frame, previous if delta else None ) )
+        previous = frame
+        frames += 1
+
+    play_queued()
+    played = i.control.cmd('pixelStreamInfo')()[2] - played_start
+    check( played == frames )
+
+    logger.info(header("Results"))
+    logger.info(" Time:    {0} secs", time_secs)
+    logger.info(" Frames:  {0} ({1} frames/sec)", played, played / time_secs)
+    logger.info(" Packets: {0} ({1} packets/frame)", packets, packets / max( frames, 1 ))
+
+
+
+##### Tests Complete #####
+
+result()
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+'''
+Binary trace stream test for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+import struct
+
+from ctypes import cast, create_string_buffer, c_uint16, c_uint8, POINTER
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+# Reference to callback datastructure
+data = i.control.data
+
+kiibohd = i.control.kiibohd
+kiibohd.Trace_peek.restype = c_uint16
+
+# HIDIO_Id__Trace
+TraceId = 0x22
+
+# Trace events (see Debug/trace/trace.h)
+Sync = 0x00
+Key = 0x10
+Vote = 0x11
+Capability = 0x12
+
+# Schedule states
+Press = 0x01
+Release = 0x03
+
+
+
+### Functions ###
+
+def set_mask( mask ):
+    '''
+    Set the traced event classes
+    '''
+    cast( kiibohd.Trace_mask, POINTER( c_uint8 ) )[0] = mask
+
+
+def records():
+    '''
+    Drain the trace stream, returns a list of (event, arg8, arg16, time) tuples
+
+    Records already streamed over HID-IO are the oldest, each packet is ACK'd so the next can be sent.
+    Whatever is left is read straight from the trace ring.
+    '''
+    raw = b''
+    while len( data.rawio_incoming_buffer ) > 0:
+        packet = data.rawio_incoming_buffer.pop(0)
+        if packet[1] == TraceId and packet[0].type == 0:
+            raw += bytes( packet[2] )
+            i.control.cmd('HIDIO_host_packet')( 1, TraceId, [] )
+
+    buf = create_string_buffer( 256 )
+    while True:
+        length = kiibohd.Trace_peek( buf, len( buf ) )
+        if length == 0:
+            break
+        kiibohd.Trace_consume( length )
+        raw += buf.raw[:length]
+
+    out = [ struct.unpack_from( '<BBHI', raw, offset ) for offset in range( 0, len( raw ), 8 ) ]
+    logger.info( [ "{:02X}:{:02X}:{}".format( *rec[:3] ) for rec in out ] )
+    return out
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+# Records are also streamed over HID-IO, replies go to rawio_incoming_buffer
+i.control.cmd('setRawIOPacketSize')( 64 )
+i.control.cmd('setRawIOLoopback')( False )
+
+i.control.loop(1)
+records()
+
+
+logger.info(header("-- Disabled by default --"))
+i.control.cmd('addScanCode')( 0x01 )
+i.control.loop(1)
+i.control.cmd('removeScanCode')( 0x01 )
+i.control.loop(2)
+check( records() == [] )
+
+
+logger.info(header("-- Key press traces key, vote and capability --"))
+set_mask( 0x07 )
+i.control.cmd('addScanCode')( 0x01 )
+i.control.loop(1)
+trace = records()
+events = [ rec[0] for rec in trace ]
+check( events[0] == Sync )
+check( ( Key, Press, 0x01 ) in [ rec[:3] for rec in trace ] )
+check( Vote in events )
+check( Capability in events )
+check( events.index( Key ) < events.index( Vote ) < events.index( Capability ) )
+
+# Timestamps never go backwards
+times = [ rec[3] for rec in trace ]
+check( times == sorted( times ) )
+
+
+logger.info(header("-- Key release --"))
+i.control.cmd('removeScanCode')( 0x01 )
+i.control.loop(2)
+trace = records()
+check( ( Key, Release, 0x01 ) in [ rec[:3] for rec in trace ] )
+
+
+logger.info(header("-- Masked classes are skipped --"))
+set_mask( 0x01 )
+i.control.cmd('addScanCode')( 0x01 )
+i.control.loop(1)
+i.control.cmd('removeScanCode')( 0x01 )
+i.control.loop(2)
+check( set( rec[0] for rec in records() ) <= { Sync, Key } )
+set_mask( 0x00 )
+
+
+
+##### Tests Complete #####
+
+result()
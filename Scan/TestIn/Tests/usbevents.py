@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+'''
+USB keyboard report event ordering test for Host-side KLL
+'''
+
+# Copyright (C) 2018 by Jacob Alexander
+#
+# This file is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This file is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+### Imports ###
+
+import logging
+import os
+
+import interface as i
+import kiilogger
+
+from common import (check, result, header)
+
+
+
+### Setup ###
+
+# Logger (current file and parent directory only)
+logger = kiilogger.get_logger(os.path.join(os.path.split(__file__)[0], os.path.basename(__file__)))
+logging.root.setLevel(logging.INFO)
+
+# Reference to callback datastructure
+data = i.control.data
+
+# USB Codes
+KEY_A = 0x04
+KEY_B = 0x05
+LSHIFT = 0xE1
+
+
+
+### Functions ###
+
+def reports( events ):
+    '''
+    Apply a list of (usb code, press) events within a single output period
+    Returns the list of reports sent, each as a sorted list of usb codes
+    '''
+    del data.usb_keyboard_history[:]
+    for code, press in events:
+        i.control.cmd('capability')('usbKeyOut', None, 0x1 if press else 0x3, 0x0, [code])
+    i.control.loop(1)
+
+    sent = [ sorted( report.keyboardcodes ) for report in data.usb_keyboard_history ]
+    logger.info("{} -> {}", events, sent)
+    return sent
+
+
+
+### Test ###
+
+# Drop to cli, type exit in the displayed terminal to continue
+#i.control.cli()
+
+i.control.loop(1)
+
+
+logger.info(header("-- Press and release within one period --"))
+check( reports( [ ( KEY_A, True ), ( KEY_A, False ) ] ) == [ [ KEY_A ], [] ] )
+
+
+logger.info(header("-- Chord is compressed --"))
+check( reports( [ ( KEY_A, True ), ( KEY_B, True ) ] ) == [ [ KEY_A, KEY_B ] ] )
+check( reports( [ ( KEY_A, False ), ( KEY_B, False ) ] ) == [ [] ] )
+
+
+logger.info(header("-- Modifier after key --"))
+check( reports( [ ( KEY_A, True ), ( LSHIFT, True ) ] ) == [ [ KEY_A ], [ KEY_A, LSHIFT ] ] )
+check( reports( [ ( KEY_A, False ), ( LSHIFT, False ) ] ) == [ [ LSHIFT ], [] ] )
+
+
+logger.info(header("-- Modifier before key --"))
+check( reports( [ ( LSHIFT, True ), ( KEY_A, True ) ] ) == [ [ KEY_A, LSHIFT ] ] )
+check( reports( [ ( LSHIFT, False ), ( KEY_A, False ) ] ) == [ [] ] )
+
+
+
+##### Tests Complete #####
+
+result()
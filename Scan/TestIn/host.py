@@ -261,6 +261,12 @@ class AnimationStackElement( Structure ):
         ( "pfunc",       c_uint8 ),
         ( "replace",     c_uint8 ),
         ( "state",       c_uint8 ),
+        ( "priority",    c_uint8 ),
+        ( "decimate",    c_uint8 ),
+        ( "wait",        c_uint8 ),
+        ( "overruns",    c_uint16 ),
+        ( "cost",        c_uint32 ),
+        ( "max_cost",    c_uint32 ),
     ]
 
     def frameoption_lookup(self):
@@ -626,6 +632,69 @@ class Commands:
         '''
         cast( control.kiibohd.Pixel_FrameState, POINTER( c_uint8 ) )[0] = state
 
+    def interpolationBenchmark( self, packed, loops ):
+        '''
+        Run the PixelMap interpolation microbenchmark
+        Interpolates a full keyboard gradient loops times
+
+        packed - 0 for the scalar path, 1 for the packed (SWAR) path
+
+        Returns a checksum of the interpolated values
+        '''
+        control.kiibohd.Pixel_interpolationBenchmark.argtypes = [ c_uint8, c_uint32 ]
+        control.kiibohd.Pixel_interpolationBenchmark.restype = c_uint32
+        return control.kiibohd.Pixel_interpolationBenchmark( packed, loops )
+
+    def pixelStreamInfo( self ):
+        '''
+        Returns the HID-IO frame stream counters
+        (total channels, queued frames, played frames, rejected segments)
+        '''
+        return (
+            cast( control.kiibohd.Pixel_TotalChannels_Host, POINTER( c_uint16 ) )[0],
+            cast( control.kiibohd.Pixel_stream_frames, POINTER( c_uint16 ) )[0],
+            cast( control.kiibohd.Pixel_stream_played, POINTER( c_uint32 ) )[0],
+            cast( control.kiibohd.Pixel_stream_rejected, POINTER( c_uint32 ) )[0],
+        )
+
+    def lcdInfo( self ):
+        '''
+        Returns the LCD framebuffer counters
+        (dirty page mask, pages flushed, SPI bytes sent)
+        '''
+        return (
+            cast( control.kiibohd.LCD_dirtyPages, POINTER( c_uint8 ) )[0],
+            cast( control.kiibohd.LCD_pagesFlushed, POINTER( c_uint32 ) )[0],
+            cast( control.kiibohd.SPI_bytesSent, POINTER( c_uint32 ) )[0],
+        )
+
+    def lcdFramebuffer( self ):
+        '''
+        Returns the LCD framebuffer as a list of pixel rows (0 or 1)
+        '''
+        width = 128
+        height = 32
+        fb = cast( control.kiibohd.LCD_framebuffer, POINTER( c_uint8 * ( width * height // 8 ) ) )[0]
+        return [
+            [ ( fb[ ( y // 8 ) * width + x ] >> ( y % 8 ) ) & 0x1 for x in range( width ) ]
+            for y in range( height )
+        ]
+
+    def lcdFb( self ):
+        '''
+        Show current LCD framebuffer
+        '''
+        control.kiibohd.LCD_dispFramebuffer()
+
+    def lcdText( self, x, y, text ):
+        '''
+        Draw text into the LCD framebuffer
+        Returns the x position after the last character
+        '''
+        control.kiibohd.LCD_fbText.argtypes = [ c_uint8, c_uint8, c_char_p ]
+        control.kiibohd.LCD_fbText.restype = c_uint8
+        return control.kiibohd.LCD_fbText( x, y, text.encode('ascii') )
+
     def readPixel( self, index ):
         '''
         Reads pixel at index
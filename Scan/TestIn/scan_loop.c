@@ -33,6 +33,9 @@
 #if defined(Pixel_MapEnabled_define)
 #include <pixel.h>
 #endif
+#if defined(LCDEnabled_define)
+#include <lcd_scan.h>
+#endif
 
 // Local Includes
 #include "scan_loop.h"
@@ -82,6 +85,11 @@ inline void Scan_setup()
 	// Setup Pixel Map
 	Pixel_setup();
 #endif
+
+#if defined(LCDEnabled_define)
+	// Setup LCD framebuffer
+	LCD_setup();
+#endif
 }
 
 
@@ -94,6 +102,11 @@ void Scan_poll()
 	// Prepare any LED events
 	Pixel_process();
 #endif
+
+#if defined(LCDEnabled_define)
+	// Send LCD framebuffer changes
+	LCD_scan();
+#endif
 }
 
 
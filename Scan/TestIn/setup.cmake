@@ -11,6 +11,7 @@
 # Required Submodules
 #
 
+AddModule ( Scan Devices/STLcd )
 
 ###
 # Module C files
@@ -46,8 +47,16 @@ configure_file ( Scan/TestIn/Tests/kiilogger.py  Tests/kiilogger.py  COPYONLY )
 configure_file ( Scan/TestIn/Tests/test.py       Tests/test.py       COPYONLY )
 configure_file ( Scan/TestIn/Tests/kll.py        Tests/kll.py        COPYONLY )
 configure_file ( Scan/TestIn/Tests/layers.py     Tests/layers.py     COPYONLY )
+configure_file ( Scan/TestIn/Tests/lcd.py        Tests/lcd.py        COPYONLY )
 configure_file ( Scan/TestIn/Tests/animation.py  Tests/animation.py  COPYONLY )
 configure_file ( Scan/TestIn/Tests/animation2.py Tests/animation2.py COPYONLY )
+configure_file ( Scan/TestIn/Tests/interpolation.py Tests/interpolation.py COPYONLY )
 configure_file ( Scan/TestIn/Tests/cli.py        Tests/cli.py        COPYONLY )
 configure_file ( Scan/TestIn/Tests/hidio.py      Tests/hidio.py      COPYONLY )
+configure_file ( Scan/TestIn/Tests/hidiobatch.py Tests/hidiobatch.py COPYONLY )
+configure_file ( Scan/TestIn/Tests/hidiobench.py Tests/hidiobench.py COPYONLY )
+configure_file ( Scan/TestIn/Tests/hidiowindow.py Tests/hidiowindow.py COPYONLY )
+configure_file ( Scan/TestIn/Tests/pixelstream.py Tests/pixelstream.py COPYONLY )
+configure_file ( Scan/TestIn/Tests/usbevents.py Tests/usbevents.py COPYONLY )
+configure_file ( Scan/TestIn/Tests/trace.py Tests/trace.py COPYONLY )
 
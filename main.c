@@ -185,6 +185,11 @@ int main()
 		Output_poll();
 		SEGGER_SYSVIEW_OnTaskTerminate(TASK_OUTPUT_POLL);
 
+#if Storage_Enable_define == 1
+		// Non-volatile storage compaction
+		Storage_poll();
+#endif
+
 		SEGGER_SYSVIEW_OnIdle();
 
 #if defined(_sam_)